@@ -0,0 +1,190 @@
+#include "buffer_arena.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+BufferArena::BufferArena(RenderDriver *driver, VkBufferUsageFlags usage, VkDeviceSize blockSize)
+    : driver(driver), usage(usage), blockSize(blockSize)
+{
+    /* 用作 uniform/storage buffer 时 offset 必须满足设备的对齐要求 */
+    const VkPhysicalDeviceLimits& limits = driver->GetPhysicalDeviceProperties().limits;
+
+    if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+        minAlignment = std::max(minAlignment, limits.minUniformBufferOffsetAlignment);
+
+    if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+        minAlignment = std::max(minAlignment, limits.minStorageBufferOffsetAlignment);
+}
+
+BufferArena::~BufferArena()
+{
+    /* 未释放和等待释放的 range 随 block 一起清掉，VkBuffer 由驱动延迟销毁 */
+    pendingFrees.clear();
+
+    for (Block& block : blocks)
+        _DestroyBlock(block);
+    blocks.clear();
+}
+
+VkResult BufferArena::Allocate(VkDeviceSize size, BufferRange *pRange)
+{
+    return Allocate(size, 1, pRange);
+}
+
+VkResult BufferArena::Allocate(VkDeviceSize size, VkDeviceSize alignment, BufferRange *pRange)
+{
+    VkResult err;
+
+    VmaVirtualAllocationCreateInfo allocationCreateInfo = {};
+    allocationCreateInfo.size = size;
+    allocationCreateInfo.alignment = std::max(alignment, minAlignment);
+
+    VmaVirtualAllocation allocation = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+
+    /* 先在已有的 block 里找空间 */
+    uint32_t blockIndex = UINT32_MAX;
+
+    for (uint32_t i = 0; i < std::size(blocks); i++) {
+        if (blocks[i].virtualBlock == VK_NULL_HANDLE || blocks[i].size < size)
+            continue;
+
+        if (vmaVirtualAllocate(blocks[i].virtualBlock, &allocationCreateInfo, &allocation, &offset) == VK_SUCCESS) {
+            blockIndex = i;
+            break;
+        }
+    }
+
+    /* 都放不下时新建一个 block，超过 blockSize 的请求单独占一个 */
+    if (blockIndex == UINT32_MAX) {
+        err = _CreateBlock(std::max(size, blockSize), &blockIndex);
+        if (err != VK_SUCCESS)
+            return err;
+
+        err = vmaVirtualAllocate(blocks[blockIndex].virtualBlock, &allocationCreateInfo, &allocation, &offset);
+        if (err != VK_SUCCESS)
+            return err;
+    }
+
+    pRange->buffer = blocks[blockIndex].buffer;
+    pRange->offset = offset;
+    pRange->size = size;
+    pRange->blockIndex = blockIndex;
+    pRange->allocation = allocation;
+
+    allocatedBytes += size;
+
+    return VK_SUCCESS;
+}
+
+void BufferArena::Free(const BufferRange& range)
+{
+    assert(range.blockIndex < std::size(blocks));
+
+    /* 当前帧的 command buffer 可能还在引用这段数据 */
+    PendingFree pending = {};
+    pending.blockIndex = range.blockIndex;
+    pending.allocation = range.allocation;
+    pending.size = range.size;
+    pending.frameNumber = driver->GetFrameNumber();
+    pendingFrees.push_back(pending);
+}
+
+VkResult BufferArena::Write(const BufferRange& range, VkDeviceSize offset, const void *data, VkDeviceSize size)
+{
+    assert(offset + size <= range.size);
+    return driver->WriteBuffer(range.buffer, range.offset + offset, data, size);
+}
+
+void BufferArena::Collect()
+{
+    uint64_t completedFrameNumber = driver->GetCompletedFrameNumber();
+
+    std::erase_if(pendingFrees, [this, completedFrameNumber](const PendingFree& pending) {
+        if (pending.frameNumber > completedFrameNumber)
+            return false;
+
+        vmaVirtualFree(blocks[pending.blockIndex].virtualBlock, pending.allocation);
+        allocatedBytes -= pending.size;
+        return true;
+    });
+
+    /* 只保留一个空 block 备用，其余的还给驱动；下标要保持稳定，所以只清空不删除 */
+    bool keepEmpty = true;
+
+    for (Block& block : blocks) {
+        if (block.virtualBlock == VK_NULL_HANDLE || !vmaIsVirtualBlockEmpty(block.virtualBlock))
+            continue;
+
+        if (keepEmpty && block.size == blockSize) {
+            keepEmpty = false;
+            continue;
+        }
+
+        _DestroyBlock(block);
+    }
+}
+
+VkDeviceSize BufferArena::GetCapacityBytes() const
+{
+    VkDeviceSize capacity = 0;
+
+    for (const Block& block : blocks) {
+        if (block.virtualBlock != VK_NULL_HANDLE)
+            capacity += block.size;
+    }
+
+    return capacity;
+}
+
+VkResult BufferArena::_CreateBlock(VkDeviceSize size, uint32_t *pBlockIndex)
+{
+    VkResult err;
+
+    Block block = {};
+    block.size = size;
+
+    err = driver->CreateBuffer(size, usage, &block.buffer);
+    if (err != VK_SUCCESS)
+        return err;
+
+    VmaVirtualBlockCreateInfo virtualBlockCreateInfo = {};
+    virtualBlockCreateInfo.size = size;
+
+    err = vmaCreateVirtualBlock(&virtualBlockCreateInfo, &block.virtualBlock);
+    if (err != VK_SUCCESS) {
+        driver->DestroyBuffer(block.buffer);
+        return err;
+    }
+
+    driver->SetBufferName(block.buffer, "arena/block");
+
+    printf("[arena] new block, size=%llu\n", (unsigned long long) size);
+
+    /* 优先复用已经清空的下标 */
+    for (uint32_t i = 0; i < std::size(blocks); i++) {
+        if (blocks[i].virtualBlock == VK_NULL_HANDLE) {
+            blocks[i] = block;
+            *pBlockIndex = i;
+            return VK_SUCCESS;
+        }
+    }
+
+    blocks.push_back(block);
+    *pBlockIndex = static_cast<uint32_t>(std::size(blocks) - 1);
+
+    return VK_SUCCESS;
+}
+
+void BufferArena::_DestroyBlock(Block& block)
+{
+    if (block.virtualBlock == VK_NULL_HANDLE)
+        return;
+
+    /* block 里还有没释放的 range 时 VMA 会断言，这里统一清掉 */
+    vmaClearVirtualBlock(block.virtualBlock);
+    vmaDestroyVirtualBlock(block.virtualBlock);
+    driver->DestroyBuffer(block.buffer);
+
+    block = {};
+}
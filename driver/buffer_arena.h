@@ -0,0 +1,70 @@
+#ifndef BUFFER_ARENA_H_
+#define BUFFER_ARENA_H_
+
+#include "render_driver.h"
+
+// std
+#include <vector>
+
+#define BUFFER_ARENA_DEFAULT_BLOCK_SIZE (64ull * 1024 * 1024)
+
+/* arena 中的一段，绑定时用 buffer + offset */
+typedef struct BufferRange {
+    Buffer buffer = {};
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    uint32_t blockIndex = UINT32_MAX;
+    VmaVirtualAllocation allocation = VK_NULL_HANDLE;
+} BufferRange;
+
+/*
+ * 从少量大 VkBuffer 中切分小块给 mesh、uniform 之类的小数据使用，
+ * 偏移由 VMA 的 virtual block 管理。释放的 range 要等当前帧执行完才能复用。
+ * 和 RenderDriver 的 buffer 一样只能在主线程使用。
+ */
+class BufferArena
+{
+public:
+    BufferArena(RenderDriver *driver, VkBufferUsageFlags usage, VkDeviceSize blockSize = BUFFER_ARENA_DEFAULT_BLOCK_SIZE);
+   ~BufferArena();
+
+    VkResult Allocate(VkDeviceSize size, BufferRange *pRange);
+    VkResult Allocate(VkDeviceSize size, VkDeviceSize alignment, BufferRange *pRange);
+    void Free(const BufferRange& range);
+    VkResult Write(const BufferRange& range, VkDeviceSize offset, const void *data, VkDeviceSize size);
+
+    /* 回收 GPU 已经用完的 range，每帧调用一次 */
+    void Collect();
+
+    uint32_t GetBlockCount() const { return static_cast<uint32_t>(std::size(blocks)); }
+    VkDeviceSize GetAllocatedBytes() const { return allocatedBytes; }
+    VkDeviceSize GetCapacityBytes() const;
+
+private:
+    struct Block {
+        Buffer buffer;
+        VmaVirtualBlock virtualBlock;
+        VkDeviceSize size;
+    };
+
+    struct PendingFree {
+        uint32_t blockIndex;
+        VmaVirtualAllocation allocation;
+        VkDeviceSize size;
+        uint64_t frameNumber;
+    };
+
+    VkResult _CreateBlock(VkDeviceSize size, uint32_t *pBlockIndex);
+    void _DestroyBlock(Block& block);
+
+    RenderDriver *driver = VK_NULL_HANDLE;
+    VkBufferUsageFlags usage = 0;
+    VkDeviceSize blockSize = 0;
+    VkDeviceSize minAlignment = 1;
+    VkDeviceSize allocatedBytes = 0;
+
+    std::vector<Block> blocks;
+    std::vector<PendingFree> pendingFrees;
+};
+
+#endif /* BUFFER_ARENA_H_ */
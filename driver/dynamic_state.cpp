@@ -0,0 +1,84 @@
+#include "dynamic_state.h"
+
+#include <string.h>
+
+void DynamicStateCache::Reset()
+{
+    validBits = 0;
+    issuedCount = 0;
+    skippedCount = 0;
+}
+
+bool DynamicStateCache::_NeedsUpdate(uint32_t bit, bool equal)
+{
+    if ((validBits & bit) && equal) {
+        skippedCount++;
+        return false;
+    }
+
+    validBits |= bit;
+    issuedCount++;
+
+    return true;
+}
+
+void DynamicStateCache::SetViewport(VkCommandBuffer commandBuffer, const VkViewport& viewport)
+{
+    if (!_NeedsUpdate(STATE_VIEWPORT_BIT, memcmp(&this->viewport, &viewport, sizeof(viewport)) == 0))
+        return;
+
+    this->viewport = viewport;
+
+    if (useViewportWithCount)
+        vkCmdSetViewportWithCount(commandBuffer, 1, &viewport);
+    else
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+}
+
+void DynamicStateCache::SetScissor(VkCommandBuffer commandBuffer, const VkRect2D& scissor)
+{
+    if (!_NeedsUpdate(STATE_SCISSOR_BIT, memcmp(&this->scissor, &scissor, sizeof(scissor)) == 0))
+        return;
+
+    this->scissor = scissor;
+
+    if (useViewportWithCount)
+        vkCmdSetScissorWithCount(commandBuffer, 1, &scissor);
+    else
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
+void DynamicStateCache::SetRasterizerDiscardEnable(VkCommandBuffer commandBuffer, VkBool32 enable)
+{
+    if (!_NeedsUpdate(STATE_RASTERIZER_DISCARD_BIT, rasterizerDiscardEnable == enable))
+        return;
+
+    rasterizerDiscardEnable = enable;
+    vkCmdSetRasterizerDiscardEnable(commandBuffer, enable);
+}
+
+void DynamicStateCache::SetRenderState(VkCommandBuffer commandBuffer, const RenderState& state)
+{
+    if (_NeedsUpdate(STATE_TOPOLOGY_BIT, current.topology == state.topology))
+        vkCmdSetPrimitiveTopology(commandBuffer, state.topology);
+
+    if (_NeedsUpdate(STATE_CULL_MODE_BIT, current.cullMode == state.cullMode))
+        vkCmdSetCullMode(commandBuffer, state.cullMode);
+
+    if (_NeedsUpdate(STATE_FRONT_FACE_BIT, current.frontFace == state.frontFace))
+        vkCmdSetFrontFace(commandBuffer, state.frontFace);
+
+    if (_NeedsUpdate(STATE_DEPTH_TEST_BIT, current.depthTestEnable == state.depthTestEnable))
+        vkCmdSetDepthTestEnable(commandBuffer, state.depthTestEnable);
+
+    if (_NeedsUpdate(STATE_DEPTH_WRITE_BIT, current.depthWriteEnable == state.depthWriteEnable))
+        vkCmdSetDepthWriteEnable(commandBuffer, state.depthWriteEnable);
+
+    if (_NeedsUpdate(STATE_DEPTH_COMPARE_OP_BIT, current.depthCompareOp == state.depthCompareOp))
+        vkCmdSetDepthCompareOp(commandBuffer, state.depthCompareOp);
+
+    if (blendEnableDynamic && _NeedsUpdate(STATE_BLEND_ENABLE_BIT, current.blendEnable == state.blendEnable))
+        vkCmdSetColorBlendEnableEXT(commandBuffer, 0, 1, &state.blendEnable);
+
+    current = state;
+}
@@ -0,0 +1,78 @@
+#ifndef DYNAMIC_STATE_H_
+#define DYNAMIC_STATE_H_
+
+#include <volk/volk.h>
+
+/* 顶点输入格式，shader object 路径下也是绑定时动态设置 */
+typedef enum VertexLayout {
+    VERTEX_LAYOUT_DEFAULT = 0,      // binding 0：position + color
+    VERTEX_LAYOUT_INSTANCED,        // 再加 binding 1：每个实例一个 mat4，占 location 2~5
+    VERTEX_LAYOUT_NONE,             // 没有顶点输入，shader 按 gl_VertexIndex 通过地址读取顶点
+    VERTEX_LAYOUT_COUNT,
+} VertexLayout;
+
+/* 材质相关、可以动态设置的渲染状态，同一个 pipeline 可以服务多种材质 */
+typedef struct RenderState {
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    VkBool32 depthTestEnable = VK_FALSE;
+    VkBool32 depthWriteEnable = VK_FALSE;
+    VkCompareOp depthCompareOp = VK_COMPARE_OP_GREATER_OR_EQUAL;     // reverse-Z，近处深度大
+    VkBool32 blendEnable = VK_FALSE;
+} RenderState;
+
+/*
+ * CPU 端记录 command buffer 当前的动态状态，值没变的 vkCmdSet* 直接跳过。
+ * 每个新的 command buffer 开始录制前必须 Reset()。
+ */
+class DynamicStateCache
+{
+public:
+    void Reset();
+    /* 绑定了动态状态集合不同的 pipeline 后，之前设置的值不再可信，下次全部重新设置 */
+    void Invalidate() { validBits = 0; }
+
+    /* shader object 路径只能用 *WithCount 版本设置 viewport/scissor */
+    void SetUseViewportWithCount(bool enable) { useViewportWithCount = enable; }
+    /* 没有 extendedDynamicState3ColorBlendEnable 时 blendEnable 烘焙在 pipeline 里 */
+    void SetBlendEnableDynamic(bool enable) { blendEnableDynamic = enable; }
+
+    void SetViewport(VkCommandBuffer commandBuffer, const VkViewport& viewport);
+    void SetScissor(VkCommandBuffer commandBuffer, const VkRect2D& scissor);
+    void SetRasterizerDiscardEnable(VkCommandBuffer commandBuffer, VkBool32 enable);
+    void SetRenderState(VkCommandBuffer commandBuffer, const RenderState& state);
+
+    uint32_t GetIssuedCount() const { return issuedCount; }
+    uint32_t GetSkippedCount() const { return skippedCount; }
+
+private:
+    enum StateBits {
+        STATE_VIEWPORT_BIT             = 1 << 0,
+        STATE_SCISSOR_BIT              = 1 << 1,
+        STATE_RASTERIZER_DISCARD_BIT   = 1 << 2,
+        STATE_TOPOLOGY_BIT             = 1 << 3,
+        STATE_CULL_MODE_BIT            = 1 << 4,
+        STATE_FRONT_FACE_BIT           = 1 << 5,
+        STATE_DEPTH_TEST_BIT           = 1 << 6,
+        STATE_DEPTH_WRITE_BIT          = 1 << 7,
+        STATE_DEPTH_COMPARE_OP_BIT     = 1 << 8,
+        STATE_BLEND_ENABLE_BIT         = 1 << 9,
+    };
+
+    bool _NeedsUpdate(uint32_t bit, bool equal);
+
+    uint32_t validBits = 0;
+    bool useViewportWithCount = false;
+    bool blendEnableDynamic = false;
+
+    VkViewport viewport = {};
+    VkRect2D scissor = {};
+    VkBool32 rasterizerDiscardEnable = VK_FALSE;
+    RenderState current = {};
+
+    uint32_t issuedCount = 0;
+    uint32_t skippedCount = 0;
+};
+
+#endif /* DYNAMIC_STATE_H_ */
@@ -0,0 +1,94 @@
+#ifndef HANDLE_POOL_H_
+#define HANDLE_POOL_H_
+
+#include <stdint.h>
+#include <assert.h>
+
+// std
+#include <vector>
+
+/*
+ * 32 位代际句柄：低 20 位是 slot 下标，高 12 位是 generation。
+ * slot 释放时 generation 加一，旧句柄再访问就能被检测出来；0 永远是空句柄。
+ */
+#define HANDLE_INDEX_BITS 20
+#define HANDLE_INDEX_MASK ((1u << HANDLE_INDEX_BITS) - 1)
+#define HANDLE_GENERATION_MASK ((1u << (32 - HANDLE_INDEX_BITS)) - 1)
+#define HANDLE_MAX_SLOTS (1u << HANDLE_INDEX_BITS)
+
+/*
+ * 只负责分配 slot 和校验句柄，资源数据由使用方按 slot 下标存放在自己的 SoA 数组里。
+ * 存活的 slot 同时记录在一个紧凑数组中，逐帧遍历时不用跳过空洞。
+ */
+class HandlePool
+{
+public:
+    static uint32_t IndexOf(uint32_t handle) { return handle & HANDLE_INDEX_MASK; }
+    static uint32_t GenerationOf(uint32_t handle) { return handle >> HANDLE_INDEX_BITS; }
+
+    uint32_t Allocate()
+    {
+        uint32_t index;
+
+        if (!freeSlots.empty()) {
+            index = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            index = static_cast<uint32_t>(std::size(generations));
+            assert(index < HANDLE_MAX_SLOTS);
+            generations.push_back(1);
+            denseIndices.push_back(UINT32_MAX);
+        }
+
+        denseIndices[index] = static_cast<uint32_t>(std::size(liveSlots));
+        liveSlots.push_back(index);
+
+        return (generations[index] << HANDLE_INDEX_BITS) | index;
+    }
+
+    void Free(uint32_t handle)
+    {
+        assert(IsValid(handle));
+
+        uint32_t index = IndexOf(handle);
+
+        /* 和最后一个存活 slot 交换后删除，O(1) */
+        uint32_t dense = denseIndices[index];
+        uint32_t last = liveSlots.back();
+        liveSlots[dense] = last;
+        denseIndices[last] = dense;
+        liveSlots.pop_back();
+        denseIndices[index] = UINT32_MAX;
+
+        /* generation 跳过 0，保证句柄值永远不为 0 */
+        uint32_t generation = (generations[index] + 1) & HANDLE_GENERATION_MASK;
+        generations[index] = generation == 0 ? 1 : generation;
+
+        freeSlots.push_back(index);
+    }
+
+    bool IsValid(uint32_t handle) const
+    {
+        uint32_t index = IndexOf(handle);
+
+        if (handle == 0 || index >= std::size(generations))
+            return false;
+
+        return denseIndices[index] != UINT32_MAX && generations[index] == GenerationOf(handle);
+    }
+
+    /* SoA 数组的长度至少要等于 slot 数 */
+    uint32_t GetCapacity() const { return static_cast<uint32_t>(std::size(generations)); }
+    uint32_t GetLiveCount() const { return static_cast<uint32_t>(std::size(liveSlots)); }
+    const std::vector<uint32_t>& GetLiveSlots() const { return liveSlots; }
+
+    uint32_t GetHandle(uint32_t index) const { return (generations[index] << HANDLE_INDEX_BITS) | index; }
+
+private:
+    std::vector<uint32_t> generations;
+    std::vector<uint32_t> denseIndices;
+    std::vector<uint32_t> liveSlots;
+    std::vector<uint32_t> freeSlots;
+};
+
+#endif /* HANDLE_POOL_H_ */
@@ -0,0 +1,85 @@
+#include "pipeline_manifest.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#define PIPELINE_MANIFEST_HEADER "# ashlands pipeline manifest v3"
+
+bool LoadPipelineManifest(const char *path, std::vector<PipelineUsage>& usages)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return false;
+
+    char line[256];
+
+    if (fgets(line, sizeof(line), file) == NULL || strncmp(line, PIPELINE_MANIFEST_HEADER, strlen(PIPELINE_MANIFEST_HEADER)) != 0) {
+        printf("[pipeline] ignore manifest %s, unknown version\n", path);
+        fclose(file);
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        PipelineUsage usage = {};
+        uint32_t topology, cullMode, frontFace, depthTestEnable, depthWriteEnable, depthCompareOp, blendEnable, vertexLayout, depthOnly;
+        unsigned long long firstFrame;
+
+        int count = sscanf(line, "%63s %u %u %u %u %u %u %u %u %u %u %llu",
+            usage.shaderName, &topology, &cullMode, &frontFace,
+            &depthTestEnable, &depthWriteEnable, &depthCompareOp, &blendEnable, &vertexLayout, &depthOnly,
+            &usage.useCount, &firstFrame);
+
+        if (count != 12 || vertexLayout >= VERTEX_LAYOUT_COUNT)
+            continue;
+
+        usage.renderState.topology = (VkPrimitiveTopology) topology;
+        usage.renderState.cullMode = cullMode;
+        usage.renderState.frontFace = (VkFrontFace) frontFace;
+        usage.renderState.depthTestEnable = depthTestEnable;
+        usage.renderState.depthWriteEnable = depthWriteEnable;
+        usage.renderState.depthCompareOp = (VkCompareOp) depthCompareOp;
+        usage.renderState.blendEnable = blendEnable;
+        usage.vertexLayout = (VertexLayout) vertexLayout;
+        usage.depthOnly = depthOnly != 0;
+        usage.firstFrame = firstFrame;
+
+        usages.push_back(usage);
+    }
+
+    fclose(file);
+
+    return true;
+}
+
+bool SavePipelineManifest(const char *path, const std::vector<PipelineUsage>& usages)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+        return false;
+
+    fprintf(file, "%s\n", PIPELINE_MANIFEST_HEADER);
+
+    for (const PipelineUsage& usage : usages) {
+        const RenderState& state = usage.renderState;
+        fprintf(file, "%s %u %u %u %u %u %u %u %u %u %u %llu\n",
+            usage.shaderName,
+            (uint32_t) state.topology, (uint32_t) state.cullMode, (uint32_t) state.frontFace,
+            (uint32_t) state.depthTestEnable, (uint32_t) state.depthWriteEnable,
+            (uint32_t) state.depthCompareOp, (uint32_t) state.blendEnable,
+            (uint32_t) usage.vertexLayout, (uint32_t) usage.depthOnly, usage.useCount, (unsigned long long) usage.firstFrame);
+    }
+
+    fclose(file);
+
+    return true;
+}
+
+void SortPipelineUsagesByPriority(std::vector<PipelineUsage>& usages)
+{
+    std::stable_sort(usages.begin(), usages.end(), [](const PipelineUsage& a, const PipelineUsage& b) {
+        if (a.firstFrame != b.firstFrame)
+            return a.firstFrame < b.firstFrame;
+        return a.useCount > b.useCount;
+    });
+}
@@ -0,0 +1,25 @@
+#ifndef PIPELINE_MANIFEST_H_
+#define PIPELINE_MANIFEST_H_
+
+#include "dynamic_state.h"
+
+// std
+#include <vector>
+
+/* 一次运行中创建过的 pipeline 记录，下次启动时按优先级预编译 */
+typedef struct PipelineUsage {
+    char shaderName[64] = {};
+    RenderState renderState = {};
+    VertexLayout vertexLayout = VERTEX_LAYOUT_DEFAULT;
+    bool depthOnly = false;
+    uint32_t useCount = 0;
+    uint64_t firstFrame = 0;
+} PipelineUsage;
+
+bool LoadPipelineManifest(const char *path, std::vector<PipelineUsage>& usages);
+bool SavePipelineManifest(const char *path, const std::vector<PipelineUsage>& usages);
+
+/* 越早被用到、使用次数越多的排在前面 */
+void SortPipelineUsagesByPriority(std::vector<PipelineUsage>& usages);
+
+#endif /* PIPELINE_MANIFEST_H_ */
@@ -4,6 +4,8 @@
 #include "render_driver.h"
 
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
 #include "vkutils.h"
 #include "utils/ioutils.h"
 
@@ -13,19 +15,139 @@
     if (err != VK_SUCCESS) \
         return err;
 
+/* 堆用量超过预算的 90% 开始驱逐，一直驱逐到 80% 以下，留出余量避免每帧来回抖动 */
+#define MEMORY_BUDGET_EVICT_THRESHOLD 0.9
+#define MEMORY_BUDGET_EVICT_TARGET 0.8
+
+/* 每帧碎片整理搬动的上限，拷贝放在帧开始前的单独提交里 */
+#define DEFRAG_MAX_BYTES_PER_PASS (16ull * 1024 * 1024)
+#define DEFRAG_MAX_ALLOCATIONS_PER_PASS 64
+
+/* 所有 buffer 都可以作为拷贝源和目标：staging 写入、碎片整理搬动 */
+#define BUFFER_IMPLICIT_USAGE (VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT)
+
+/* 每帧临时分配的页面可以用作任何 buffer，线性池里的一个 block 能放下若干页 */
+#define TRANSIENT_BUFFER_USAGE (VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | \
+    VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | \
+    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)
+#define TRANSIENT_POOL_BLOCK_SIZE (32ull * 1024 * 1024)
+
 /* volk 全局只初始化一次 */
 static bool volkInitialized = false;
 
-struct Buffer_T {
-    VkBuffer vkBuffer = VK_NULL_HANDLE;
-    VmaAllocation allocation = VK_NULL_HANDLE;
-    VkBufferUsageFlagBits usage = VK_BUFFER_USAGE_FLAG_BITS_MAX_ENUM;
-    VkDeviceSize size = 0;
+/* FNV-1a，用于 pipeline library 的缓存 key */
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static uint64_t HashBytes(uint64_t hash, const void *data, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t *) data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t HashString(uint64_t hash, const char *str)
+{
+    return HashBytes(hash, str, strlen(str));
+}
+
+/* 动态 topology 只能在同一类别内切换，pipeline 只需要区分类别 */
+static uint32_t TopologyClass(VkPrimitiveTopology topology)
+{
+    switch (topology) {
+        case VK_PRIMITIVE_TOPOLOGY_POINT_LIST:
+            return 0;
+        case VK_PRIMITIVE_TOPOLOGY_LINE_LIST:
+        case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP:
+        case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY:
+        case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY:
+            return 1;
+        case VK_PRIMITIVE_TOPOLOGY_PATCH_LIST:
+            return 3;
+        default:
+            return 2;
+    }
+}
+
+/*
+ * 读取 SPIR-V，文件不存在或者还没写完时返回 NULL。
+ * 热重载和后台编译都运行在没有异常处理的线程上，io_read_bytecode 的异常不能传出去。
+ */
+static char *LoadShaderCode(const char *path, size_t *size)
+{
+    char *buf = NULL;
+
+    try {
+        buf = io_read_bytecode(path, size);
+    } catch (const std::exception& e) {
+        printf("[vulkan] load shader %s failed: %s\n", path, e.what());
+        return NULL;
+    }
+
+    /* SPIR-V 按 32 位字存储，长度不对说明文件正在被改写 */
+    if (*size == 0 || (*size % sizeof(uint32_t)) != 0) {
+        printf("[vulkan] load shader %s failed: invalid code size %zu\n", path, *size);
+        io_free_buf(buf);
+        return NULL;
+    }
+
+    return buf;
+}
+
+/* 顶点格式：position + color */
+static const VkVertexInputAttributeDescription vertexInputAttributeDescriptions[] = {
+    { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 },
+    { 1, 0, VK_FORMAT_R32G32B32_SFLOAT, sizeof(float) * 3 },
+};
+
+static const VkVertexInputBindingDescription vertexInputBindingDescriptions[] = {
+    { 0, sizeof(float) * 6, VK_VERTEX_INPUT_RATE_VERTEX }
+};
+
+/* 实例化：binding 1 每个实例一个列主序的 mat4，每列占一个 location */
+static const VkVertexInputAttributeDescription instancedInputAttributeDescriptions[] = {
+    { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 },
+    { 1, 0, VK_FORMAT_R32G32B32_SFLOAT, sizeof(float) * 3 },
+    { 2, 1, VK_FORMAT_R32G32B32A32_SFLOAT, sizeof(float) * 0 },
+    { 3, 1, VK_FORMAT_R32G32B32A32_SFLOAT, sizeof(float) * 4 },
+    { 4, 1, VK_FORMAT_R32G32B32A32_SFLOAT, sizeof(float) * 8 },
+    { 5, 1, VK_FORMAT_R32G32B32A32_SFLOAT, sizeof(float) * 12 },
+};
+
+static const VkVertexInputBindingDescription instancedInputBindingDescriptions[] = {
+    { 0, sizeof(float) * 6, VK_VERTEX_INPUT_RATE_VERTEX },
+    { 1, sizeof(float) * 16, VK_VERTEX_INPUT_RATE_INSTANCE },
 };
 
+typedef struct VertexInputLayout {
+    const VkVertexInputBindingDescription *pBindings;
+    uint32_t bindingCount;
+    const VkVertexInputAttributeDescription *pAttributes;
+    uint32_t attributeCount;
+} VertexInputLayout;
+
+/* 按 VertexLayout 下标 */
+static const VertexInputLayout vertexInputLayouts[VERTEX_LAYOUT_COUNT] = {
+    { vertexInputBindingDescriptions, ARRAY_SIZE(vertexInputBindingDescriptions), vertexInputAttributeDescriptions, ARRAY_SIZE(vertexInputAttributeDescriptions) },
+    { instancedInputBindingDescriptions, ARRAY_SIZE(instancedInputBindingDescriptions), instancedInputAttributeDescriptions, ARRAY_SIZE(instancedInputAttributeDescriptions) },
+    { NULL, 0, NULL, 0 },
+};
+
+#define MAX_VERTEX_INPUT_BINDINGS 2
+#define MAX_VERTEX_INPUT_ATTRIBUTES 6
+
 struct Pipeline_T {
     VkPipeline vkPipeline = VK_NULL_HANDLE;
+    VkShaderEXT shaders[SHADER_OBJECT_STAGE_COUNT] = {};
     VkPipelineLayout vkPipelineLayout = VK_NULL_HANDLE;
+    PipelineDesc desc = {};                 // renderState 是这个句柄绑定时的默认值
+    char shaderName[64] = {};
+    uint64_t key = 0;                       // sharedPipelines 里的编译结果
+    bool compute = false;
+    bool mesh = false;
 };
 
 RenderDriver::RenderDriver()
@@ -62,6 +184,58 @@ RenderDriver::RenderDriver()
 
 RenderDriver::~RenderDriver()
 {
+    shaderWatcher.Stop();
+    jobSystem.Shutdown();
+
+    if (device != VK_NULL_HANDLE)
+        vkDeviceWaitIdle(device);
+
+    _DestroyWarmPipelines(VK_NULL_HANDLE);
+
+    for (const PipelineSwap &swap : pendingPipelineSwaps)
+        _DestroyPipelineObjects(swap.vkPipeline, swap.shaders);
+    pendingPipelineSwaps.clear();
+
+    _RetireDepthImage(frameNumber);
+
+    completedFrameNumber = UINT64_MAX;
+    _EndDefragmentation();
+    _CollectRetiredObjects();
+    _DestroyPipelineLibraries();
+
+    /* 没有显式销毁的资源统一回收 */
+    for (const auto& entry : sharedPipelines)
+        _DestroyPipelineObjects(entry.second.vkPipeline, entry.second.shaders);
+
+    if (buffers.handles.GetLiveCount() > 0)
+        printf("[vulkan] %u buffers not destroyed before shutdown\n", buffers.handles.GetLiveCount());
+
+    /* 每次运行结束打印累计计数，方便比较不同版本的显存使用 */
+    for (uint32_t i = 0; i < std::size(heapCounters); i++) {
+        const MemoryHeapStats& counters = heapCounters[i];
+        if (counters.totalAllocations == 0)
+            continue;
+
+        printf("[vulkan] heap %u: %llu buffers allocated (%llu bytes), %llu freed (%llu bytes)\n", i,
+            (unsigned long long) counters.totalAllocations, (unsigned long long) counters.totalAllocatedBytes,
+            (unsigned long long) counters.totalFrees, (unsigned long long) counters.totalFreedBytes);
+    }
+
+    for (uint32_t slot : buffers.handles.GetLiveSlots()) {
+        if (buffers.importedMemories[slot] != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, buffers.vkBuffers[slot], VK_NULL_HANDLE);
+            vkFreeMemory(device, buffers.importedMemories[slot], VK_NULL_HANDLE);
+            continue;
+        }
+
+        vmaDestroyBuffer(memoryAllocator, buffers.vkBuffers[slot], buffers.allocations[slot]);
+    }
+
+    vkDestroyPipelineLayout(device, pipelineLayout, VK_NULL_HANDLE);
+    vkDestroyFence(device, defragFence, VK_NULL_HANDLE);
+
+    _DestroyTransientPools();
+    _DestroyFrameResources();
     vkDestroyCommandPool(device, commandPool, VK_NULL_HANDLE);
     // vkDestroySwapchainKHR(device, swapchain, VK_NULL_HANDLE);
     _DestroySwapchain();
@@ -86,446 +260,3264 @@ VkResult RenderDriver::Initialize(VkSurfaceKHR surface)
     err = _CreateCommandPool();
     VK_CHECK_ERROR(err);
 
+    err = _CreateFrameResources();
+    VK_CHECK_ERROR(err);
+
     err = _CreateMemoryAllocator();
     VK_CHECK_ERROR(err);
 
+    err = _CreateTransientPools();
+    VK_CHECK_ERROR(err);
+
+    err = _CreateDepthImage();
+    VK_CHECK_ERROR(err);
+
+    err = _CreatePipelineLayout();
+    VK_CHECK_ERROR(err);
+
     return err;
 }
 
 VkResult RenderDriver::CreateBuffer(size_t size, VkBufferUsageFlags usage, Buffer *pBuffer)
 {
+    return _CreateBuffer(size, usage, 0, pBuffer);
+}
+
+VkResult RenderDriver::AllocateTransient(VkDeviceSize size, VkDeviceSize alignment, TransientBuffer *pBuffer)
+{
+    VkResult err;
+
+    assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+    uint32_t frameIndex = frameNumber % MAX_FRAMES_IN_FLIGHT;
+    FrameContext *frame = &frames[frameIndex];
+
+    /* 这一帧第一次分配，之前的内容整体作废 */
+    if (frame->transientFrameNumber != frameNumber)
+        _ResetTransientPages(frameIndex);
+
+    alignment = std::max(alignment, transientAlignment);
+
+    /* 热路径：在当前页面里移动指针，放不下就换下一页 */
+    for (;;) {
+        if (frame->transientPageIndex >= std::size(frame->transientPages)) {
+            err = _AllocateTransientPage(frameIndex, std::max(size, (VkDeviceSize) TRANSIENT_PAGE_SIZE));
+            VK_CHECK_ERROR(err);
+        }
+
+        TransientPage& page = frame->transientPages[frame->transientPageIndex];
+        VkDeviceSize offset = (page.offset + alignment - 1) & ~(alignment - 1);
+
+        if (offset + size <= page.size) {
+            page.offset = offset + size;
+
+            pBuffer->buffer = page.vkBuffer;
+            pBuffer->offset = offset;
+            pBuffer->size = size;
+            pBuffer->pMapped = page.pMapped + offset;
+            pBuffer->address = page.address + offset;
+
+            return VK_SUCCESS;
+        }
+
+        frame->transientPageIndex++;
+    }
+}
+
+VkResult RenderDriver::CreateStreamableBuffer(size_t size, VkBufferUsageFlags usage, BufferEvictCallback onEvict, Buffer *pBuffer)
+{
+    VkResult err;
+
+    /* 超出预算时直接失败，由调用方稍后重试，而不是挤占常驻资源 */
+    err = _CreateBuffer(size, usage, VMA_ALLOCATION_CREATE_WITHIN_BUDGET_BIT, pBuffer);
+    VK_CHECK_ERROR(err);
+
+    buffers.evictCallbacks[HandlePool::IndexOf(pBuffer->id)] = std::move(onEvict);
+
+    return err;
+}
+
+VkResult RenderDriver::_CreateBuffer(size_t size, VkBufferUsageFlags usage, VmaAllocationCreateFlags allocationFlags, Buffer *pBuffer)
+{
+    VkResult err;
+
     VkBufferCreateInfo bufferCreateInfo = {};
     bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bufferCreateInfo.size = size;
-    bufferCreateInfo.usage = usage;
+    bufferCreateInfo.usage = usage | BUFFER_IMPLICIT_USAGE;
     bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    /* 优先选可映射的显存，没有的话 VMA 会退回到只能靠 transfer 写入的显存 */
+    VmaAllocationCreateInfo allocationCreateInfo = {};
+    allocationCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+    allocationCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
+                                 | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT
+                                 | allocationFlags;
+
+    VkBuffer vkBuffer = VK_NULL_HANDLE;
+    VmaAllocation allocation = VK_NULL_HANDLE;
+    VmaAllocationInfo allocationInfo = {};
+
+    err = vmaCreateBuffer(memoryAllocator, &bufferCreateInfo, &allocationCreateInfo, &vkBuffer, &allocation, &allocationInfo);
+    VK_CHECK_ERROR(err);
+
+    const VkPhysicalDeviceMemoryProperties *memoryProperties = VK_NULL_HANDLE;
+    vmaGetMemoryProperties(memoryAllocator, &memoryProperties);
+
+    uint32_t handle = _AllocateBufferSlot();
+    uint32_t slot = HandlePool::IndexOf(handle);
+
+    buffers.vkBuffers[slot] = vkBuffer;
+    buffers.allocations[slot] = allocation;
+    buffers.sizes[slot] = size;
+    buffers.usages[slot] = usage;
+    buffers.addresses[slot] = 0;
+    buffers.heapIndices[slot] = memoryProperties->memoryTypes[allocationInfo.memoryType].heapIndex;
+    buffers.lastUsedFrames[slot] = frameNumber;
+    buffers.evictCallbacks[slot] = {};
+    buffers.moving[slot] = 0;
+
+    MemoryHeapStats& counters = heapCounters[buffers.heapIndices[slot]];
+    counters.totalAllocations++;
+    counters.totalAllocatedBytes += size;
+
+    /* 碎片整理时通过 user data 找回 buffer */
+    vmaSetAllocationUserData(memoryAllocator, allocation, (void *) (uintptr_t) handle);
+
+    /* 地址在 buffer 生命周期内不变，创建时查一次 */
+    if (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
+        VkBufferDeviceAddressInfo bufferDeviceAddressInfo = {};
+        bufferDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+        bufferDeviceAddressInfo.buffer = vkBuffer;
+        buffers.addresses[slot] = vkGetBufferDeviceAddress(device, &bufferDeviceAddressInfo);
+    }
+
+    pBuffer->id = handle;
+
+    return err;
 }
 
-void RenderDriver::DestroyBuffer(Buffer buffer)
+uint32_t RenderDriver::_AllocateBufferSlot()
 {
+    uint32_t handle = buffers.handles.Allocate();
+    uint32_t slot = HandlePool::IndexOf(handle);
+
+    /* 用到新 slot 时各列一起扩容 */
+    if (slot >= std::size(buffers.vkBuffers)) {
+        uint32_t capacity = buffers.handles.GetCapacity();
+        buffers.vkBuffers.resize(capacity, VK_NULL_HANDLE);
+        buffers.allocations.resize(capacity, VK_NULL_HANDLE);
+        buffers.sizes.resize(capacity, 0);
+        buffers.usages.resize(capacity, 0);
+        buffers.addresses.resize(capacity, 0);
+        buffers.heapIndices.resize(capacity, 0);
+        buffers.lastUsedFrames.resize(capacity, 0);
+        buffers.evictCallbacks.resize(capacity);
+        buffers.moving.resize(capacity, 0);
+        buffers.importedMemories.resize(capacity, VK_NULL_HANDLE);
+    }
 
+    return handle;
 }
 
-VkResult RenderDriver::CreatePipeline(const char *shaderName, Pipeline* pPipeline)
+VkResult RenderDriver::ImportHostBuffer(const void *pHostPointer, size_t size, Buffer *pBuffer)
 {
     VkResult err;
 
-    /* VkPipelineLayoutCreateInfo */
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 0;
-    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    if (!externalMemoryHostEnabled)
+        return VK_ERROR_EXTENSION_NOT_PRESENT;
 
-    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
-    err = vkCreatePipelineLayout(device, &pipelineLayoutInfo, VK_NULL_HANDLE, &pipelineLayout);
-    VK_CHECK_ERROR(err);
+    if (size == 0)
+        return VK_ERROR_INITIALIZATION_FAILED;
 
-    /* shader module */
-    VkShaderModule vertexShaderModule = VK_NULL_HANDLE;
-    VkShaderModule fragmentShaderModule = VK_NULL_HANDLE;
+    /*
+     * 指针和导入的大小都要按 minImportedHostPointerAlignment 对齐。
+     * 映射只保证覆盖到页尾，对齐要求比页大时导入的范围会超出映射，只能让调用方退回 staging 上传。
+     */
+    const VkDeviceSize alignment = minImportedHostPointerAlignment;
+    const VkDeviceSize pageSize = io_page_size();
+    VkDeviceSize importSize = (size + alignment - 1) & ~(alignment - 1);
+    VkDeviceSize mappedSize = (size + pageSize - 1) & ~(pageSize - 1);
 
-    err = _CreateShaderModule(shaderName, "vert", &vertexShaderModule);
-    VK_CHECK_ERROR(err);
+    if (((uintptr_t) pHostPointer & (alignment - 1)) != 0 || importSize > mappedSize)
+        return VK_ERROR_FEATURE_NOT_PRESENT;
+
+    VkMemoryHostPointerPropertiesEXT hostPointerProperties = {};
+    hostPointerProperties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
 
-    err = _CreateShaderModule(shaderName, "frag", &fragmentShaderModule);
+    err = vkGetMemoryHostPointerPropertiesEXT(device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, pHostPointer, &hostPointerProperties);
     VK_CHECK_ERROR(err);
 
-    /* VkPipelineShaderStageCreateInfo */
-    VkPipelineShaderStageCreateInfo shaderStagesCreateInfo[] = {
-        {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-            .stage = VK_SHADER_STAGE_VERTEX_BIT,
-            .module = vertexShaderModule,
-            .pName = "main",
-        },
-        {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-            .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-            .module = fragmentShaderModule,
-            .pName = "main",
-        }
-    };
+    VkExternalMemoryBufferCreateInfo externalMemoryBufferCreateInfo = {};
+    externalMemoryBufferCreateInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+    externalMemoryBufferCreateInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
 
-    /* VkVertexInputAttributeDescription */
-    VkVertexInputAttributeDescription vertexInputAttributeDescriptions[] = {
-        { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 },
-        { 1, 0, VK_FORMAT_R32G32B32_SFLOAT, sizeof(float) * 3 },
-    };
+    VkBufferCreateInfo bufferCreateInfo = {};
+    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferCreateInfo.pNext = &externalMemoryBufferCreateInfo;
+    bufferCreateInfo.size = size;
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    VkVertexInputBindingDescription vertexInputBindingDescriptions[] = {
-        { 0, sizeof(float) * 6, VK_VERTEX_INPUT_RATE_VERTEX }
-    };
+    VkBuffer vkBuffer = VK_NULL_HANDLE;
+    err = vkCreateBuffer(device, &bufferCreateInfo, VK_NULL_HANDLE, &vkBuffer);
+    VK_CHECK_ERROR(err);
 
-    VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo = {};
-    vertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputStateCreateInfo.vertexBindingDescriptionCount = ARRAY_SIZE(vertexInputBindingDescriptions);
-    vertexInputStateCreateInfo.pVertexBindingDescriptions = &vertexInputBindingDescriptions[0];
-    vertexInputStateCreateInfo.vertexAttributeDescriptionCount = ARRAY_SIZE(vertexInputAttributeDescriptions);
-    vertexInputStateCreateInfo.pVertexAttributeDescriptions = &vertexInputAttributeDescriptions[0];
+    VkMemoryRequirements memoryRequirements = {};
+    vkGetBufferMemoryRequirements(device, vkBuffer, &memoryRequirements);
+    assert(memoryRequirements.size <= importSize);
 
-    /* VkPipelineInputAssemblyStateCreateInfo */
-    VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCreateInfo = {};
-    inputAssemblyStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssemblyStateCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssemblyStateCreateInfo.primitiveRestartEnable = VK_FALSE;
+    /* 取第一个同时满足 buffer 和 host 指针要求的内存类型 */
+    uint32_t memoryTypeBits = memoryRequirements.memoryTypeBits & hostPointerProperties.memoryTypeBits;
+    uint32_t memoryTypeIndex = 0;
 
-    /* VkPipelineRasterizationStateCreateInfo */
-    VkPipelineRasterizationStateCreateInfo rasterizationStateCreateInfo = {};
-    rasterizationStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizationStateCreateInfo.depthClampEnable = VK_FALSE;                   // 超出深度范围裁剪而不是 clamp
-    rasterizationStateCreateInfo.rasterizerDiscardEnable = VK_TRUE;             // 不丢弃几何体
-    rasterizationStateCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;            // 填充多边形方式点、线、面
-    rasterizationStateCreateInfo.lineWidth = 1.0f;                              // 线宽
-    rasterizationStateCreateInfo.cullMode = VK_CULL_MODE_BACK_BIT;              // 背面剔除，可改 NONE 或 FRONT
-    rasterizationStateCreateInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;   // 前向面定义
-    rasterizationStateCreateInfo.depthBiasEnable = VK_FALSE;                    // 不使用深度偏移
-    rasterizationStateCreateInfo.depthBiasConstantFactor = 0.0f;
-    rasterizationStateCreateInfo.depthBiasClamp = 0.0f;
-    rasterizationStateCreateInfo.depthBiasSlopeFactor = 0.0f;
+    while (memoryTypeBits != 0 && !(memoryTypeBits & (1u << memoryTypeIndex)))
+        memoryTypeIndex++;
 
-    /* VkPipelineMultisampleStateCreateInfo */
-    VkPipelineMultisampleStateCreateInfo multisampleStateCreateInfo = {};
-    multisampleStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampleStateCreateInfo.sampleShadingEnable = VK_FALSE;                  // 关闭样本着色
-    multisampleStateCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;    // 每像素采样数，1 = 关闭 MSAA
-    multisampleStateCreateInfo.minSampleShading = 1.0f;                         // 如果开启 sampleShading，最小采样比例
-    multisampleStateCreateInfo.pSampleMask = VK_NULL_HANDLE;                    // 默认全开
-    multisampleStateCreateInfo.alphaToCoverageEnable = VK_FALSE;                // alpha to coverage 禁用
-    multisampleStateCreateInfo.alphaToOneEnable = VK_FALSE;                     // alphaToOne 禁用
+    if (memoryTypeBits == 0) {
+        vkDestroyBuffer(device, vkBuffer, VK_NULL_HANDLE);
+        return VK_ERROR_FEATURE_NOT_PRESENT;
+    }
 
-    /* VkPipelineColorBlendStateCreateInfo */
-    VkPipelineColorBlendAttachmentState colorBlendAttachmentStage = {};
-    colorBlendAttachmentStage.colorWriteMask =
-        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-        VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachmentStage.blendEnable = VK_FALSE;                           // 关闭混合
+    VkImportMemoryHostPointerInfoEXT importMemoryHostPointerInfo = {};
+    importMemoryHostPointerInfo.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+    importMemoryHostPointerInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+    importMemoryHostPointerInfo.pHostPointer = const_cast<void *>(pHostPointer);
 
-    VkPipelineColorBlendStateCreateInfo colorBlendStateCreateInfo = {};
-    colorBlendStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlendStateCreateInfo.logicOpEnable = VK_FALSE;                         // 不使用逻辑操作
-    colorBlendStateCreateInfo.logicOp = VK_LOGIC_OP_COPY;                       // 无效，因为逻辑操作关闭
-    colorBlendStateCreateInfo.attachmentCount = 1;
-    colorBlendStateCreateInfo.pAttachments = &colorBlendAttachmentStage;
-    colorBlendStateCreateInfo.blendConstants[0] = 0.0f;
-    colorBlendStateCreateInfo.blendConstants[1] = 0.0f;
-    colorBlendStateCreateInfo.blendConstants[2] = 0.0f;
-    colorBlendStateCreateInfo.blendConstants[3] = 0.0f;
+    VkMemoryAllocateInfo memoryAllocateInfo = {};
+    memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    memoryAllocateInfo.pNext = &importMemoryHostPointerInfo;
+    memoryAllocateInfo.allocationSize = importSize;
+    memoryAllocateInfo.memoryTypeIndex = memoryTypeIndex;
 
-    /* VkPipelineDynamicStateCreateInfo[] */
-    VkDynamicState dynamicStates[] = {
-        VK_DYNAMIC_STATE_VIEWPORT,
-        VK_DYNAMIC_STATE_SCISSOR,
-        VK_DYNAMIC_STATE_RASTERIZER_DISCARD_ENABLE,
-    };
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    err = vkAllocateMemory(device, &memoryAllocateInfo, VK_NULL_HANDLE, &memory);
 
-    VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
-    dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicStateCreateInfo.dynamicStateCount = ARRAY_SIZE(dynamicStates);
-    dynamicStateCreateInfo.pDynamicStates = &dynamicStates[0];
+    if (err == VK_SUCCESS)
+        err = vkBindBufferMemory(device, vkBuffer, memory, 0);
 
-    /* dynamic rendering */
-    VkPipelineRenderingCreateInfo pipelineRenderingInfo = {};
-    pipelineRenderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
-    pipelineRenderingInfo.colorAttachmentCount = 1;
-    pipelineRenderingInfo.pColorAttachmentFormats = &surfaceFormat.format;
+    if (err != VK_SUCCESS) {
+        vkDestroyBuffer(device, vkBuffer, VK_NULL_HANDLE);
+        vkFreeMemory(device, memory, VK_NULL_HANDLE);
+        return err;
+    }
 
-    VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
-    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineCreateInfo.pNext = &pipelineRenderingInfo;
-    pipelineCreateInfo.stageCount = std::size(shaderStagesCreateInfo);
-    pipelineCreateInfo.pStages = shaderStagesCreateInfo;
-    pipelineCreateInfo.pVertexInputState = &vertexInputStateCreateInfo;
-    pipelineCreateInfo.pInputAssemblyState = &inputAssemblyStateCreateInfo;
-    pipelineCreateInfo.pTessellationState = VK_NULL_HANDLE;
-    pipelineCreateInfo.pViewportState = VK_NULL_HANDLE;
-    pipelineCreateInfo.pRasterizationState = &rasterizationStateCreateInfo;
-    pipelineCreateInfo.pMultisampleState = &multisampleStateCreateInfo;
-    pipelineCreateInfo.pDepthStencilState = VK_NULL_HANDLE;
-    pipelineCreateInfo.pColorBlendState = &colorBlendStateCreateInfo;
-    pipelineCreateInfo.pDynamicState = &dynamicStateCreateInfo;
-    pipelineCreateInfo.layout = pipelineLayout;
+    const VkPhysicalDeviceMemoryProperties *memoryProperties = VK_NULL_HANDLE;
+    vmaGetMemoryProperties(memoryAllocator, &memoryProperties);
 
-    VkPipeline pipeline = VK_NULL_HANDLE;
-    err = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, VK_NULL_HANDLE, &pipeline);
-    VK_CHECK_ERROR(err);
+    uint32_t handle = _AllocateBufferSlot();
+    uint32_t slot = HandlePool::IndexOf(handle);
 
-    vkDestroyShaderModule(device, vertexShaderModule, VK_NULL_HANDLE);
-    vkDestroyShaderModule(device, fragmentShaderModule, VK_NULL_HANDLE);
+    buffers.vkBuffers[slot] = vkBuffer;
+    buffers.allocations[slot] = VK_NULL_HANDLE;
+    buffers.sizes[slot] = size;
+    buffers.usages[slot] = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffers.addresses[slot] = 0;
+    buffers.heapIndices[slot] = memoryProperties->memoryTypes[memoryTypeIndex].heapIndex;
+    buffers.lastUsedFrames[slot] = frameNumber;
+    buffers.evictCallbacks[slot] = {};
+    buffers.moving[slot] = 0;
+    buffers.importedMemories[slot] = memory;
 
-    Pipeline ret = (Pipeline) malloc(sizeof(Pipeline_T));
-    ret->vkPipeline = pipeline;
-    ret->vkPipelineLayout = pipelineLayout;
-    *pPipeline = ret;
+    MemoryHeapStats& counters = heapCounters[buffers.heapIndices[slot]];
+    counters.totalAllocations++;
+    counters.totalAllocatedBytes += size;
+
+    pBuffer->id = handle;
 
     return err;
 }
 
-void RenderDriver::DestroyPipeline(Pipeline pipeline)
+void RenderDriver::DestroyBuffer(Buffer buffer)
 {
-    vkDestroyPipeline(device, pipeline->vkPipeline, VK_NULL_HANDLE);
-    vkDestroyPipelineLayout(device, pipeline->vkPipelineLayout, VK_NULL_HANDLE);
-    free(pipeline);
-}
+    uint32_t slot = _GetBufferSlot(buffer);
+
+    MemoryHeapStats& counters = heapCounters[buffers.heapIndices[slot]];
+    counters.totalFrees++;
+    counters.totalFreedBytes += buffers.sizes[slot];
+
+    /* 句柄立即失效，VkBuffer 等到当前帧执行完再销毁，导入的 buffer 连同 VkDeviceMemory 一起 */
+    RetiredObject retired = {};
+    retired.type = RETIRED_OBJECT_BUFFER;
+    retired.frameNumber = frameNumber;
+    retired.buffer.vkBuffer = buffers.vkBuffers[slot];
+    retired.buffer.allocation = buffers.allocations[slot];
+    retired.buffer.importedMemory = buffers.importedMemories[slot];
+
+    /* 正在搬动的 buffer 由 VMA 在 pass 结束时连同新旧位置一起释放 */
+    if (buffers.moving[slot]) {
+        for (uint32_t i = 0; i < defragPass.moveCount; i++) {
+            if (defragMoveSlots[i] == slot)
+                defragPass.pMoves[i].operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_DESTROY;
+        }
+        retired.buffer.allocation = VK_NULL_HANDLE;
+    }
 
-void RenderDriver::RebuildSwapchain()
-{
-    _CreateSwapchain(swapchain);
+    retiredObjects.push_back(retired);
+
+    buffers.vkBuffers[slot] = VK_NULL_HANDLE;
+    buffers.allocations[slot] = VK_NULL_HANDLE;
+    buffers.addresses[slot] = 0;
+    buffers.evictCallbacks[slot] = {};
+    buffers.moving[slot] = 0;
+    buffers.importedMemories[slot] = VK_NULL_HANDLE;
+
+    buffers.handles.Free(buffer.id);
 }
 
-void RenderDriver::WriteBuffer(Buffer buffer, size_t offset, void *data, size_t size)
+VkResult RenderDriver::CreatePipeline(const char *shaderName, Pipeline* pPipeline)
 {
+    PipelineDesc desc = {};
+    desc.shaderName = shaderName;
 
+    return CreatePipeline(desc, pPipeline);
 }
 
-VkResult RenderDriver::_CreateInstance()
+VkResult RenderDriver::CreatePipeline(const PipelineDesc& desc, Pipeline* pPipeline)
 {
-    VkResult err;
+    VkResult err = VK_SUCCESS;
 
-    VkApplicationInfo applicationInfo = {};
-    applicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-    applicationInfo.pApplicationName = "AshLands";
-    applicationInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-    applicationInfo.pEngineName = "AshLands";
-    applicationInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    applicationInfo.apiVersion = VK_API_VERSION_1_3;
-
-    const std::vector<const char*> layers = {
-#ifndef __APPLE__
-        "VK_LAYER_KHRONOS_validation"
-#endif
-    };
+    _RecordPipelineUsage(desc);
 
-    const std::vector<const char*> extensions = {
-        VK_KHR_SURFACE_EXTENSION_NAME,
-    #if defined(_WIN32)
-        "VK_KHR_win32_surface",
-    #elif defined(__APPLE__)
-        "VK_MVK_macos_surface",
-        "VK_EXT_metal_surface",
-    #elif defined(__linux__)
-        VK_KHR_XLIB_SURFACE_EXTENSION_NAME,
-    #endif
-        VK_EXT_DEBUG_UTILS_EXTENSION_NAME,
+    /* 只有动态状态不同的 pipeline 直接共用已有的编译结果 */
+    uint64_t key = _GetPipelineKey(desc, false, false);
+    if (_AcquireSharedPipeline(key, desc, false, false, pPipeline))
+        return err;
 
-#if VK_HEADER_VERSION >= 216
-        "VK_KHR_portability_enumeration",
-        "VK_KHR_get_physical_device_properties2",
-#endif
-    };
+    VkPipeline vkPipeline = VK_NULL_HANDLE;
+    VkShaderEXT shaders[SHADER_OBJECT_STAGE_COUNT] = {};
+    bool optimized = false;
+
+    /* 优先使用启动时预编译好的结果，没有的话只能当场编译 */
+    if (!_TakeWarmPipeline(desc, &vkPipeline, shaders, &optimized)) {
+        /* shader object 路径不需要 VkPipeline，状态全部在绑定时动态设置 */
+        if (shaderObjectEnabled)
+            err = _CreateShaderObjects(desc, shaders);
+        else
+            err = _BuildPipeline(desc, &vkPipeline);
+        VK_CHECK_ERROR(err);
 
-    VkInstanceCreateInfo instanceCreateInfo = {};
-    instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-#if VK_HEADER_VERSION >= 216
-    instanceCreateInfo.flags = VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;
-#endif
-    instanceCreateInfo.pApplicationInfo = &applicationInfo;
-    instanceCreateInfo.enabledLayerCount = static_cast<uint32_t>(std::size(layers));
-    instanceCreateInfo.ppEnabledLayerNames = std::data(layers);
-    instanceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(std::size(extensions));
-    instanceCreateInfo.ppEnabledExtensionNames = std::data(extensions);
+        std::lock_guard<std::mutex> lock(warmupMutex);
+        warmupStats.firstUseCompiles++;
+    }
 
-    err = vkCreateInstance(&instanceCreateInfo, VK_NULL_HANDLE, &instance);
-    VK_CHECK_ERROR(err);
+    /* 先用 fast-link 的 pipeline 顶上，后台再编译完全优化的版本替换 */
+    bool queueOptimize = graphicsPipelineLibraryEnabled && !shaderObjectEnabled && !optimized;
+    _AddSharedPipeline(key, desc, false, false, vkPipeline, shaders, queueOptimize, pPipeline);
 
     return err;
 }
 
-VkResult RenderDriver::_CreateDevice()
+VkResult RenderDriver::CreateComputePipeline(const char *shaderName, Pipeline* pPipeline)
 {
-    VkResult err;
+    VkResult err = VK_SUCCESS;
 
-    physicalDevice = VkUtils::PickBestPhysicalDevice(instance);
+    PipelineDesc desc = {};
+    desc.shaderName = shaderName;
+
+    uint64_t key = _GetPipelineKey(desc, true, false);
+    if (_AcquireSharedPipeline(key, desc, true, false, pPipeline))
+        return err;
+
+    /* compute pipeline 只有一个阶段，不走 GPL、shader object 和预编译清单 */
+    VkPipeline vkPipeline = VK_NULL_HANDLE;
+    err = _CreateComputePipeline(shaderName, &vkPipeline);
+    VK_CHECK_ERROR(err);
+
+    VkShaderEXT shaders[SHADER_OBJECT_STAGE_COUNT] = {};
+    _AddSharedPipeline(key, desc, true, false, vkPipeline, shaders, false, pPipeline);
+
+    return err;
+}
+
+VkResult RenderDriver::CreateMeshPipeline(const PipelineDesc& desc, Pipeline* pPipeline)
+{
+    VkResult err = VK_SUCCESS;
+
+    if (!meshShaderEnabled)
+        return VK_ERROR_FEATURE_NOT_PRESENT;
+
+    uint64_t key = _GetPipelineKey(desc, false, true);
+    if (_AcquireSharedPipeline(key, desc, false, true, pPipeline))
+        return err;
+
+    /* 和 compute 一样只创建完整的 pipeline，shader object 模式下也用 VkPipeline 绑定 */
+    VkPipeline vkPipeline = VK_NULL_HANDLE;
+    err = _CreateMeshPipeline(desc, &vkPipeline);
+    VK_CHECK_ERROR(err);
+
+    VkShaderEXT shaders[SHADER_OBJECT_STAGE_COUNT] = {};
+    _AddSharedPipeline(key, desc, false, true, vkPipeline, shaders, false, pPipeline);
+
+    return err;
+}
+
+void RenderDriver::DestroyPipeline(Pipeline pipeline)
+{
+    VkPipeline vkPipeline;
+    VkShaderEXT shaders[SHADER_OBJECT_STAGE_COUNT];
+
+    {
+        /* 释放后 generation 变化，后台任务再拿这个句柄就对不上了 */
+        std::lock_guard<std::mutex> lock(pipelineMutex);
+        Pipeline_T& slot = _GetPipelineSlot(pipeline);
+        uint64_t key = slot.key;
+        slot = {};
+        pipelineHandles.Free(pipeline.id);
+
+        /* 还有其他句柄在用同一份编译结果 */
+        auto it = sharedPipelines.find(key);
+        if (--it->second.refCount > 0)
+            return;
+
+        /* 还没来得及替换的热重载结果在 _ApplyPendingPipelineSwaps 里找不到 key，直接丢弃 */
+        vkPipeline = it->second.vkPipeline;
+        memcpy(shaders, it->second.shaders, sizeof(shaders));
+        sharedPipelines.erase(it);
+    }
+
+    /* 当前帧可能已经绑定过，不能立即销毁 */
+    _RetirePipelineObjects(vkPipeline, shaders, frameNumber);
+}
+
+uint64_t RenderDriver::_GetPipelineKey(const PipelineDesc& desc, bool compute, bool mesh) const
+{
+    /* 只包含烘焙进 pipeline 的状态，cull mode、front face、深度状态都在绑定时设置 */
+    uint64_t hash = HashString(FNV_OFFSET_BASIS, desc.shaderName);
+    hash = HashBytes(hash, &compute, sizeof(compute));
+    if (compute)
+        return hash;
+
+    hash = HashBytes(hash, &mesh, sizeof(mesh));
+    hash = HashBytes(hash, &desc.depthOnly, sizeof(desc.depthOnly));
+
+    if (!mesh) {
+        uint32_t topologyClass = TopologyClass(desc.renderState.topology);
+        hash = HashBytes(hash, &topologyClass, sizeof(topologyClass));
+        hash = HashBytes(hash, &desc.vertexLayout, sizeof(desc.vertexLayout));
+    }
+
+    if (!colorBlendEnableDynamic)
+        hash = HashBytes(hash, &desc.renderState.blendEnable, sizeof(desc.renderState.blendEnable));
+
+    return hash;
+}
+
+bool RenderDriver::_AcquireSharedPipeline(uint64_t key, const PipelineDesc& desc, bool compute, bool mesh, Pipeline *pPipeline)
+{
+    std::lock_guard<std::mutex> lock(pipelineMutex);
+
+    if (sharedPipelines.find(key) == sharedPipelines.end())
+        return false;
+
+    *pPipeline = _AllocatePipelineHandle(key, desc, compute, mesh);
+
+    return true;
+}
+
+void RenderDriver::_AddSharedPipeline(uint64_t key, const PipelineDesc& desc, bool compute, bool mesh,
+    VkPipeline vkPipeline, const VkShaderEXT *pShaders, bool queueOptimize, Pipeline *pPipeline)
+{
+    std::lock_guard<std::mutex> lock(pipelineMutex);
+
+    auto it = sharedPipelines.find(key);
+
+    /* 编译期间其他线程已经创建了同样的 pipeline，用先放进去的那份 */
+    if (it != sharedPipelines.end()) {
+        _DestroyPipelineObjects(vkPipeline, pShaders);
+    } else {
+        SharedPipeline shared = {};
+        shared.vkPipeline = vkPipeline;
+        memcpy(shared.shaders, pShaders, sizeof(shared.shaders));
+        shared.desc = desc;
+        snprintf(shared.shaderName, sizeof(shared.shaderName), "%s", desc.shaderName);
+        shared.revision = ++pipelineRevision;
+        shared.compute = compute;
+        shared.mesh = mesh;
+        sharedPipelines.emplace(key, shared);
+
+        if (queueOptimize)
+            _QueueOptimizedPipeline(key);
+    }
+
+    *pPipeline = _AllocatePipelineHandle(key, desc, compute, mesh);
+}
+
+Pipeline RenderDriver::_AllocatePipelineHandle(uint64_t key, const PipelineDesc& desc, bool compute, bool mesh)
+{
+    /* 调用方需持有 pipelineMutex，slot 数组可能扩容 */
+    SharedPipeline& shared = sharedPipelines.at(key);
+    shared.refCount++;
+
+    uint32_t handle = pipelineHandles.Allocate();
+    uint32_t slot = HandlePool::IndexOf(handle);
+
+    if (slot >= std::size(pipelineSlots))
+        pipelineSlots.resize(pipelineHandles.GetCapacity());
+
+    Pipeline_T& ret = pipelineSlots[slot];
+    ret = {};
+    ret.vkPipeline = shared.vkPipeline;
+    memcpy(ret.shaders, shared.shaders, sizeof(ret.shaders));
+    ret.vkPipelineLayout = pipelineLayout;
+    ret.desc = desc;
+    snprintf(ret.shaderName, sizeof(ret.shaderName), "%s", desc.shaderName);
+    ret.key = key;
+    ret.compute = compute;
+    ret.mesh = mesh;
+
+    Pipeline pipeline = {};
+    pipeline.id = handle;
+
+    return pipeline;
+}
+
+void RenderDriver::RebuildSwapchain()
+{
+    /* 旧 swapchain 的资源进延迟销毁队列，不需要等待设备空闲 */
+    _CreateSwapchain(swapchain);
+
+    _RetireDepthImage(frameNumber);
+    _CreateDepthImage();
+}
+
+void RenderDriver::WaitIdle()
+{
+    vkDeviceWaitIdle(device);
+}
+
+VkResult RenderDriver::WriteBuffer(Buffer buffer, size_t offset, const void *data, size_t size)
+{
+    VkResult err;
+
+    uint32_t slot = _GetBufferSlot(buffer);
+    assert(offset + size <= buffers.sizes[slot]);
+    assert(buffers.importedMemories[slot] == VK_NULL_HANDLE);   // 导入的 host 内存是只读的
+
+    VkMemoryPropertyFlags memoryProperties = 0;
+    vmaGetAllocationMemoryProperties(memoryAllocator, buffers.allocations[slot], &memoryProperties);
+
+    /*
+     * 可映射的内存直接写，non-coherent 的情况 VMA 会负责 flush。
+     * 正在搬动的 buffer 新位置还不能映射，和搬动的拷贝一样走 transfer，按提交顺序排在后面。
+     */
+    if ((memoryProperties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !buffers.moving[slot]) {
+        err = vmaCopyMemoryToAllocation(memoryAllocator, data, buffers.allocations[slot], offset, size);
+        VK_CHECK_ERROR(err);
+        return err;
+    }
+
+    /*
+     * 不可映射的显存先写到固定大小的上传 staging buffer，再用 transfer 拷贝过去。
+     * 不用当前帧的临时页面：加载阶段帧号不变，每次上传都会让页面一直增长。
+     * _ImmediateSubmit 同步等待，staging 在下一块写入前已经空闲，大的数据分块上传。
+     */
+    if (uploadStaging.vkBuffer == VK_NULL_HANDLE) {
+        err = _CreateUploadStaging();
+        VK_CHECK_ERROR(err);
+    }
+
+    VkBuffer dstBuffer = buffers.vkBuffers[slot];
+
+    for (size_t chunkOffset = 0; chunkOffset < size; chunkOffset += (size_t) uploadStaging.size) {
+        size_t chunkSize = std::min(size - chunkOffset, (size_t) uploadStaging.size);
+        memcpy(uploadStaging.pMapped, static_cast<const uint8_t *>(data) + chunkOffset, chunkSize);
+
+        err = _ImmediateSubmit([&](VkCommandBuffer commandBuffer) {
+            VkBufferCopy region = { 0, offset + chunkOffset, chunkSize };
+            vkCmdCopyBuffer(commandBuffer, uploadStaging.vkBuffer, dstBuffer, 1, &region);
+
+            /* 拷贝结果对之后所有提交可见 */
+            VkMemoryBarrier memoryBarrier = {};
+            memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            memoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+
+            vkCmdPipelineBarrier(commandBuffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                0, 1, &memoryBarrier, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+        });
+        VK_CHECK_ERROR(err);
+    }
+
+    return VK_SUCCESS;
+}
+
+void RenderDriver::SetBufferName(Buffer buffer, const char *name)
+{
+    uint32_t slot = _GetBufferSlot(buffer);
+
+    if (buffers.allocations[slot] != VK_NULL_HANDLE)
+        vmaSetAllocationName(memoryAllocator, buffers.allocations[slot], name);
+}
+
+VkResult RenderDriver::CopyBuffer(Buffer srcBuffer, Buffer dstBuffer, uint32_t regionCount, const VkBufferCopy *pRegions)
+{
+    VkBuffer src = buffers.vkBuffers[_GetBufferSlot(srcBuffer)];
+    VkBuffer dst = buffers.vkBuffers[_GetBufferSlot(dstBuffer)];
+
+    /* 同步拷贝，只用于加载、整理这类低频操作 */
+    return _ImmediateSubmit([&](VkCommandBuffer commandBuffer) {
+        vkCmdCopyBuffer(commandBuffer, src, dst, regionCount, pRegions);
+
+        VkMemoryBarrier memoryBarrier = {};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+            0, 1, &memoryBarrier, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+    });
+}
+
+VkResult RenderDriver::WriteBufferFromFile(Buffer buffer, size_t offset, const char *path)
+{
+    VkResult err;
+
+    size_t size = 0;
+    void *pData = io_map_file(path, &size);
+    if (pData == NULL)
+        return VK_ERROR_INITIALIZATION_FAILED;
+
+    assert(offset + size <= buffers.sizes[_GetBufferSlot(buffer)]);
+
+    /* 不支持导入时退回到 staging 上传，只省掉读文件的那次拷贝 */
+    Buffer srcBuffer = {};
+    err = ImportHostBuffer(pData, size, &srcBuffer);
+
+    if (err != VK_SUCCESS) {
+        err = WriteBuffer(buffer, offset, pData, size);
+        io_unmap_file(pData, size);
+        return err;
+    }
+
+    VkBufferCopy region = { 0, offset, size };
+    err = CopyBuffer(srcBuffer, buffer, 1, &region);
+    DestroyBuffer(srcBuffer);
+
+    /* 导入的内存释放之前映射必须保持有效，排在 buffer 后面一起回收 */
+    RetiredObject retired = {};
+    retired.type = RETIRED_OBJECT_FILE_MAPPING;
+    retired.frameNumber = frameNumber;
+    retired.fileMapping.pData = pData;
+    retired.fileMapping.size = size;
+    retiredObjects.push_back(retired);
+
+    return err;
+}
+
+VkDeviceAddress RenderDriver::GetBufferAddress(Buffer buffer) const
+{
+    uint32_t slot = _GetBufferSlot(buffer);
+
+    /* 创建时需要带上 VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT */
+    assert(buffers.usages[slot] & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+
+    return buffers.addresses[slot];
+}
+
+void RenderDriver::TouchBuffer(Buffer buffer)
+{
+    buffers.lastUsedFrames[_GetBufferSlot(buffer)] = frameNumber;
+}
+
+VkResult RenderDriver::BeginFrame()
+{
+    VkResult err;
+
+    FrameContext *frame = &frames[frameNumber % MAX_FRAMES_IN_FLIGHT];
+
+    err = vkWaitForFences(device, 1, &frame->fence, VK_TRUE, UINT64_MAX);
+    VK_CHECK_ERROR(err);
+
+    /* 该 frame slot 上一次提交的帧已经执行完毕 */
+    completedFrameNumber = std::max(completedFrameNumber, frame->submittedFrameNumber);
+    _CollectRetiredObjects();
+
+    /* 在新的一帧申请资源之前先把用量压回预算内 */
+    _UpdateMemoryBudget();
+    _EvictStreamableBuffers();
+
+    /* 还没开始录制，搬动后的 buffer 对这一帧的命令可见 */
+    _UpdateDefragmentation();
+
+    /* 帧边界：替换热重载后的 pipeline */
+    _ApplyPendingPipelineSwaps();
+
+    err = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, frame->imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+    if (err == VK_ERROR_OUT_OF_DATE_KHR) {
+        RebuildSwapchain();
+        return err;
+    }
+
+    if (err != VK_SUCCESS && err != VK_SUBOPTIMAL_KHR)
+        return err;
+
+    err = vkResetFences(device, 1, &frame->fence);
+    VK_CHECK_ERROR(err);
+
+    err = vkResetCommandBuffer(frame->commandBuffer, 0);
+    VK_CHECK_ERROR(err);
+
+    VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+    commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    err = vkBeginCommandBuffer(frame->commandBuffer, &commandBufferBeginInfo);
+    VK_CHECK_ERROR(err);
+
+    /* 新的 command buffer 里没有任何动态状态 */
+    dynamicStateCache.Reset();
+    shaderObjectStateDirty = true;
+    meshPipelineBound = false;
+
+    return err;
+}
+
+VkResult RenderDriver::EndFrame()
+{
+    VkResult err;
+
+    FrameContext *frame = &frames[frameNumber % MAX_FRAMES_IN_FLIGHT];
+
+    err = vkEndCommandBuffer(frame->commandBuffer);
+    VK_CHECK_ERROR(err);
+
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &frame->imageAvailableSemaphore;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &frame->commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &renderFinishedSemaphores[imageIndex];
+
+    err = vkQueueSubmit(queue, 1, &submitInfo, frame->fence);
+    VK_CHECK_ERROR(err);
+
+    frame->submittedFrameNumber = frameNumber;
+    frameNumber++;
+
+    VkPresentInfoKHR presentInfo = {};
+    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = &renderFinishedSemaphores[imageIndex];
+    presentInfo.swapchainCount = 1;
+    presentInfo.pSwapchains = &swapchain;
+    presentInfo.pImageIndices = &imageIndex;
+
+    err = vkQueuePresentKHR(queue, &presentInfo);
+    if (err == VK_ERROR_OUT_OF_DATE_KHR || err == VK_SUBOPTIMAL_KHR) {
+        RebuildSwapchain();
+        return VK_SUCCESS;
+    }
+
+    return err;
+}
+
+void RenderDriver::BeginRendering(const VkClearColorValue& clearColor)
+{
+    _BeginRendering(&clearColor);
+}
+
+void RenderDriver::ResumeRendering()
+{
+    _BeginRendering(VK_NULL_HANDLE);
+}
+
+void RenderDriver::_BeginRendering(const VkClearColorValue *pClearColor)
+{
+    VkCommandBuffer commandBuffer = GetCommandBuffer();
+
+    /* 继续绘制时颜色从 EndRendering 留下的 present 布局转回来，内容要保留 */
+    const bool load = pClearColor == VK_NULL_HANDLE;
+
+    VkImageMemoryBarrier imageMemoryBarriers[2] = {};
+
+    VkImageMemoryBarrier *colorBarrier = &imageMemoryBarriers[0];
+    colorBarrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    colorBarrier->srcAccessMask = load ? VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : 0;
+    colorBarrier->dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    colorBarrier->oldLayout = load ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_UNDEFINED;
+    colorBarrier->newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorBarrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    colorBarrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    colorBarrier->image = swapchainImages[imageIndex];
+    colorBarrier->subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+    /* 深度在两次绘制之间一直保持 attachment 布局，清除时丢掉旧内容 */
+    VkImageMemoryBarrier *depthBarrier = &imageMemoryBarriers[1];
+    depthBarrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    depthBarrier->srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    depthBarrier->dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    depthBarrier->oldLayout = load ? VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+    depthBarrier->newLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+    depthBarrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    depthBarrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    depthBarrier->image = depthImage;
+    depthBarrier->subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+        0, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, ARRAY_SIZE(imageMemoryBarriers), imageMemoryBarriers);
+
+    VkRenderingAttachmentInfo colorAttachmentInfo = {};
+    colorAttachmentInfo.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    colorAttachmentInfo.imageView = swapchainImageViews[imageIndex];
+    colorAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachmentInfo.loadOp = load ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachmentInfo.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    if (!load)
+        colorAttachmentInfo.clearValue.color = *pClearColor;
+
+    /* 深度要留给 Hi-Z 和下一帧的遮挡剔除，所以也要 store */
+    VkRenderingAttachmentInfo depthAttachmentInfo = {};
+    depthAttachmentInfo.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    depthAttachmentInfo.imageView = depthImageView;
+    depthAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+    depthAttachmentInfo.loadOp = load ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachmentInfo.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depthAttachmentInfo.clearValue.depthStencil = { DEPTH_CLEAR_VALUE, 0 };
+
+    VkRenderingInfo renderingInfo = {};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    renderingInfo.renderArea = { { 0, 0 }, swapchainExtent };
+    renderingInfo.layerCount = 1;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachments = &colorAttachmentInfo;
+    renderingInfo.pDepthAttachment = &depthAttachmentInfo;
+
+    vkCmdBeginRendering(commandBuffer, &renderingInfo);
+}
+
+void RenderDriver::EndRendering()
+{
+    VkCommandBuffer commandBuffer = GetCommandBuffer();
+
+    vkCmdEndRendering(commandBuffer);
+
+    VkImageMemoryBarrier imageMemoryBarrier = {};
+    imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imageMemoryBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    imageMemoryBarrier.dstAccessMask = 0;
+    imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageMemoryBarrier.image = swapchainImages[imageIndex];
+    imageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        0, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, 1, &imageMemoryBarrier);
+}
+
+void RenderDriver::CmdCopyDepthToBuffer(Buffer dst)
+{
+    VkCommandBuffer commandBuffer = GetCommandBuffer();
+
+    uint32_t slot = _GetBufferSlot(dst);
+    assert(buffers.sizes[slot] >= (VkDeviceSize) swapchainExtent.width * swapchainExtent.height * sizeof(float));
+    buffers.lastUsedFrames[slot] = frameNumber;
+
+    VkImageMemoryBarrier imageMemoryBarrier = {};
+    imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imageMemoryBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+    imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageMemoryBarrier.image = depthImage;
+    imageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, 1, &imageMemoryBarrier);
+
+    VkBufferImageCopy region = {};
+    region.imageSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1 };
+    region.imageExtent = { swapchainExtent.width, swapchainExtent.height, 1 };
+
+    vkCmdCopyImageToBuffer(commandBuffer, depthImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffers.vkBuffers[slot], 1, &region);
+
+    /* 拷完转回 attachment 布局，ResumeRendering 可以直接接着画 */
+    imageMemoryBarrier.srcAccessMask = 0;
+    imageMemoryBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+        0, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, 1, &imageMemoryBarrier);
+}
+
+void RenderDriver::CmdBindPipeline(Pipeline handle)
+{
+    VkCommandBuffer commandBuffer = GetCommandBuffer();
+
+    /* slot 只会在主线程扩容，录制命令时不需要加锁 */
+    const Pipeline_T *pipeline = &_GetPipelineSlot(handle);
+
+    if (pipeline->compute) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->vkPipeline);
+        return;
+    }
+
+    /*
+     * mesh pipeline 没有顶点输入和 topology 状态，和普通 pipeline 之间切换后
+     * 动态状态和 shader object 的固定状态都要重新设置。
+     */
+    if (pipeline->mesh != meshPipelineBound) {
+        meshPipelineBound = pipeline->mesh;
+        dynamicStateCache.Invalidate();
+        shaderObjectStateDirty = true;
+    }
+
+    if (pipeline->vkPipeline == VK_NULL_HANDLE) {
+        /* 开启了 mesh shader 时 task/mesh 阶段也必须显式绑定，这里绑定为空 */
+        static const VkShaderStageFlagBits stages[] = {
+            VK_SHADER_STAGE_VERTEX_BIT,
+            VK_SHADER_STAGE_FRAGMENT_BIT,
+            VK_SHADER_STAGE_TASK_BIT_EXT,
+            VK_SHADER_STAGE_MESH_BIT_EXT,
+        };
+
+        VkShaderEXT shaders[ARRAY_SIZE(stages)] = {};
+        memcpy(shaders, pipeline->shaders, sizeof(pipeline->shaders));
+
+        uint32_t stageCount = meshShaderEnabled ? ARRAY_SIZE(stages) : SHADER_OBJECT_STAGE_COUNT;
+        vkCmdBindShadersEXT(commandBuffer, stageCount, stages, shaders);
+        _SetShaderObjectState(commandBuffer, pipeline->desc);
+    } else {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->vkPipeline);
+    }
+
+    /* 所有 pipeline 的动态状态集合相同，切换 pipeline 不会让已设置的状态失效 */
+    VkViewport viewport = { 0.0f, 0.0f, (float) swapchainExtent.width, (float) swapchainExtent.height, 0.0f, 1.0f };
+    VkRect2D scissor = { { 0, 0 }, swapchainExtent };
+
+    dynamicStateCache.SetViewport(commandBuffer, viewport);
+    dynamicStateCache.SetScissor(commandBuffer, scissor);
+    dynamicStateCache.SetRasterizerDiscardEnable(commandBuffer, VK_FALSE);
+    dynamicStateCache.SetRenderState(commandBuffer, pipeline->desc.renderState);
+}
+
+void RenderDriver::CmdSetRenderState(const RenderState& state)
+{
+    dynamicStateCache.SetRenderState(GetCommandBuffer(), state);
+}
+
+void RenderDriver::CmdPushConstants(const void *data, uint32_t size, uint32_t offset)
+{
+    assert(offset + size <= PUSH_CONSTANT_SIZE);
+
+    /* 所有 pipeline 共用一个 layout，切换 pipeline 后 push constant 依然有效 */
+    vkCmdPushConstants(GetCommandBuffer(), pipelineLayout, VK_SHADER_STAGE_ALL, offset, size, data);
+}
+
+void RenderDriver::CmdBindVertexBuffer(Buffer buffer, VkDeviceSize offset)
+{
+    uint32_t slot = _GetBufferSlot(buffer);
+    buffers.lastUsedFrames[slot] = frameNumber;
+
+    vkCmdBindVertexBuffers(GetCommandBuffer(), 0, 1, &buffers.vkBuffers[slot], &offset);
+}
+
+void RenderDriver::CmdBindVertexBuffer(const TransientBuffer& buffer, uint32_t binding)
+{
+    vkCmdBindVertexBuffers(GetCommandBuffer(), binding, 1, &buffer.buffer, &buffer.offset);
+}
+
+void RenderDriver::CmdBindIndexBuffer(Buffer buffer, VkDeviceSize offset, VkIndexType indexType)
+{
+    uint32_t slot = _GetBufferSlot(buffer);
+    buffers.lastUsedFrames[slot] = frameNumber;
+
+    vkCmdBindIndexBuffer(GetCommandBuffer(), buffers.vkBuffers[slot], offset, indexType);
+}
+
+void RenderDriver::CmdDrawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance)
+{
+    vkCmdDrawIndexed(GetCommandBuffer(), indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+}
+
+void RenderDriver::CmdDrawIndexedIndirect(Buffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride)
+{
+    VkCommandBuffer commandBuffer = GetCommandBuffer();
+    uint32_t slot = _GetBufferSlot(buffer);
+    VkBuffer vkBuffer = buffers.vkBuffers[slot];
+    buffers.lastUsedFrames[slot] = frameNumber;
+
+    if (multiDrawIndirectEnabled) {
+        vkCmdDrawIndexedIndirect(commandBuffer, vkBuffer, offset, drawCount, stride);
+        return;
+    }
+
+    /* 不支持 multiDrawIndirect 时 drawCount 只能是 0 或 1 */
+    for (uint32_t i = 0; i < drawCount; i++)
+        vkCmdDrawIndexedIndirect(commandBuffer, vkBuffer, offset + (VkDeviceSize) i * stride, 1, stride);
+}
+
+void RenderDriver::CmdDrawIndexedIndirectCount(Buffer buffer, VkDeviceSize offset, Buffer countBuffer, VkDeviceSize countOffset, uint32_t maxDrawCount, uint32_t stride)
+{
+    assert(drawIndirectCountEnabled);
+
+    uint32_t slot = _GetBufferSlot(buffer);
+    uint32_t countSlot = _GetBufferSlot(countBuffer);
+    buffers.lastUsedFrames[slot] = frameNumber;
+    buffers.lastUsedFrames[countSlot] = frameNumber;
+
+    vkCmdDrawIndexedIndirectCount(GetCommandBuffer(), buffers.vkBuffers[slot], offset,
+        buffers.vkBuffers[countSlot], countOffset, maxDrawCount, stride);
+}
+
+void RenderDriver::CmdDrawMeshTasks(uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ)
+{
+    assert(meshPipelineBound);
+
+    vkCmdDrawMeshTasksEXT(GetCommandBuffer(), groupCountX, groupCountY, groupCountZ);
+}
+
+void RenderDriver::CmdDispatch(uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ)
+{
+    vkCmdDispatch(GetCommandBuffer(), groupCountX, groupCountY, groupCountZ);
+}
+
+void RenderDriver::CmdFillBuffer(Buffer buffer, VkDeviceSize offset, VkDeviceSize size, uint32_t data)
+{
+    uint32_t slot = _GetBufferSlot(buffer);
+    buffers.lastUsedFrames[slot] = frameNumber;
+
+    vkCmdFillBuffer(GetCommandBuffer(), buffers.vkBuffers[slot], offset, size, data);
+}
+
+void RenderDriver::CmdCopyBuffer(const TransientBuffer& src, Buffer dst, VkDeviceSize dstOffset)
+{
+    uint32_t slot = _GetBufferSlot(dst);
+    assert(dstOffset + src.size <= buffers.sizes[slot]);
+    buffers.lastUsedFrames[slot] = frameNumber;
+
+    /* 和 WriteBuffer 不同，拷贝随当前帧提交，不会和在途帧的读取冲突 */
+    VkBufferCopy region = { src.offset, dstOffset, src.size };
+    vkCmdCopyBuffer(GetCommandBuffer(), src.buffer, buffers.vkBuffers[slot], 1, &region);
+}
+
+void RenderDriver::CmdMemoryBarrier(VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+    VkMemoryBarrier memoryBarrier = {};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = srcAccess;
+    memoryBarrier.dstAccessMask = dstAccess;
+
+    vkCmdPipelineBarrier(GetCommandBuffer(), srcStage, dstStage,
+        0, 1, &memoryBarrier, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+}
+
+bool RenderDriver::EnableShaderHotReload(const char *shaderDirectory)
+{
+    return shaderWatcher.Start(shaderDirectory, [this](const char *shaderName) {
+        _OnShaderChanged(shaderName);
+    });
+}
+
+bool RenderDriver::WarmupPipelines(const char *manifestPath)
+{
+    std::vector<PipelineUsage> usages;
+    if (!LoadPipelineManifest(manifestPath, usages))
+        return false;
+
+    SortPipelineUsagesByPriority(usages);
+
+    {
+        std::lock_guard<std::mutex> lock(warmupMutex);
+
+        /* 旧清单里只有动态状态不同的条目对应同一个 pipeline，只保留优先级最高的那条 */
+        std::erase_if(usages, [this](const PipelineUsage& usage) {
+            PipelineDesc desc = {};
+            desc.shaderName = usage.shaderName;
+            desc.renderState = usage.renderState;
+            desc.vertexLayout = usage.vertexLayout;
+            desc.depthOnly = usage.depthOnly;
+            return !manifestUsages.emplace(_GetPipelineKey(desc, false, false), usage).second;
+        });
+
+        warmupStats.manifestEntries = static_cast<uint32_t>(std::size(usages));
+    }
+
+    printf("[pipeline] warming up %zu pipelines from %s\n", std::size(usages), manifestPath);
+
+    /* 任务队列先进先出，按优先级顺序提交即可 */
+    for (const PipelineUsage& usage : usages) {
+        pendingWarmupJobs++;
+
+        jobSystem.Submit([this, usage]() {
+            PipelineDesc desc = {};
+            desc.shaderName = usage.shaderName;
+            desc.renderState = usage.renderState;
+            desc.vertexLayout = usage.vertexLayout;
+            desc.depthOnly = usage.depthOnly;
+
+            WarmPipeline warm = {};
+            snprintf(warm.shaderName, sizeof(warm.shaderName), "%s", usage.shaderName);
+
+            VkResult err = VK_ERROR_INITIALIZATION_FAILED;
+
+            try {
+                /* 反正在后台，GPL 路径直接链接完全优化的版本 */
+                if (shaderObjectEnabled) {
+                    err = _CreateShaderObjects(desc, warm.shaders);
+                } else if (graphicsPipelineLibraryEnabled) {
+                    err = _LinkPipeline(desc, true, &warm.vkPipeline);
+                    warm.optimized = true;
+                } else {
+                    err = _CreateGraphicsPipeline(desc, 0, 0, &warm.vkPipeline);
+                }
+            } catch (const std::exception& e) {
+                /* 清单里的 shader 可能已经被删掉了 */
+                printf("[pipeline] warm up %s failed: %s\n", usage.shaderName, e.what());
+            }
+
+            if (err == VK_SUCCESS) {
+                std::lock_guard<std::mutex> lock(warmupMutex);
+                if (warmPipelines.emplace(_GetPipelineKey(desc, false, false), warm).second)
+                    warmupStats.warmedPipelines++;
+                else
+                    _DestroyPipelineObjects(warm.vkPipeline, warm.shaders);
+            }
+
+            pendingWarmupJobs--;
+        });
+    }
+
+    return true;
+}
+
+bool RenderDriver::SavePipelineManifest(const char *manifestPath)
+{
+    std::vector<PipelineUsage> usages;
+
+    {
+        std::lock_guard<std::mutex> lock(warmupMutex);
+
+        for (const auto& entry : pipelineUsages)
+            usages.push_back(entry.second);
+
+        /* 这次没用到的也保留下来，比如没去过的关卡 */
+        for (const auto& entry : manifestUsages) {
+            if (pipelineUsages.find(entry.first) == pipelineUsages.end())
+                usages.push_back(entry.second);
+        }
+    }
+
+    SortPipelineUsagesByPriority(usages);
+
+    return ::SavePipelineManifest(manifestPath, usages);
+}
+
+PipelineWarmupStats RenderDriver::GetPipelineWarmupStats()
+{
+    std::lock_guard<std::mutex> lock(warmupMutex);
+    return warmupStats;
+}
+
+VkResult RenderDriver::_CreateInstance()
+{
+    VkResult err;
+
+    VkApplicationInfo applicationInfo = {};
+    applicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    applicationInfo.pApplicationName = "AshLands";
+    applicationInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+    applicationInfo.pEngineName = "AshLands";
+    applicationInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+    applicationInfo.apiVersion = VK_API_VERSION_1_3;
+
+    const std::vector<const char*> layers = {
+#ifndef __APPLE__
+        "VK_LAYER_KHRONOS_validation"
+#endif
+    };
+
+    const std::vector<const char*> extensions = {
+        VK_KHR_SURFACE_EXTENSION_NAME,
+    #if defined(_WIN32)
+        "VK_KHR_win32_surface",
+    #elif defined(__APPLE__)
+        "VK_MVK_macos_surface",
+        "VK_EXT_metal_surface",
+    #elif defined(__linux__)
+        VK_KHR_XLIB_SURFACE_EXTENSION_NAME,
+    #endif
+        VK_EXT_DEBUG_UTILS_EXTENSION_NAME,
+
+#if VK_HEADER_VERSION >= 216
+        "VK_KHR_portability_enumeration",
+        "VK_KHR_get_physical_device_properties2",
+#endif
+    };
+
+    VkInstanceCreateInfo instanceCreateInfo = {};
+    instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+#if VK_HEADER_VERSION >= 216
+    instanceCreateInfo.flags = VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;
+#endif
+    instanceCreateInfo.pApplicationInfo = &applicationInfo;
+    instanceCreateInfo.enabledLayerCount = static_cast<uint32_t>(std::size(layers));
+    instanceCreateInfo.ppEnabledLayerNames = std::data(layers);
+    instanceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(std::size(extensions));
+    instanceCreateInfo.ppEnabledExtensionNames = std::data(extensions);
+
+    err = vkCreateInstance(&instanceCreateInfo, VK_NULL_HANDLE, &instance);
+    VK_CHECK_ERROR(err);
+
+    return err;
+}
+
+VkResult RenderDriver::_CreateDevice()
+{
+    VkResult err;
+
+    physicalDevice = VkUtils::PickBestPhysicalDevice(instance);
     vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
     printf("[vulkan] found best physical device: %s\n", physicalDeviceProperties.deviceName);
 
-    queueFamilyIndex = VkUtils::FindQueueFamilyIndex(physicalDevice, surface);
-    assert(queueFamilyIndex != UINT32_MAX);
+    queueFamilyIndex = VkUtils::FindQueueFamilyIndex(physicalDevice, surface);
+    assert(queueFamilyIndex != UINT32_MAX);
+
+    float priorities = 1.0f;
+    VkDeviceQueueCreateInfo queueCreateInfo = {};
+    queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueCreateInfo.queueFamilyIndex = queueFamilyIndex;
+    queueCreateInfo.queueCount = 1;
+    queueCreateInfo.pQueuePriorities = &priorities;
+
+    const std::vector<VkExtensionProperties> availableExtensions = VkUtils::EnumerateDeviceExtensions(physicalDevice);
+
+    std::vector<const char*> extensions = {
+        VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+        VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+        VK_KHR_MAINTENANCE3_EXTENSION_NAME
+    };
+
+    /* 启用的 feature 结构体依次挂到 pNext 链上 */
+    void *pFeatureChain = VK_NULL_HANDLE;
+
+    /* dynamic rendering */
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeature = {};
+    dynamicRenderingFeature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+    dynamicRenderingFeature.dynamicRendering = VK_TRUE;
+    dynamicRenderingFeature.pNext = pFeatureChain;
+    pFeatureChain = &dynamicRenderingFeature;
+
+    /* VK_EXT_graphics_pipeline_library，只在支持 fast-linking 的设备上启用 */
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphicsPipelineLibraryFeature = {};
+    graphicsPipelineLibraryFeature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+
+    if (VkUtils::IsExtensionSupported(availableExtensions, VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) &&
+        VkUtils::IsExtensionSupported(availableExtensions, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME)) {
+        VkPhysicalDeviceFeatures2 features2 = {};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &graphicsPipelineLibraryFeature;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+        VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT graphicsPipelineLibraryProperties = {};
+        graphicsPipelineLibraryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT;
+
+        VkPhysicalDeviceProperties2 properties2 = {};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &graphicsPipelineLibraryProperties;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+
+        if (graphicsPipelineLibraryFeature.graphicsPipelineLibrary &&
+            graphicsPipelineLibraryProperties.graphicsPipelineLibraryFastLinking) {
+            extensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+            extensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+            graphicsPipelineLibraryFeature.pNext = pFeatureChain;
+            pFeatureChain = &graphicsPipelineLibraryFeature;
+            graphicsPipelineLibraryEnabled = true;
+        }
+    }
+
+    printf("[vulkan] graphics pipeline library: %s\n", graphicsPipelineLibraryEnabled ? "enabled" : "disabled");
+
+    /* VK_EXT_shader_object，支持时直接绑定 shader 对象代替 VkPipeline */
+    VkPhysicalDeviceShaderObjectFeaturesEXT shaderObjectFeature = {};
+    shaderObjectFeature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT;
+
+#ifdef ENABLE_SHADER_OBJECT
+    if (VkUtils::IsExtensionSupported(availableExtensions, VK_EXT_SHADER_OBJECT_EXTENSION_NAME)) {
+        VkPhysicalDeviceFeatures2 features2 = {};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &shaderObjectFeature;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+        if (shaderObjectFeature.shaderObject) {
+            extensions.push_back(VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
+            shaderObjectFeature.pNext = pFeatureChain;
+            pFeatureChain = &shaderObjectFeature;
+            shaderObjectEnabled = true;
+        }
+    }
+#endif /* ENABLE_SHADER_OBJECT */
+
+    printf("[vulkan] shader object: %s\n", shaderObjectEnabled ? "enabled" : "disabled");
+
+    /*
+     * extended dynamic state 1/2 是 1.3 核心功能，不需要额外开启；
+     * extended dynamic state 3 只用到 colorBlendEnable，shader object 本身已经包含这些命令。
+     */
+    assert(physicalDeviceProperties.apiVersion >= VK_API_VERSION_1_3);
+
+    VkPhysicalDeviceExtendedDynamicState3FeaturesEXT extendedDynamicState3Feature = {};
+    extendedDynamicState3Feature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+
+    if (shaderObjectEnabled) {
+        colorBlendEnableDynamic = true;
+    } else if (VkUtils::IsExtensionSupported(availableExtensions, VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME)) {
+        VkPhysicalDeviceFeatures2 features2 = {};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &extendedDynamicState3Feature;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+        if (extendedDynamicState3Feature.extendedDynamicState3ColorBlendEnable) {
+            /* 只开启用到的 feature */
+            VkPhysicalDeviceExtendedDynamicState3FeaturesEXT supported = extendedDynamicState3Feature;
+            extendedDynamicState3Feature = {};
+            extendedDynamicState3Feature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+            extendedDynamicState3Feature.extendedDynamicState3ColorBlendEnable = supported.extendedDynamicState3ColorBlendEnable;
+
+            extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+            extendedDynamicState3Feature.pNext = pFeatureChain;
+            pFeatureChain = &extendedDynamicState3Feature;
+            colorBlendEnableDynamic = true;
+        }
+    }
+
+    dynamicStateCache.SetUseViewportWithCount(shaderObjectEnabled);
+    dynamicStateCache.SetBlendEnableDynamic(colorBlendEnableDynamic);
+
+    printf("[vulkan] dynamic color blend enable: %s\n", colorBlendEnableDynamic ? "enabled" : "disabled");
+
+    /*
+     * buffer device address，1.3 设备必须支持，shader 通过 push constant 里的 64 位指针直接读数据。
+     * 挂了 Vulkan12Features 之后不能再启用已经并入 1.2 的扩展（如 descriptor indexing），否则对应 feature 必须同时打开。
+     */
+    VkPhysicalDeviceVulkan12Features supportedVulkan12Feature = {};
+    supportedVulkan12Feature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+    {
+        VkPhysicalDeviceFeatures2 features2 = {};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &supportedVulkan12Feature;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+    }
+
+    VkPhysicalDeviceVulkan12Features vulkan12Feature = {};
+    vulkan12Feature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12Feature.bufferDeviceAddress = VK_TRUE;
+    vulkan12Feature.drawIndirectCount = supportedVulkan12Feature.drawIndirectCount;     // GPU 剔除后由 shader 写入 draw 数量
+    drawIndirectCountEnabled = supportedVulkan12Feature.drawIndirectCount;
+    vulkan12Feature.pNext = pFeatureChain;
+    pFeatureChain = &vulkan12Feature;
+
+    /* VK_EXT_memory_budget，VMA 用它查询驱动给出的实时预算 */
+    if (VkUtils::IsExtensionSupported(availableExtensions, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+        extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        memoryBudgetEnabled = true;
+    }
+
+    printf("[vulkan] memory budget: %s\n", memoryBudgetEnabled ? "enabled" : "disabled");
+
+    /* VK_EXT_external_memory_host，大块静态资源直接从 mmap 的文件导入作为拷贝源 */
+    if (VkUtils::IsExtensionSupported(availableExtensions, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME)) {
+        VkPhysicalDeviceExternalMemoryHostPropertiesEXT externalMemoryHostProperties = {};
+        externalMemoryHostProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+
+        VkPhysicalDeviceProperties2 properties2 = {};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &externalMemoryHostProperties;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+
+        extensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+        minImportedHostPointerAlignment = externalMemoryHostProperties.minImportedHostPointerAlignment;
+        externalMemoryHostEnabled = true;
+    }
+
+    printf("[vulkan] external memory host: %s\n", externalMemoryHostEnabled ? "enabled" : "disabled");
+
+    /* VK_EXT_mesh_shader，只开启 task 和 mesh 两个阶段，multiview 之类的不需要 */
+    VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeature = {};
+    meshShaderFeature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+
+    if (VkUtils::IsExtensionSupported(availableExtensions, VK_EXT_MESH_SHADER_EXTENSION_NAME)) {
+        VkPhysicalDeviceFeatures2 features2 = {};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &meshShaderFeature;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+        if (meshShaderFeature.taskShader && meshShaderFeature.meshShader) {
+            meshShaderFeature = {};
+            meshShaderFeature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+            meshShaderFeature.taskShader = VK_TRUE;
+            meshShaderFeature.meshShader = VK_TRUE;
+
+            extensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+            meshShaderFeature.pNext = pFeatureChain;
+            pFeatureChain = &meshShaderFeature;
+            meshShaderEnabled = true;
+        }
+    }
+
+    printf("[vulkan] mesh shader: %s\n", meshShaderEnabled ? "enabled" : "disabled");
+
+    /* 核心 feature，multi-draw indirect 让整个 megabuffer 的 draw 一次提交 */
+    VkPhysicalDeviceFeatures supportedFeatures = {};
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
+    VkPhysicalDeviceFeatures enabledFeatures = {};
+    enabledFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    enabledFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+    multiDrawIndirectEnabled = supportedFeatures.multiDrawIndirect;
+    drawIndirectFirstInstanceEnabled = supportedFeatures.drawIndirectFirstInstance;
+
+    printf("[vulkan] draw indirect count: %s\n", drawIndirectCountEnabled ? "enabled" : "disabled");
+
+    VkDeviceCreateInfo deviceCreateInfo = {};
+    deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    deviceCreateInfo.pNext = pFeatureChain;
+    deviceCreateInfo.pEnabledFeatures = &enabledFeatures;
+    deviceCreateInfo.queueCreateInfoCount = 1;
+    deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
+    deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(std::size(extensions));
+    deviceCreateInfo.ppEnabledExtensionNames = std::data(extensions);
+
+    err = vkCreateDevice(physicalDevice, &deviceCreateInfo, VK_NULL_HANDLE, &device);
+    VK_CHECK_ERROR(err);
+
+    vkGetDeviceQueue(device, queueFamilyIndex, 0, &queue);
+
+TAG_DEVICE_Create_END:
+    return err;
+}
+
+VkResult RenderDriver::_CreateMemoryAllocator()
+{
+    VkResult err;
+
+    VmaVulkanFunctions vulkanFunctions = {};
+    vulkanFunctions.vkGetInstanceProcAddr = vkGetInstanceProcAddr;
+    vulkanFunctions.vkGetDeviceProcAddr = vkGetDeviceProcAddr;
+
+    VmaAllocatorCreateInfo allocatorCreateInfo = {};
+    allocatorCreateInfo.flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+    if (memoryBudgetEnabled)
+        allocatorCreateInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+    allocatorCreateInfo.vulkanApiVersion = VK_API_VERSION_1_3;
+    allocatorCreateInfo.instance = instance;
+    allocatorCreateInfo.physicalDevice = physicalDevice;
+    allocatorCreateInfo.device = device;
+    allocatorCreateInfo.pVulkanFunctions = &vulkanFunctions;
+
+    err = vmaCreateAllocator(&allocatorCreateInfo, &memoryAllocator);
+    VK_CHECK_ERROR(err);
+
+    const VkPhysicalDeviceMemoryProperties *memoryProperties = VK_NULL_HANDLE;
+    vmaGetMemoryProperties(memoryAllocator, &memoryProperties);
+    heapBudgets.resize(memoryProperties->memoryHeapCount);
+    heapCounters.resize(memoryProperties->memoryHeapCount);
+
+    return err;
+}
+
+VkResult RenderDriver::_CreateSwapchain(VkSwapchainKHR oldSwapchain)
+{
+    VkResult err;
+
+    VkSurfaceCapabilitiesKHR surfaceCapabilities = {};
+    err = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCapabilities);
+    VK_CHECK_ERROR(err);
+
+    imageCount = surfaceCapabilities.minImageCount + 1;
+    if (imageCount > surfaceCapabilities.maxImageCount)
+        imageCount = surfaceCapabilities.maxImageCount;
+
+    uint32_t formatCount = 0;
+    err = vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &formatCount, VK_NULL_HANDLE);
+    VK_CHECK_ERROR(err);
+
+    std::vector<VkSurfaceFormatKHR> surfaceFormats(formatCount);
+    err = vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &formatCount, std::data(surfaceFormats));
+    VK_CHECK_ERROR(err);
+
+    surfaceFormat = VkUtils::ChooseSwapSurfaceFormat(surfaceFormats);
+
+    VkSwapchainCreateInfoKHR swapchainCreateInfo = {};
+    swapchainCreateInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+    swapchainCreateInfo.surface = surface;
+    swapchainCreateInfo.minImageCount = imageCount;
+    swapchainCreateInfo.imageFormat = surfaceFormat.format;
+    swapchainCreateInfo.imageColorSpace = surfaceFormat.colorSpace;
+    swapchainCreateInfo.imageExtent = surfaceCapabilities.currentExtent;
+    swapchainCreateInfo.imageArrayLayers = 1;
+    swapchainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    swapchainCreateInfo.preTransform = surfaceCapabilities.currentTransform;
+    swapchainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    swapchainCreateInfo.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    swapchainCreateInfo.clipped = VK_TRUE;
+    swapchainCreateInfo.oldSwapchain = oldSwapchain;
+
+    VkSwapchainKHR tmpSwapchain = VK_NULL_HANDLE;
+    err = vkCreateSwapchainKHR(device, &swapchainCreateInfo, VK_NULL_HANDLE, &tmpSwapchain);
+    VK_CHECK_ERROR(err);
+
+    /* 旧 swapchain 的 image 可能还被在途的帧引用 */
+    if (oldSwapchain != VK_NULL_HANDLE)
+        _RetireSwapchain(frameNumber);
+
+    swapchain = tmpSwapchain;
+    swapchainExtent = surfaceCapabilities.currentExtent;
+
+    /* Create swapchain resources */
+    err = vkGetSwapchainImagesKHR(device, swapchain, &imageCount, nullptr);
+    VK_CHECK_ERROR(err);
+
+    swapchainImages.resize(imageCount);
+    swapchainImageViews.resize(imageCount);
+    renderFinishedSemaphores.resize(imageCount);
+
+    err = vkGetSwapchainImagesKHR(device, swapchain, &imageCount, std::data(swapchainImages));
+    VK_CHECK_ERROR(err);
+
+    for (uint32_t i = 0; i < imageCount; i++) {
+        VkImage swapchainImage = swapchainImages[i];
+
+        VkImageViewCreateInfo imageViewCreateInfo = {};
+        imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        imageViewCreateInfo.image = swapchainImage;
+        imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        imageViewCreateInfo.format = surfaceFormat.format;
+        imageViewCreateInfo.components = {
+            VK_COMPONENT_SWIZZLE_IDENTITY,
+            VK_COMPONENT_SWIZZLE_IDENTITY,
+            VK_COMPONENT_SWIZZLE_IDENTITY,
+            VK_COMPONENT_SWIZZLE_IDENTITY
+        };
+        imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
+        imageViewCreateInfo.subresourceRange.levelCount = 1;
+        imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
+        imageViewCreateInfo.subresourceRange.layerCount = 1;
+        imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+
+        err = vkCreateImageView(device, &imageViewCreateInfo, VK_NULL_HANDLE, &swapchainImageViews[i]);
+        VK_CHECK_ERROR(err);
+
+        /* present 等待的信号量跟随 swapchain image，而不是 frame slot */
+        VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+        semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        err = vkCreateSemaphore(device, &semaphoreCreateInfo, VK_NULL_HANDLE, &renderFinishedSemaphores[i]);
+        VK_CHECK_ERROR(err);
+    }
+
+    return err;
+}
+
+VkResult RenderDriver::_CreateDepthImage()
+{
+    VkResult err;
+
+    /* 除了深度测试，还要拷贝出来构建 Hi-Z */
+    VkImageCreateInfo imageCreateInfo = {};
+    imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageCreateInfo.format = DEPTH_FORMAT;
+    imageCreateInfo.extent = { swapchainExtent.width, swapchainExtent.height, 1 };
+    imageCreateInfo.mipLevels = 1;
+    imageCreateInfo.arrayLayers = 1;
+    imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VmaAllocationCreateInfo allocationCreateInfo = {};
+    allocationCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+    allocationCreateInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+
+    err = vmaCreateImage(memoryAllocator, &imageCreateInfo, &allocationCreateInfo, &depthImage, &depthAllocation, VK_NULL_HANDLE);
+    VK_CHECK_ERROR(err);
+
+    vmaSetAllocationName(memoryAllocator, depthAllocation, "driver/depth");
+
+    VkImageViewCreateInfo imageViewCreateInfo = {};
+    imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    imageViewCreateInfo.image = depthImage;
+    imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    imageViewCreateInfo.format = DEPTH_FORMAT;
+    imageViewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+
+    err = vkCreateImageView(device, &imageViewCreateInfo, VK_NULL_HANDLE, &depthImageView);
+    VK_CHECK_ERROR(err);
+
+    return err;
+}
+
+void RenderDriver::_RetireDepthImage(uint64_t lastUsedFrame)
+{
+    if (depthImage == VK_NULL_HANDLE)
+        return;
+
+    RetiredObject retired = {};
+    retired.frameNumber = lastUsedFrame;
+
+    retired.type = RETIRED_OBJECT_IMAGE_VIEW;
+    retired.vkImageView = depthImageView;
+    retiredObjects.push_back(retired);
+
+    retired.type = RETIRED_OBJECT_IMAGE;
+    retired.image.vkImage = depthImage;
+    retired.image.allocation = depthAllocation;
+    retiredObjects.push_back(retired);
+
+    depthImage = VK_NULL_HANDLE;
+    depthAllocation = VK_NULL_HANDLE;
+    depthImageView = VK_NULL_HANDLE;
+}
+
+VkResult RenderDriver::_CreateCommandPool()
+{
+    VkResult err;
+
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+    commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT
+                                  | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    commandPoolCreateInfo.queueFamilyIndex = queueFamilyIndex;
+
+    err = vkCreateCommandPool(device, &commandPoolCreateInfo, VK_NULL_HANDLE, &commandPool);
+    VK_CHECK_ERROR(err);
+
+    return err;
+}
+
+VkResult RenderDriver::_CreateFrameResources()
+{
+    VkResult err;
+
+    VkCommandBuffer commandBuffers[MAX_FRAMES_IN_FLIGHT];
+
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
+    commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferAllocateInfo.commandPool = commandPool;
+    commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferAllocateInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
+
+    err = vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, commandBuffers);
+    VK_CHECK_ERROR(err);
+
+    VkFenceCreateInfo fenceCreateInfo = {};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        FrameContext *frame = &frames[i];
+        frame->commandBuffer = commandBuffers[i];
+
+        err = vkCreateFence(device, &fenceCreateInfo, VK_NULL_HANDLE, &frame->fence);
+        VK_CHECK_ERROR(err);
+
+        err = vkCreateSemaphore(device, &semaphoreCreateInfo, VK_NULL_HANDLE, &frame->imageAvailableSemaphore);
+        VK_CHECK_ERROR(err);
+    }
+
+    return err;
+}
+
+VkResult RenderDriver::_CreatePipelineLayout()
+{
+    VkResult err;
+
+    /* 所有图形 pipeline 共用同一个 layout，GPL 链接时各 library 的 layout 才能兼容 */
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_ALL;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = PUSH_CONSTANT_SIZE;
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 0;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    err = vkCreatePipelineLayout(device, &pipelineLayoutInfo, VK_NULL_HANDLE, &pipelineLayout);
+    VK_CHECK_ERROR(err);
+
+    return err;
+}
+
+VkResult RenderDriver::_CreateShaderModule(const char* shaderName, const char* stage, VkShaderModule* pShaderModule)
+{
+    size_t size;
+    VkResult err;
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s.%s.spv", shaderName, stage);
+
+    char *buf = LoadShaderCode(path, &size);
+    if (buf == NULL)
+        return VK_ERROR_INITIALIZATION_FAILED;
+
+    printf("[vulkan] load shader module %s, code size=%ld\n", path, size);
+
+    VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
+    shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shaderModuleCreateInfo.codeSize = size;
+    shaderModuleCreateInfo.pCode = reinterpret_cast<uint32_t*>(buf);
+
+    err = vkCreateShaderModule(device, &shaderModuleCreateInfo, VK_NULL_HANDLE, pShaderModule);
+    io_free_buf(buf);
+    VK_CHECK_ERROR(err);
+
+    return err;
+}
+
+VkResult RenderDriver::_CreateGraphicsPipeline(const PipelineDesc& desc, VkGraphicsPipelineLibraryFlagsEXT libraryFlags, VkPipelineCreateFlags flags, VkPipeline *pPipeline)
+{
+    VkResult err;
+
+    /* libraryFlags 为 0 时创建完整的 pipeline，否则只创建对应部分的 library */
+    const bool isLibrary = libraryFlags != 0;
+    const bool hasVertexInput = !isLibrary || (libraryFlags & VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT);
+    const bool hasPreRasterization = !isLibrary || (libraryFlags & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT);
+    const bool hasFragmentShader = !isLibrary || (libraryFlags & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT);
+    const bool hasFragmentOutput = !isLibrary || (libraryFlags & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT);
+
+    /* shader module */
+    VkShaderModule vertexShaderModule = VK_NULL_HANDLE;
+    VkShaderModule fragmentShaderModule = VK_NULL_HANDLE;
+
+    uint32_t stageCount = 0;
+    VkPipelineShaderStageCreateInfo shaderStagesCreateInfo[2] = {};
+
+    if (hasPreRasterization) {
+        err = _CreateShaderModule(desc.shaderName, "vert", &vertexShaderModule);
+        VK_CHECK_ERROR(err);
+
+        VkPipelineShaderStageCreateInfo *stage = &shaderStagesCreateInfo[stageCount++];
+        stage->sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stage->stage = VK_SHADER_STAGE_VERTEX_BIT;
+        stage->module = vertexShaderModule;
+        stage->pName = "main";
+    }
+
+    /* 深度预渲染只需要光栅化和深度测试，fragment shader library 不带着色器阶段 */
+    if (hasFragmentShader && !desc.depthOnly) {
+        err = _CreateShaderModule(desc.shaderName, "frag", &fragmentShaderModule);
+        if (err != VK_SUCCESS) {
+            vkDestroyShaderModule(device, vertexShaderModule, VK_NULL_HANDLE);
+            return err;
+        }
+
+        VkPipelineShaderStageCreateInfo *stage = &shaderStagesCreateInfo[stageCount++];
+        stage->sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stage->stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        stage->module = fragmentShaderModule;
+        stage->pName = "main";
+    }
+
+    /* VkPipelineVertexInputStateCreateInfo */
+    VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo = {};
+    vertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    const VertexInputLayout& vertexInputLayout = vertexInputLayouts[desc.vertexLayout];
+    vertexInputStateCreateInfo.vertexBindingDescriptionCount = vertexInputLayout.bindingCount;
+    vertexInputStateCreateInfo.pVertexBindingDescriptions = vertexInputLayout.pBindings;
+    vertexInputStateCreateInfo.vertexAttributeDescriptionCount = vertexInputLayout.attributeCount;
+    vertexInputStateCreateInfo.pVertexAttributeDescriptions = vertexInputLayout.pAttributes;
+
+    /* VkPipelineInputAssemblyStateCreateInfo */
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCreateInfo = {};
+    inputAssemblyStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssemblyStateCreateInfo.topology = desc.renderState.topology;
+    inputAssemblyStateCreateInfo.primitiveRestartEnable = VK_FALSE;
+
+    /* VkPipelineRasterizationStateCreateInfo */
+    VkPipelineRasterizationStateCreateInfo rasterizationStateCreateInfo = {};
+    rasterizationStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizationStateCreateInfo.depthClampEnable = VK_FALSE;                   // 超出深度范围裁剪而不是 clamp
+    rasterizationStateCreateInfo.rasterizerDiscardEnable = VK_TRUE;             // 不丢弃几何体
+    rasterizationStateCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;            // 填充多边形方式点、线、面
+    rasterizationStateCreateInfo.lineWidth = 1.0f;                              // 线宽
+    rasterizationStateCreateInfo.cullMode = desc.renderState.cullMode;          // 背面剔除，动态状态，绑定时再设置
+    rasterizationStateCreateInfo.frontFace = desc.renderState.frontFace;        // 前向面定义，动态状态
+    rasterizationStateCreateInfo.depthBiasEnable = VK_FALSE;                    // 不使用深度偏移
+    rasterizationStateCreateInfo.depthBiasConstantFactor = 0.0f;
+    rasterizationStateCreateInfo.depthBiasClamp = 0.0f;
+    rasterizationStateCreateInfo.depthBiasSlopeFactor = 0.0f;
+
+    /* VkPipelineViewportStateCreateInfo, viewport 和 scissor 都是动态状态 */
+    VkPipelineViewportStateCreateInfo viewportStateCreateInfo = {};
+    viewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportStateCreateInfo.viewportCount = 1;
+    viewportStateCreateInfo.scissorCount = 1;
+
+    /* VkPipelineMultisampleStateCreateInfo */
+    VkPipelineMultisampleStateCreateInfo multisampleStateCreateInfo = {};
+    multisampleStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampleStateCreateInfo.sampleShadingEnable = VK_FALSE;                  // 关闭样本着色
+    multisampleStateCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;    // 每像素采样数，1 = 关闭 MSAA
+    multisampleStateCreateInfo.minSampleShading = 1.0f;                         // 如果开启 sampleShading，最小采样比例
+    multisampleStateCreateInfo.pSampleMask = VK_NULL_HANDLE;                    // 默认全开
+    multisampleStateCreateInfo.alphaToCoverageEnable = VK_FALSE;                // alpha to coverage 禁用
+    multisampleStateCreateInfo.alphaToOneEnable = VK_FALSE;                     // alphaToOne 禁用
+
+    /* VkPipelineColorBlendStateCreateInfo */
+    VkPipelineColorBlendAttachmentState colorBlendAttachmentStage = {};
+    colorBlendAttachmentStage.colorWriteMask = desc.depthOnly ? 0 :
+        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+        VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachmentStage.blendEnable = desc.renderState.blendEnable;       // 是否开启混合
+    colorBlendAttachmentStage.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    colorBlendAttachmentStage.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachmentStage.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachmentStage.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachmentStage.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    colorBlendAttachmentStage.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo colorBlendStateCreateInfo = {};
+    colorBlendStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlendStateCreateInfo.logicOpEnable = VK_FALSE;                         // 不使用逻辑操作
+    colorBlendStateCreateInfo.logicOp = VK_LOGIC_OP_COPY;                       // 无效，因为逻辑操作关闭
+    colorBlendStateCreateInfo.attachmentCount = 1;
+    colorBlendStateCreateInfo.pAttachments = &colorBlendAttachmentStage;
+    colorBlendStateCreateInfo.blendConstants[0] = 0.0f;
+    colorBlendStateCreateInfo.blendConstants[1] = 0.0f;
+    colorBlendStateCreateInfo.blendConstants[2] = 0.0f;
+    colorBlendStateCreateInfo.blendConstants[3] = 0.0f;
+
+    /* VkPipelineDepthStencilStateCreateInfo，深度相关状态都是动态的 */
+    VkPipelineDepthStencilStateCreateInfo depthStencilStateCreateInfo = {};
+    depthStencilStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencilStateCreateInfo.depthTestEnable = desc.renderState.depthTestEnable;
+    depthStencilStateCreateInfo.depthWriteEnable = desc.renderState.depthWriteEnable;
+    depthStencilStateCreateInfo.depthCompareOp = desc.renderState.depthCompareOp;
+
+    /* VkPipelineDynamicStateCreateInfo[]，extended dynamic state 1/2 在 1.3 中是核心功能 */
+    std::vector<VkDynamicState> dynamicStates = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR,
+        VK_DYNAMIC_STATE_RASTERIZER_DISCARD_ENABLE,
+        VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY,
+        VK_DYNAMIC_STATE_CULL_MODE,
+        VK_DYNAMIC_STATE_FRONT_FACE,
+        VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE,
+        VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE,
+        VK_DYNAMIC_STATE_DEPTH_COMPARE_OP,
+    };
+
+    if (colorBlendEnableDynamic)
+        dynamicStates.push_back(VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT);
+
+    VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
+    dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicStateCreateInfo.dynamicStateCount = static_cast<uint32_t>(std::size(dynamicStates));
+    dynamicStateCreateInfo.pDynamicStates = std::data(dynamicStates);
+
+    /* dynamic rendering */
+    VkPipelineRenderingCreateInfo pipelineRenderingInfo = {};
+    pipelineRenderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+    pipelineRenderingInfo.colorAttachmentCount = 1;
+    pipelineRenderingInfo.pColorAttachmentFormats = &surfaceFormat.format;
+    pipelineRenderingInfo.depthAttachmentFormat = DEPTH_FORMAT;
+
+    /* graphics pipeline library */
+    VkGraphicsPipelineLibraryCreateInfoEXT libraryCreateInfo = {};
+    libraryCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+    libraryCreateInfo.pNext = &pipelineRenderingInfo;
+    libraryCreateInfo.flags = libraryFlags;
+
+    VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.pNext = isLibrary ? (void *) &libraryCreateInfo : (void *) &pipelineRenderingInfo;
+    pipelineCreateInfo.flags = isLibrary ? (flags | VK_PIPELINE_CREATE_LIBRARY_BIT_KHR) : flags;
+    pipelineCreateInfo.stageCount = stageCount;
+    pipelineCreateInfo.pStages = shaderStagesCreateInfo;
+    pipelineCreateInfo.pVertexInputState = hasVertexInput ? &vertexInputStateCreateInfo : VK_NULL_HANDLE;
+    pipelineCreateInfo.pInputAssemblyState = hasVertexInput ? &inputAssemblyStateCreateInfo : VK_NULL_HANDLE;
+    pipelineCreateInfo.pTessellationState = VK_NULL_HANDLE;
+    pipelineCreateInfo.pViewportState = hasPreRasterization ? &viewportStateCreateInfo : VK_NULL_HANDLE;
+    pipelineCreateInfo.pRasterizationState = hasPreRasterization ? &rasterizationStateCreateInfo : VK_NULL_HANDLE;
+    pipelineCreateInfo.pMultisampleState = (hasFragmentShader || hasFragmentOutput) ? &multisampleStateCreateInfo : VK_NULL_HANDLE;
+    pipelineCreateInfo.pDepthStencilState = hasFragmentShader ? &depthStencilStateCreateInfo : VK_NULL_HANDLE;
+    pipelineCreateInfo.pColorBlendState = hasFragmentOutput ? &colorBlendStateCreateInfo : VK_NULL_HANDLE;
+    pipelineCreateInfo.pDynamicState = &dynamicStateCreateInfo;
+    pipelineCreateInfo.layout = (hasPreRasterization || hasFragmentShader) ? pipelineLayout : VK_NULL_HANDLE;
+
+    err = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, VK_NULL_HANDLE, pPipeline);
+
+    vkDestroyShaderModule(device, vertexShaderModule, VK_NULL_HANDLE);
+    vkDestroyShaderModule(device, fragmentShaderModule, VK_NULL_HANDLE);
+
+    return err;
+}
+
+VkResult RenderDriver::_GetPipelineLibrary(const PipelineDesc& desc, VkGraphicsPipelineLibraryFlagsEXT libraryFlags, VkPipeline *pLibrary)
+{
+    VkResult err;
+
+    /* 每个 library 只由它自己负责的那部分状态决定 */
+    const char *shaderName = "";
+    uint64_t key = HashBytes(FNV_OFFSET_BASIS, &libraryFlags, sizeof(libraryFlags));
+
+    /* cull mode、front face、深度状态都是动态的，不进 key；topology 只能在同一类别内动态切换 */
+    switch (libraryFlags) {
+        case VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT: {
+            uint32_t topologyClass = TopologyClass(desc.renderState.topology);
+            key = HashBytes(key, &topologyClass, sizeof(topologyClass));
+            key = HashBytes(key, &desc.vertexLayout, sizeof(desc.vertexLayout));
+            break;
+        }
+        case VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT:
+            shaderName = desc.shaderName;
+            key = HashString(key, shaderName);
+            break;
+        case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT:
+            /* 深度预渲染不带 fragment shader，所有 shader 共用一个 library */
+            shaderName = desc.depthOnly ? "" : desc.shaderName;
+            key = HashString(key, shaderName);
+            break;
+        case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT:
+            key = HashBytes(key, &desc.depthOnly, sizeof(desc.depthOnly));
+            if (!colorBlendEnableDynamic)
+                key = HashBytes(key, &desc.renderState.blendEnable, sizeof(desc.renderState.blendEnable));
+            break;
+        default:
+            return VK_ERROR_UNKNOWN;
+    }
+
+    uint64_t generation;
+
+    {
+        std::lock_guard<std::mutex> lock(libraryMutex);
+
+        auto it = pipelineLibraries.find(key);
+        if (it != pipelineLibraries.end()) {
+            *pLibrary = it->second.vkPipeline;
+            return VK_SUCCESS;
+        }
+
+        generation = libraryGeneration;
+    }
+
+    /*
+     * 编译时不持有 libraryMutex，主线程的快速链接不用排在后台预编译和 LTO 任务后面。
+     * 保留 LTO 信息，后台才能链接出完全优化的 pipeline。
+     */
+    VkPipeline vkLibrary = VK_NULL_HANDLE;
+    err = _CreateGraphicsPipeline(desc, libraryFlags, VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT, &vkLibrary);
+    VK_CHECK_ERROR(err);
+
+    std::lock_guard<std::mutex> lock(libraryMutex);
+
+    /* 其他线程已经编译好同一个 library，用先放进去的那个 */
+    auto it = pipelineLibraries.find(key);
+    if (it != pipelineLibraries.end()) {
+        vkDestroyPipeline(device, vkLibrary, VK_NULL_HANDLE);
+        *pLibrary = it->second.vkPipeline;
+        return VK_SUCCESS;
+    }
+
+    *pLibrary = vkLibrary;
+
+    /* 编译期间有 shader 被热重载，结果可能来自旧文件，这次照常使用，但不放进缓存 */
+    if (generation != libraryGeneration) {
+        staleLibraries.push_back(vkLibrary);
+        return VK_SUCCESS;
+    }
+
+    PipelineLibrary library = {};
+    library.vkPipeline = vkLibrary;
+    snprintf(library.shaderName, sizeof(library.shaderName), "%s", shaderName);
+    pipelineLibraries[key] = library;
 
-    float priorities = 1.0f;
-    VkDeviceQueueCreateInfo queueCreateInfo = {};
-    queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queueCreateInfo.queueFamilyIndex = queueFamilyIndex;
-    queueCreateInfo.queueCount = 1;
-    queueCreateInfo.pQueuePriorities = &priorities;
+    return VK_SUCCESS;
+}
+
+VkResult RenderDriver::_LinkPipeline(const PipelineDesc& desc, bool optimized, VkPipeline *pPipeline)
+{
+    VkResult err;
+
+    static const VkGraphicsPipelineLibraryFlagsEXT libraryParts[] = {
+        VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+        VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+        VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+        VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT,
+    };
+
+    VkPipeline libraries[std::size(libraryParts)] = {};
+    for (uint32_t i = 0; i < std::size(libraryParts); i++) {
+        err = _GetPipelineLibrary(desc, libraryParts[i], &libraries[i]);
+        VK_CHECK_ERROR(err);
+    }
+
+    VkPipelineLibraryCreateInfoKHR libraryCreateInfo = {};
+    libraryCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+    libraryCreateInfo.libraryCount = ARRAY_SIZE(libraries);
+    libraryCreateInfo.pLibraries = &libraries[0];
+
+    /* 不带 LTO 标志就是 fast-link，几乎没有编译开销 */
+    VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.pNext = &libraryCreateInfo;
+    pipelineCreateInfo.flags = optimized ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+    pipelineCreateInfo.layout = pipelineLayout;
+
+    err = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, VK_NULL_HANDLE, pPipeline);
+    VK_CHECK_ERROR(err);
+
+    return err;
+}
+
+VkResult RenderDriver::_BuildPipeline(const PipelineDesc& desc, VkPipeline *pPipeline)
+{
+    if (graphicsPipelineLibraryEnabled)
+        return _LinkPipeline(desc, false, pPipeline);
+
+    return _CreateGraphicsPipeline(desc, 0, 0, pPipeline);
+}
+
+void RenderDriver::_QueueOptimizedPipeline(uint64_t key)
+{
+    /* 调用方需持有 pipelineMutex，这里拷贝一份描述，任务执行时 pipeline 可能已经销毁 */
+    const SharedPipeline& shared = sharedPipelines.at(key);
+    PipelineDesc desc = shared.desc;
+    std::string shaderName = shared.shaderName;
+    uint64_t revision = shared.revision;
+
+    pendingOptimizeJobs++;
+
+    jobSystem.Submit([this, key, desc, shaderName, revision]() mutable {
+        desc.shaderName = shaderName.c_str();
+
+        VkPipeline vkPipeline = VK_NULL_HANDLE;
+        VkResult err = _LinkPipeline(desc, true, &vkPipeline);
+
+        if (err == VK_SUCCESS) {
+            std::lock_guard<std::mutex> lock(pipelineMutex);
+
+            /* 所有句柄都销毁后 key 不存在，revision 全局递增，又被热重载过也会对不上 */
+            auto it = sharedPipelines.find(key);
+            if (it != sharedPipelines.end() && it->second.revision == revision) {
+                std::lock_guard<std::mutex> swapLock(pendingSwapMutex);
+                pendingPipelineSwaps.push_back({ key, revision, vkPipeline, {} });
+                vkPipeline = VK_NULL_HANDLE;
+            }
+        }
+
+        if (vkPipeline != VK_NULL_HANDLE)
+            vkDestroyPipeline(device, vkPipeline, VK_NULL_HANDLE);
+
+        pendingOptimizeJobs--;
+    });
+}
+
+VkResult RenderDriver::_CreateShaderObjects(const PipelineDesc& desc, VkShaderEXT *pShaders)
+{
+    VkResult err;
+
+    static const char *stageNames[SHADER_OBJECT_STAGE_COUNT] = { "vert", "frag" };
+
+    /* 深度预渲染只创建顶点着色器，绑定时 fragment 阶段为空 */
+    const uint32_t stageCount = desc.depthOnly ? 1 : SHADER_OBJECT_STAGE_COUNT;
+
+    size_t codeSizes[SHADER_OBJECT_STAGE_COUNT] = {};
+    char *codes[SHADER_OBJECT_STAGE_COUNT] = {};
+
+    for (uint32_t i = 0; i < stageCount; i++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s.%s.spv", desc.shaderName, stageNames[i]);
+        codes[i] = LoadShaderCode(path, &codeSizes[i]);
+
+        if (codes[i] == NULL) {
+            for (uint32_t j = 0; j < i; j++)
+                io_free_buf(codes[j]);
+            return VK_ERROR_INITIALIZATION_FAILED;
+        }
+
+        printf("[vulkan] load shader object %s, code size=%ld\n", path, codeSizes[i]);
+    }
+
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_ALL;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = PUSH_CONSTANT_SIZE;
+
+    /* 顶点和片元阶段链接在一起创建，驱动可以做跨阶段优化 */
+    VkShaderCreateInfoEXT shaderCreateInfos[SHADER_OBJECT_STAGE_COUNT] = {};
+
+    shaderCreateInfos[0].sType = VK_STRUCTURE_TYPE_SHADER_CREATE_INFO_EXT;
+    shaderCreateInfos[0].flags = desc.depthOnly ? 0 : VK_SHADER_CREATE_LINK_STAGE_BIT_EXT;
+    shaderCreateInfos[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderCreateInfos[0].nextStage = desc.depthOnly ? 0 : VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    shaderCreateInfos[1].sType = VK_STRUCTURE_TYPE_SHADER_CREATE_INFO_EXT;
+    shaderCreateInfos[1].flags = VK_SHADER_CREATE_LINK_STAGE_BIT_EXT;
+    shaderCreateInfos[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderCreateInfos[1].nextStage = 0;
+
+    for (uint32_t i = 0; i < stageCount; i++) {
+        shaderCreateInfos[i].codeType = VK_SHADER_CODE_TYPE_SPIRV_EXT;
+        shaderCreateInfos[i].codeSize = codeSizes[i];
+        shaderCreateInfos[i].pCode = codes[i];
+        shaderCreateInfos[i].pName = "main";
+        shaderCreateInfos[i].pushConstantRangeCount = 1;                        // 和 pipelineLayout 保持一致
+        shaderCreateInfos[i].pPushConstantRanges = &pushConstantRange;
+    }
+
+    for (uint32_t i = stageCount; i < SHADER_OBJECT_STAGE_COUNT; i++)
+        pShaders[i] = VK_NULL_HANDLE;
+
+    err = vkCreateShadersEXT(device, stageCount, shaderCreateInfos, VK_NULL_HANDLE, pShaders);
+
+    for (uint32_t i = 0; i < stageCount; i++)
+        io_free_buf(codes[i]);
+
+    VK_CHECK_ERROR(err);
+
+    return err;
+}
+
+VkResult RenderDriver::_CreateComputePipeline(const char *shaderName, VkPipeline *pPipeline)
+{
+    VkResult err;
+
+    VkShaderModule computeShaderModule = VK_NULL_HANDLE;
+    err = _CreateShaderModule(shaderName, "comp", &computeShaderModule);
+    VK_CHECK_ERROR(err);
+
+    VkComputePipelineCreateInfo pipelineCreateInfo = {};
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineCreateInfo.stage.module = computeShaderModule;
+    pipelineCreateInfo.stage.pName = "main";
+    pipelineCreateInfo.layout = pipelineLayout;
+
+    err = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, VK_NULL_HANDLE, pPipeline);
+
+    vkDestroyShaderModule(device, computeShaderModule, VK_NULL_HANDLE);
+
+    return err;
+}
+
+VkResult RenderDriver::_CreateMeshPipeline(const PipelineDesc& desc, VkPipeline *pPipeline)
+{
+    VkResult err = VK_SUCCESS;
+
+    static const char *stageNames[] = { "task", "mesh", "frag" };
+    static const VkShaderStageFlagBits stageFlags[] = {
+        VK_SHADER_STAGE_TASK_BIT_EXT,
+        VK_SHADER_STAGE_MESH_BIT_EXT,
+        VK_SHADER_STAGE_FRAGMENT_BIT,
+    };
+
+    VkShaderModule shaderModules[ARRAY_SIZE(stageNames)] = {};
+    VkPipelineShaderStageCreateInfo shaderStagesCreateInfo[ARRAY_SIZE(stageNames)] = {};
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(stageNames) && err == VK_SUCCESS; i++) {
+        err = _CreateShaderModule(desc.shaderName, stageNames[i], &shaderModules[i]);
+
+        shaderStagesCreateInfo[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStagesCreateInfo[i].stage = stageFlags[i];
+        shaderStagesCreateInfo[i].module = shaderModules[i];
+        shaderStagesCreateInfo[i].pName = "main";
+    }
+
+    if (err != VK_SUCCESS) {
+        for (VkShaderModule shaderModule : shaderModules)
+            vkDestroyShaderModule(device, shaderModule, VK_NULL_HANDLE);
+        return err;
+    }
+
+    /* 没有顶点输入和图元装配阶段，其余状态和 _CreateGraphicsPipeline 一致 */
+    VkPipelineRasterizationStateCreateInfo rasterizationStateCreateInfo = {};
+    rasterizationStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizationStateCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizationStateCreateInfo.lineWidth = 1.0f;
+    rasterizationStateCreateInfo.cullMode = desc.renderState.cullMode;
+    rasterizationStateCreateInfo.frontFace = desc.renderState.frontFace;
+
+    VkPipelineViewportStateCreateInfo viewportStateCreateInfo = {};
+    viewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportStateCreateInfo.viewportCount = shaderObjectEnabled ? 0 : 1;       // WithCount 动态状态要求为 0
+    viewportStateCreateInfo.scissorCount = shaderObjectEnabled ? 0 : 1;
+
+    VkPipelineMultisampleStateCreateInfo multisampleStateCreateInfo = {};
+    multisampleStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampleStateCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampleStateCreateInfo.minSampleShading = 1.0f;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachmentStage = {};
+    colorBlendAttachmentStage.colorWriteMask =
+        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+        VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachmentStage.blendEnable = desc.renderState.blendEnable;
+    colorBlendAttachmentStage.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    colorBlendAttachmentStage.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachmentStage.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachmentStage.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachmentStage.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    colorBlendAttachmentStage.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo colorBlendStateCreateInfo = {};
+    colorBlendStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlendStateCreateInfo.attachmentCount = 1;
+    colorBlendStateCreateInfo.pAttachments = &colorBlendAttachmentStage;
+
+    VkPipelineDepthStencilStateCreateInfo depthStencilStateCreateInfo = {};
+    depthStencilStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencilStateCreateInfo.depthTestEnable = desc.renderState.depthTestEnable;
+    depthStencilStateCreateInfo.depthWriteEnable = desc.renderState.depthWriteEnable;
+    depthStencilStateCreateInfo.depthCompareOp = desc.renderState.depthCompareOp;
+
+    /*
+     * mesh pipeline 不能把 topology 设为动态状态。shader object 模式下 dynamicStateCache
+     * 用 *WithCount 设置 viewport/scissor，这里也要一致；colorBlendEnable 只有开启了 EDS3 才能动态。
+     */
+    std::vector<VkDynamicState> dynamicStates = {
+        shaderObjectEnabled ? VK_DYNAMIC_STATE_VIEWPORT_WITH_COUNT : VK_DYNAMIC_STATE_VIEWPORT,
+        shaderObjectEnabled ? VK_DYNAMIC_STATE_SCISSOR_WITH_COUNT : VK_DYNAMIC_STATE_SCISSOR,
+        VK_DYNAMIC_STATE_RASTERIZER_DISCARD_ENABLE,
+        VK_DYNAMIC_STATE_CULL_MODE,
+        VK_DYNAMIC_STATE_FRONT_FACE,
+        VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE,
+        VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE,
+        VK_DYNAMIC_STATE_DEPTH_COMPARE_OP,
+    };
+
+    if (colorBlendEnableDynamic && !shaderObjectEnabled)
+        dynamicStates.push_back(VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT);
+
+    VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
+    dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicStateCreateInfo.dynamicStateCount = static_cast<uint32_t>(std::size(dynamicStates));
+    dynamicStateCreateInfo.pDynamicStates = std::data(dynamicStates);
+
+    VkPipelineRenderingCreateInfo pipelineRenderingInfo = {};
+    pipelineRenderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+    pipelineRenderingInfo.colorAttachmentCount = 1;
+    pipelineRenderingInfo.pColorAttachmentFormats = &surfaceFormat.format;
+    pipelineRenderingInfo.depthAttachmentFormat = DEPTH_FORMAT;
+
+    VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.pNext = &pipelineRenderingInfo;
+    pipelineCreateInfo.stageCount = ARRAY_SIZE(shaderStagesCreateInfo);
+    pipelineCreateInfo.pStages = shaderStagesCreateInfo;
+    pipelineCreateInfo.pViewportState = &viewportStateCreateInfo;
+    pipelineCreateInfo.pRasterizationState = &rasterizationStateCreateInfo;
+    pipelineCreateInfo.pMultisampleState = &multisampleStateCreateInfo;
+    pipelineCreateInfo.pDepthStencilState = &depthStencilStateCreateInfo;
+    pipelineCreateInfo.pColorBlendState = &colorBlendStateCreateInfo;
+    pipelineCreateInfo.pDynamicState = &dynamicStateCreateInfo;
+    pipelineCreateInfo.layout = pipelineLayout;
+
+    err = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, VK_NULL_HANDLE, pPipeline);
+
+    for (VkShaderModule shaderModule : shaderModules)
+        vkDestroyShaderModule(device, shaderModule, VK_NULL_HANDLE);
+
+    return err;
+}
+
+void RenderDriver::_UpdateMemoryBudget()
+{
+    /* 没有 VK_EXT_memory_budget 时 VMA 按堆大小的 80% 估算预算 */
+    vmaSetCurrentFrameIndex(memoryAllocator, static_cast<uint32_t>(frameNumber));
+    vmaGetHeapBudgets(memoryAllocator, std::data(heapBudgets));
+}
+
+void RenderDriver::_EvictStreamableBuffers()
+{
+    const uint32_t heapCount = static_cast<uint32_t>(std::size(heapBudgets));
+
+    bool overBudget = false;
+    for (const VmaBudget& budget : heapBudgets)
+        overBudget |= budget.usage > budget.budget * MEMORY_BUDGET_EVICT_THRESHOLD;
+
+    if (!overBudget)
+        return;
+
+    /* 已经在延迟销毁队列里的 buffer 很快就会释放，不要因为它们再多驱逐 */
+    const VkPhysicalDeviceMemoryProperties *memoryProperties = VK_NULL_HANDLE;
+    vmaGetMemoryProperties(memoryAllocator, &memoryProperties);
+
+    std::vector<VkDeviceSize> heapUsages(heapCount);
+    for (uint32_t i = 0; i < heapCount; i++)
+        heapUsages[i] = heapBudgets[i].usage;
+
+    for (const RetiredObject& retired : retiredObjects) {
+        if (retired.type != RETIRED_OBJECT_BUFFER || retired.buffer.allocation == VK_NULL_HANDLE)
+            continue;
+
+        VmaAllocationInfo allocationInfo = {};
+        vmaGetAllocationInfo(memoryAllocator, retired.buffer.allocation, &allocationInfo);
+
+        uint32_t heapIndex = memoryProperties->memoryTypes[allocationInfo.memoryType].heapIndex;
+        heapUsages[heapIndex] -= std::min(heapUsages[heapIndex], allocationInfo.size);
+    }
+
+    /* 候选是本帧还没用过的流式 buffer，最久没用的先驱逐 */
+    struct EvictCandidate {
+        uint64_t lastUsedFrame;
+        uint32_t handle;
+    };
+
+    std::vector<EvictCandidate> candidates;
+
+    for (uint32_t slot : buffers.handles.GetLiveSlots()) {
+        if (!buffers.evictCallbacks[slot] || buffers.lastUsedFrames[slot] >= frameNumber)
+            continue;
+
+        const VmaBudget& budget = heapBudgets[buffers.heapIndices[slot]];
+        if (heapUsages[buffers.heapIndices[slot]] > budget.budget * MEMORY_BUDGET_EVICT_THRESHOLD)
+            candidates.push_back({ buffers.lastUsedFrames[slot], buffers.handles.GetHandle(slot) });
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const EvictCandidate& a, const EvictCandidate& b) {
+        return a.lastUsedFrame < b.lastUsedFrame;
+    });
+
+    for (const EvictCandidate& candidate : candidates) {
+        if (!buffers.handles.IsValid(candidate.handle))
+            continue;
+
+        uint32_t slot = HandlePool::IndexOf(candidate.handle);
+        uint32_t heapIndex = buffers.heapIndices[slot];
+
+        if (heapUsages[heapIndex] <= heapBudgets[heapIndex].budget * MEMORY_BUDGET_EVICT_TARGET)
+            continue;
+
+        heapUsages[heapIndex] -= std::min(heapUsages[heapIndex], buffers.sizes[slot]);
+
+        Buffer buffer = {};
+        buffer.id = candidate.handle;
+
+        /* 回调里可能会读 buffer 信息，之后再销毁 */
+        BufferEvictCallback onEvict = std::move(buffers.evictCallbacks[slot]);
+        onEvict(buffer);
+        DestroyBuffer(buffer);
+
+        evictedBufferCount++;
+    }
+}
+
+std::vector<MemoryHeapStats> RenderDriver::GetMemoryStats() const
+{
+    /* 实时查询，不依赖每帧缓存的 heapBudgets */
+    std::vector<VmaBudget> budgets(std::size(heapCounters));
+    vmaGetHeapBudgets(memoryAllocator, std::data(budgets));
+
+    std::vector<MemoryHeapStats> heaps = heapCounters;
+
+    for (uint32_t i = 0; i < std::size(heaps); i++) {
+        heaps[i].budget = budgets[i].budget;
+        heaps[i].usage = budgets[i].usage;
+        heaps[i].blockBytes = budgets[i].statistics.blockBytes;
+        heaps[i].allocationBytes = budgets[i].statistics.allocationBytes;
+        heaps[i].blockCount = budgets[i].statistics.blockCount;
+        heaps[i].allocationCount = budgets[i].statistics.allocationCount;
+    }
+
+    return heaps;
+}
+
+bool RenderDriver::DumpMemoryStats(const char *path) const
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+        return false;
+
+    /* detailedMap 会列出每个分配的名字、大小和所在 block */
+    char *statsString = NULL;
+    vmaBuildStatsString(memoryAllocator, &statsString, VK_TRUE);
+
+    bool ok = fputs(statsString, file) >= 0;
+
+    vmaFreeStatsString(memoryAllocator, statsString);
+    fclose(file);
+
+    return ok;
+}
+
+void RenderDriver::StartDefragmentation()
+{
+    VkResult err;
+
+    if (defragState != DEFRAG_STATE_IDLE)
+        return;
+
+    if (defragFence == VK_NULL_HANDLE) {
+        VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
+        commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandBufferAllocateInfo.commandPool = commandPool;
+        commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        commandBufferAllocateInfo.commandBufferCount = 1;
+
+        err = vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &defragCommandBuffer);
+        if (err != VK_SUCCESS)
+            return;
+
+        VkFenceCreateInfo fenceCreateInfo = {};
+        fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        err = vkCreateFence(device, &fenceCreateInfo, VK_NULL_HANDLE, &defragFence);
+        if (err != VK_SUCCESS)
+            return;
+    }
+
+    VmaDefragmentationInfo defragmentationInfo = {};
+    defragmentationInfo.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT;
+    defragmentationInfo.maxBytesPerPass = DEFRAG_MAX_BYTES_PER_PASS;
+    defragmentationInfo.maxAllocationsPerPass = DEFRAG_MAX_ALLOCATIONS_PER_PASS;
+
+    err = vmaBeginDefragmentation(memoryAllocator, &defragmentationInfo, &defragContext);
+    if (err != VK_SUCCESS)
+        return;
+
+    defragStats = {};
+    defragState = DEFRAG_STATE_RUNNING;
+}
+
+void RenderDriver::_UpdateDefragmentation()
+{
+    VkResult err;
+
+    if (defragState == DEFRAG_STATE_PASS_IN_FLIGHT) {
+        /* 拷贝完成、并且引用旧 buffer 的帧都执行完后，旧位置才能交还给 VMA */
+        if (vkGetFenceStatus(device, defragFence) != VK_SUCCESS || completedFrameNumber < defragPassFrame)
+            return;
+
+        for (uint32_t slot : defragMoveSlots)
+            buffers.moving[slot] = 0;
+        defragMoveSlots.clear();
+
+        /* 拷贝走的是 defragFence 而不是帧 fence，旧 VkBuffer 不能走 retiredObjects */
+        for (VkBuffer vkBuffer : defragSourceBuffers)
+            vkDestroyBuffer(device, vkBuffer, VK_NULL_HANDLE);
+        defragSourceBuffers.clear();
+
+        err = vmaEndDefragmentationPass(memoryAllocator, defragContext, &defragPass);
+        defragPass = {};
+
+        if (err == VK_SUCCESS) {
+            _EndDefragmentation();
+            return;
+        }
+
+        defragState = DEFRAG_STATE_RUNNING;
+    }
+
+    if (defragState == DEFRAG_STATE_RUNNING) {
+        err = _BeginDefragmentationPass();
+        if (err != VK_INCOMPLETE)
+            _EndDefragmentation();
+    }
+}
+
+VkResult RenderDriver::_BeginDefragmentationPass()
+{
+    VkResult err;
+
+    /* VK_SUCCESS 表示已经没有可以搬动的分配 */
+    err = vmaBeginDefragmentationPass(memoryAllocator, defragContext, &defragPass);
+    if (err != VK_INCOMPLETE)
+        return err;
+
+    err = vkResetCommandBuffer(defragCommandBuffer, 0);
+    VK_CHECK_ERROR(err);
+
+    VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+    commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    err = vkBeginCommandBuffer(defragCommandBuffer, &commandBufferBeginInfo);
+    VK_CHECK_ERROR(err);
+
+    defragMoveSlots.resize(defragPass.moveCount);
+
+    /* 正在执行的帧可能还在写这些 buffer，拷贝之前先等这些写入完成 */
+    VkMemoryBarrier sourceBarrier = {};
+    sourceBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    sourceBarrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    sourceBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    vkCmdPipelineBarrier(defragCommandBuffer,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 1, &sourceBarrier, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+
+    for (uint32_t i = 0; i < defragPass.moveCount; i++) {
+        VmaDefragmentationMove *move = &defragPass.pMoves[i];
+
+        VmaAllocationInfo allocationInfo = {};
+        vmaGetAllocationInfo(memoryAllocator, move->srcAllocation, &allocationInfo);
+
+        uint32_t handle = (uint32_t) (uintptr_t) allocationInfo.pUserData;
+        uint32_t slot = HandlePool::IndexOf(handle);
+        defragMoveSlots[i] = slot;
+
+        /* shader 里可能缓存了 device address，这类 buffer 不搬 */
+        if (!buffers.handles.IsValid(handle) || (buffers.usages[slot] & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)) {
+            move->operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+            continue;
+        }
+
+        VkBufferCreateInfo bufferCreateInfo = {};
+        bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferCreateInfo.size = buffers.sizes[slot];
+        bufferCreateInfo.usage = buffers.usages[slot] | BUFFER_IMPLICIT_USAGE;
+        bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VkBuffer newBuffer = VK_NULL_HANDLE;
+        err = vkCreateBuffer(device, &bufferCreateInfo, VK_NULL_HANDLE, &newBuffer);
+
+        if (err == VK_SUCCESS)
+            err = vmaBindBufferMemory(memoryAllocator, move->dstTmpAllocation, newBuffer);
+
+        if (err != VK_SUCCESS) {
+            vkDestroyBuffer(device, newBuffer, VK_NULL_HANDLE);
+            move->operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+            continue;
+        }
+
+        VkBufferCopy region = { 0, 0, buffers.sizes[slot] };
+        vkCmdCopyBuffer(defragCommandBuffer, buffers.vkBuffers[slot], newBuffer, 1, &region);
+
+        /* 旧 VkBuffer 还是这次拷贝的源，等 defragFence 之后再销毁，内存由 VMA 在 pass 结束时回收 */
+        defragSourceBuffers.push_back(buffers.vkBuffers[slot]);
+
+        /* 句柄不变，之后录制的命令直接用新的 VkBuffer */
+        buffers.vkBuffers[slot] = newBuffer;
+        buffers.moving[slot] = 1;
+
+        defragStats.allocationsMoved++;
+        defragStats.bytesMoved += buffers.sizes[slot];
+    }
+
+    /* 同一个队列上后续提交的命令都能看到搬动后的数据 */
+    VkMemoryBarrier memoryBarrier = {};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+    vkCmdPipelineBarrier(defragCommandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        0, 1, &memoryBarrier, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+
+    err = vkEndCommandBuffer(defragCommandBuffer);
+
+    if (err == VK_SUCCESS)
+        err = vkResetFences(device, 1, &defragFence);
+
+    if (err == VK_SUCCESS) {
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &defragCommandBuffer;
+
+        err = vkQueueSubmit(queue, 1, &submitInfo, defragFence);
+    }
+
+    /* 提交失败时新 buffer 里没有数据，只能等设备空闲后放弃整次整理 */
+    if (err != VK_SUCCESS) {
+        vkDeviceWaitIdle(device);
+        return err;
+    }
+
+    /* 拷贝之后提交的第一帧执行完，之前引用旧 buffer 的帧一定也执行完了 */
+    defragPassFrame = frameNumber;
+    defragState = DEFRAG_STATE_PASS_IN_FLIGHT;
+
+    return VK_INCOMPLETE;
+}
+
+void RenderDriver::_EndDefragmentation()
+{
+    if (defragState == DEFRAG_STATE_IDLE)
+        return;
+
+    if (defragState == DEFRAG_STATE_PASS_IN_FLIGHT) {
+        vkWaitForFences(device, 1, &defragFence, VK_TRUE, UINT64_MAX);
+        vmaEndDefragmentationPass(memoryAllocator, defragContext, &defragPass);
+    }
+
+    /* 拷贝已经完成，剩下的只是还在执行的帧对旧 buffer 的引用 */
+    for (VkBuffer vkBuffer : defragSourceBuffers) {
+        RetiredObject retired = {};
+        retired.type = RETIRED_OBJECT_BUFFER;
+        retired.frameNumber = frameNumber;
+        retired.buffer.vkBuffer = vkBuffer;
+        retired.buffer.allocation = VK_NULL_HANDLE;
+        retiredObjects.push_back(retired);
+    }
+    defragSourceBuffers.clear();
+
+    for (uint32_t slot : defragMoveSlots)
+        buffers.moving[slot] = 0;
+    defragMoveSlots.clear();
+    defragPass = {};
+
+    /* VMA 统计的 bytesFreed 是真正还给驱动的 device memory */
+    VmaDefragmentationStats stats = {};
+    vmaEndDefragmentation(memoryAllocator, defragContext, &stats);
+    defragContext = VK_NULL_HANDLE;
+
+    defragStats.bytesFreed = stats.bytesFreed;
+    defragStats.deviceMemoryBlocksFreed = stats.deviceMemoryBlocksFreed;
+    defragState = DEFRAG_STATE_IDLE;
+
+    printf("[vulkan] defragmentation finished, moved %u allocations (%llu bytes), freed %u blocks (%llu bytes)\n",
+        defragStats.allocationsMoved, (unsigned long long) defragStats.bytesMoved,
+        defragStats.deviceMemoryBlocksFreed, (unsigned long long) defragStats.bytesFreed);
+}
+
+VkResult RenderDriver::_ImmediateSubmit(const std::function<void(VkCommandBuffer)>& record)
+{
+    VkResult err;
+
+    /* 一次性的 command buffer，提交后同步等待，只用于资源上传这类低频操作 */
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
+    commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferAllocateInfo.commandPool = commandPool;
+    commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferAllocateInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    err = vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &commandBuffer);
+    VK_CHECK_ERROR(err);
+
+    VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+    commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VkFenceCreateInfo fenceCreateInfo = {};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    VkFence fence = VK_NULL_HANDLE;
+
+    err = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+
+    if (err == VK_SUCCESS) {
+        record(commandBuffer);
+        err = vkEndCommandBuffer(commandBuffer);
+    }
 
-    const std::vector<const char*> extensions = {
-        VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-        VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
-        VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,
-        VK_KHR_MAINTENANCE3_EXTENSION_NAME
-    };
+    if (err == VK_SUCCESS)
+        err = vkCreateFence(device, &fenceCreateInfo, VK_NULL_HANDLE, &fence);
 
-    /* dynamic rendering */
-    VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeature = {};
-    dynamicRenderingFeature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
-    dynamicRenderingFeature.dynamicRendering = VK_TRUE;
+    if (err == VK_SUCCESS) {
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
 
-    VkDeviceCreateInfo deviceCreateInfo = {};
-    deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    deviceCreateInfo.pNext = &dynamicRenderingFeature;
-    deviceCreateInfo.queueCreateInfoCount = 1;
-    deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
-    deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(std::size(extensions));
-    deviceCreateInfo.ppEnabledExtensionNames = std::data(extensions);
+        err = vkQueueSubmit(queue, 1, &submitInfo, fence);
+    }
 
-    err = vkCreateDevice(physicalDevice, &deviceCreateInfo, VK_NULL_HANDLE, &device);
-    VK_CHECK_ERROR(err);
+    if (err == VK_SUCCESS)
+        err = vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
 
-    vkGetDeviceQueue(device, queueFamilyIndex, 0, &queue);
+    vkDestroyFence(device, fence, VK_NULL_HANDLE);
+    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
 
-TAG_DEVICE_Create_END:
     return err;
 }
 
-VkResult RenderDriver::_CreateMemoryAllocator()
+uint32_t RenderDriver::_GetBufferSlot(Buffer buffer) const
 {
-    VkResult err;
+    /* 已经销毁的句柄 generation 对不上 */
+    if (!buffers.handles.IsValid(buffer.id)) {
+        printf("[vulkan] invalid buffer handle 0x%08x\n", buffer.id);
+        assert(!"invalid buffer handle");
+    }
 
-    VmaVulkanFunctions vulkanFunctions = {};
-    vulkanFunctions.vkGetInstanceProcAddr = vkGetInstanceProcAddr;
-    vulkanFunctions.vkGetDeviceProcAddr = vkGetDeviceProcAddr;
+    return HandlePool::IndexOf(buffer.id);
+}
 
-    VmaAllocatorCreateInfo allocatorCreateInfo = {};
-    allocatorCreateInfo.instance = instance;
-    allocatorCreateInfo.physicalDevice = physicalDevice;
-    allocatorCreateInfo.device = device;
-    allocatorCreateInfo.pVulkanFunctions = &vulkanFunctions;
+Pipeline_T& RenderDriver::_GetPipelineSlot(Pipeline pipeline)
+{
+    if (!pipelineHandles.IsValid(pipeline.id)) {
+        printf("[vulkan] invalid pipeline handle 0x%08x\n", pipeline.id);
+        assert(!"invalid pipeline handle");
+    }
 
-    err = vmaCreateAllocator(&allocatorCreateInfo, &memoryAllocator);
-    VK_CHECK_ERROR(err);
+    return pipelineSlots[HandlePool::IndexOf(pipeline.id)];
+}
 
-    return err;
+void RenderDriver::_DestroyPipelineObjects(VkPipeline vkPipeline, const VkShaderEXT *pShaders)
+{
+    if (vkPipeline != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, vkPipeline, VK_NULL_HANDLE);
+
+    for (uint32_t i = 0; i < SHADER_OBJECT_STAGE_COUNT; i++) {
+        if (pShaders[i] != VK_NULL_HANDLE)
+            vkDestroyShaderEXT(device, pShaders[i], VK_NULL_HANDLE);
+    }
 }
 
-VkResult RenderDriver::_CreateSwapchain(VkSwapchainKHR oldSwapchain)
+void RenderDriver::_SetShaderObjectState(VkCommandBuffer commandBuffer, const PipelineDesc& desc)
 {
-    VkResult err;
+    /*
+     * 没有 pipeline 烘焙状态，绘制前所有用到的状态都必须动态设置。
+     * 材质相关的状态交给 dynamicStateCache，这里设置固定不变的部分，每个 command buffer 一次；
+     * 顶点输入和颜色写掩码只在变化时重新设置。
+     */
+    if (shaderObjectStateDirty) {
+        shaderObjectStateDirty = false;
+        shaderObjectVertexLayout = VERTEX_LAYOUT_COUNT;
+        shaderObjectColorWriteMask = VK_COLOR_COMPONENT_FLAG_BITS_MAX_ENUM;
+        _SetShaderObjectFixedState(commandBuffer);
+    }
 
-    VkSurfaceCapabilitiesKHR surfaceCapabilities = {};
-    err = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCapabilities);
-    VK_CHECK_ERROR(err);
+    /* 深度预渲染没有 fragment shader，颜色附件的值未定义，必须关掉写入 */
+    VkColorComponentFlags colorWriteMask = desc.depthOnly ? 0 :
+        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+        VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
 
-    imageCount = surfaceCapabilities.minImageCount + 1;
-    if (imageCount > surfaceCapabilities.maxImageCount)
-        imageCount = surfaceCapabilities.maxImageCount;
+    if (shaderObjectColorWriteMask != colorWriteMask) {
+        shaderObjectColorWriteMask = colorWriteMask;
+        vkCmdSetColorWriteMaskEXT(commandBuffer, 0, 1, &colorWriteMask);
+    }
 
-    uint32_t formatCount = 0;
-    err = vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &formatCount, VK_NULL_HANDLE);
-    VK_CHECK_ERROR(err);
+    const VertexLayout vertexLayout = desc.vertexLayout;
+    if (shaderObjectVertexLayout == vertexLayout)
+        return;
 
-    std::vector<VkSurfaceFormatKHR> surfaceFormats(formatCount);
-    err = vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &formatCount, std::data(surfaceFormats));
-    VK_CHECK_ERROR(err);
+    shaderObjectVertexLayout = vertexLayout;
 
-    surfaceFormat = VkUtils::ChooseSwapSurfaceFormat(surfaceFormats);
+    const VertexInputLayout& layout = vertexInputLayouts[vertexLayout];
 
-    VkSwapchainCreateInfoKHR swapchainCreateInfo = {};
-    swapchainCreateInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-    swapchainCreateInfo.surface = surface;
-    swapchainCreateInfo.minImageCount = imageCount;
-    swapchainCreateInfo.imageFormat = surfaceFormat.format;
-    swapchainCreateInfo.imageColorSpace = surfaceFormat.colorSpace;
-    swapchainCreateInfo.imageExtent = surfaceCapabilities.currentExtent;
-    swapchainCreateInfo.imageArrayLayers = 1;
-    swapchainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-    swapchainCreateInfo.preTransform = surfaceCapabilities.currentTransform;
-    swapchainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-    swapchainCreateInfo.presentMode = VK_PRESENT_MODE_FIFO_KHR;
-    swapchainCreateInfo.clipped = VK_TRUE;
-    swapchainCreateInfo.oldSwapchain = oldSwapchain;
+    VkVertexInputBindingDescription2EXT vertexBindings[MAX_VERTEX_INPUT_BINDINGS] = {};
+    for (uint32_t i = 0; i < layout.bindingCount; i++) {
+        vertexBindings[i].sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_BINDING_DESCRIPTION_2_EXT;
+        vertexBindings[i].binding = layout.pBindings[i].binding;
+        vertexBindings[i].stride = layout.pBindings[i].stride;
+        vertexBindings[i].inputRate = layout.pBindings[i].inputRate;
+        vertexBindings[i].divisor = 1;
+    }
 
-    VkSwapchainKHR tmpSwapchain = VK_NULL_HANDLE;
-    err = vkCreateSwapchainKHR(device, &swapchainCreateInfo, VK_NULL_HANDLE, &tmpSwapchain);
-    VK_CHECK_ERROR(err);
+    VkVertexInputAttributeDescription2EXT vertexAttributes[MAX_VERTEX_INPUT_ATTRIBUTES] = {};
+    for (uint32_t i = 0; i < layout.attributeCount; i++) {
+        vertexAttributes[i].sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_ATTRIBUTE_DESCRIPTION_2_EXT;
+        vertexAttributes[i].location = layout.pAttributes[i].location;
+        vertexAttributes[i].binding = layout.pAttributes[i].binding;
+        vertexAttributes[i].format = layout.pAttributes[i].format;
+        vertexAttributes[i].offset = layout.pAttributes[i].offset;
+    }
 
-    if (oldSwapchain != VK_NULL_HANDLE)
-        _DestroySwapchain();
+    vkCmdSetVertexInputEXT(commandBuffer, layout.bindingCount, vertexBindings, layout.attributeCount, vertexAttributes);
+}
 
-    swapchain = tmpSwapchain;
+void RenderDriver::_SetShaderObjectFixedState(VkCommandBuffer commandBuffer)
+{
+    vkCmdSetPrimitiveRestartEnable(commandBuffer, VK_FALSE);
+
+    /* rasterization */
+    vkCmdSetPolygonModeEXT(commandBuffer, VK_POLYGON_MODE_FILL);
+    vkCmdSetDepthBiasEnable(commandBuffer, VK_FALSE);
+
+    /* multisample */
+    VkSampleMask sampleMask = 0xFFFFFFFF;
+    vkCmdSetRasterizationSamplesEXT(commandBuffer, VK_SAMPLE_COUNT_1_BIT);
+    vkCmdSetSampleMaskEXT(commandBuffer, VK_SAMPLE_COUNT_1_BIT, &sampleMask);
+    vkCmdSetAlphaToCoverageEnableEXT(commandBuffer, VK_FALSE);
+
+    /* stencil */
+    vkCmdSetStencilTestEnable(commandBuffer, VK_FALSE);
+
+    /* color blend，写掩码随 pipeline 变化，在 _SetShaderObjectState 里设置 */
+    VkColorBlendEquationEXT colorBlendEquation = {};
+    colorBlendEquation.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    colorBlendEquation.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendEquation.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendEquation.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendEquation.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    colorBlendEquation.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    vkCmdSetColorBlendEquationEXT(commandBuffer, 0, 1, &colorBlendEquation);
+}
 
-    /* Create swapchain resources */
-    err = vkGetSwapchainImagesKHR(device, swapchain, &imageCount, nullptr);
-    VK_CHECK_ERROR(err);
+void RenderDriver::_RecordPipelineUsage(const PipelineDesc& desc)
+{
+    std::lock_guard<std::mutex> lock(warmupMutex);
+
+    PipelineUsage& usage = pipelineUsages[_GetPipelineKey(desc, false, false)];
+    if (usage.useCount == 0) {
+        snprintf(usage.shaderName, sizeof(usage.shaderName), "%s", desc.shaderName);
+        usage.renderState = desc.renderState;
+        usage.vertexLayout = desc.vertexLayout;
+        usage.depthOnly = desc.depthOnly;
+        usage.firstFrame = frameNumber;
+    }
 
-    swapchainImages.resize(imageCount);
-    swapchainImageViews.resize(imageCount);
+    usage.useCount++;
+}
 
-    err = vkGetSwapchainImagesKHR(device, swapchain, &imageCount, std::data(swapchainImages));
+bool RenderDriver::_TakeWarmPipeline(const PipelineDesc& desc, VkPipeline *pPipeline, VkShaderEXT *pShaders, bool *pOptimized)
+{
+    std::lock_guard<std::mutex> lock(warmupMutex);
+
+    auto it = warmPipelines.find(_GetPipelineKey(desc, false, false));
+    if (it == warmPipelines.end())
+        return false;
+
+    *pPipeline = it->second.vkPipeline;
+    memcpy(pShaders, it->second.shaders, sizeof(it->second.shaders));
+    *pOptimized = it->second.optimized;
+
+    warmPipelines.erase(it);
+    warmupStats.warmHits++;
+
+    return true;
+}
+
+void RenderDriver::_DestroyWarmPipelines(const char *shaderName)
+{
+    /* shaderName 为空时全部销毁 */
+    std::lock_guard<std::mutex> lock(warmupMutex);
+
+    std::erase_if(warmPipelines, [this, shaderName](const auto& entry) {
+        if (shaderName != VK_NULL_HANDLE && strcmp(entry.second.shaderName, shaderName) != 0)
+            return false;
+        _DestroyPipelineObjects(entry.second.vkPipeline, entry.second.shaders);
+        return true;
+    });
+}
+
+void RenderDriver::_DestroySwapchain()
+{
+    for (uint32_t i = 0; i < std::size(swapchainImageViews); i++) {
+        vkDestroyImageView(device, swapchainImageViews[i], VK_NULL_HANDLE);
+        vkDestroySemaphore(device, renderFinishedSemaphores[i], VK_NULL_HANDLE);
+    }
+    swapchainImages.clear();
+    swapchainImageViews.clear();
+    renderFinishedSemaphores.clear();
+    vkDestroySwapchainKHR(device, swapchain, VK_NULL_HANDLE);
+}
+
+VkResult RenderDriver::_CreateTransientPools()
+{
+    VkResult err;
+
+    VkBufferCreateInfo bufferCreateInfo = {};
+    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferCreateInfo.size = TRANSIENT_PAGE_SIZE;
+    bufferCreateInfo.usage = TRANSIENT_BUFFER_USAGE;
+    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VmaAllocationCreateInfo allocationCreateInfo = {};
+    allocationCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+    allocationCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    allocationCreateInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;     // 写完直接用，不做 flush
+
+    err = vmaFindMemoryTypeIndexForBufferInfo(memoryAllocator, &bufferCreateInfo, &allocationCreateInfo, &transientMemoryTypeIndex);
     VK_CHECK_ERROR(err);
 
-    for (uint32_t i = 0; i < imageCount; i++) {
-        VkImage swapchainImage = swapchainImages[i];
+    /* 同一段临时内存可能被当作 uniform 或 storage buffer 绑定 */
+    const VkPhysicalDeviceLimits& limits = physicalDeviceProperties.limits;
+    transientAlignment = std::max(limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment);
 
-        VkImageViewCreateInfo imageViewCreateInfo = {};
-        imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-        imageViewCreateInfo.image = swapchainImage;
-        imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        imageViewCreateInfo.format = surfaceFormat.format;
-        imageViewCreateInfo.components = {
-            VK_COMPONENT_SWIZZLE_IDENTITY,
-            VK_COMPONENT_SWIZZLE_IDENTITY,
-            VK_COMPONENT_SWIZZLE_IDENTITY,
-            VK_COMPONENT_SWIZZLE_IDENTITY
-        };
-        imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
-        imageViewCreateInfo.subresourceRange.levelCount = 1;
-        imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
-        imageViewCreateInfo.subresourceRange.layerCount = 1;
-        imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    /* 线性算法：页面只在帧末整体释放，分配和释放都不需要查找空闲链表 */
+    VmaPoolCreateInfo poolCreateInfo = {};
+    poolCreateInfo.memoryTypeIndex = transientMemoryTypeIndex;
+    poolCreateInfo.flags = VMA_POOL_CREATE_LINEAR_ALGORITHM_BIT;
+    poolCreateInfo.blockSize = TRANSIENT_POOL_BLOCK_SIZE;
 
-        err = vkCreateImageView(device, &imageViewCreateInfo, VK_NULL_HANDLE, &swapchainImageViews[i]);
+    for (FrameContext &frame : frames) {
+        err = vmaCreatePool(memoryAllocator, &poolCreateInfo, &frame.transientPool);
         VK_CHECK_ERROR(err);
+
+        vmaSetPoolName(memoryAllocator, frame.transientPool, "driver/transient");
     }
 
     return err;
 }
 
-VkResult RenderDriver::_CreateCommandPool()
+VkResult RenderDriver::_CreateUploadStaging()
 {
     VkResult err;
 
-    VkCommandPoolCreateInfo commandPoolCreateInfo = {};
-    commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT
-                                  | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
-    commandPoolCreateInfo.queueFamilyIndex = queueFamilyIndex;
+    VkBufferCreateInfo bufferCreateInfo = {};
+    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferCreateInfo.size = TRANSIENT_PAGE_SIZE;
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    err = vkCreateCommandPool(device, &commandPoolCreateInfo, VK_NULL_HANDLE, &commandPool);
+    VmaAllocationCreateInfo allocationCreateInfo = {};
+    allocationCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+    allocationCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    allocationCreateInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;     // 写完直接拷贝，不做 flush
+
+    VmaAllocationInfo allocationInfo = {};
+    err = vmaCreateBuffer(memoryAllocator, &bufferCreateInfo, &allocationCreateInfo,
+        &uploadStaging.vkBuffer, &uploadStaging.allocation, &allocationInfo);
     VK_CHECK_ERROR(err);
 
+    uploadStaging.size = TRANSIENT_PAGE_SIZE;
+    uploadStaging.pMapped = static_cast<uint8_t *>(allocationInfo.pMappedData);
+    vmaSetAllocationName(memoryAllocator, uploadStaging.allocation, "driver/upload staging");
+
     return err;
 }
 
-VkResult RenderDriver::_CreateShaderModule(const char* shaderName, const char* stage, VkShaderModule* pShaderModule)
+void RenderDriver::_DestroyTransientPools()
+{
+    for (FrameContext &frame : frames) {
+        for (const TransientPage& page : frame.transientPages)
+            vmaDestroyBuffer(memoryAllocator, page.vkBuffer, page.allocation);
+        frame.transientPages.clear();
+
+        if (frame.transientPool != VK_NULL_HANDLE)
+            vmaDestroyPool(memoryAllocator, frame.transientPool);
+        frame.transientPool = VK_NULL_HANDLE;
+    }
+
+    if (uploadStaging.vkBuffer != VK_NULL_HANDLE)
+        vmaDestroyBuffer(memoryAllocator, uploadStaging.vkBuffer, uploadStaging.allocation);
+    uploadStaging = {};
+}
+
+VkResult RenderDriver::_AllocateTransientPage(uint32_t frameIndex, VkDeviceSize size)
 {
-    size_t size;
     VkResult err;
 
-    char path[PATH_MAX];
-    snprintf(path, sizeof(path), "%s.%s.spv", shaderName, stage);
+    FrameContext *frame = &frames[frameIndex];
 
-    char *buf = io_read_bytecode(path, &size);
+    VkBufferCreateInfo bufferCreateInfo = {};
+    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferCreateInfo.size = size;
+    bufferCreateInfo.usage = TRANSIENT_BUFFER_USAGE;
+    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    printf("[vulkan] load shader module %s, code size=%ld\n", path, size);
+    VmaAllocationCreateInfo allocationCreateInfo = {};
+    allocationCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    allocationCreateInfo.pool = frame->transientPool;
 
-    VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
-    shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    shaderModuleCreateInfo.codeSize = size;
-    shaderModuleCreateInfo.pCode = reinterpret_cast<uint32_t*>(buf);
+    TransientPage page = {};
+    page.size = size;
 
-    err = vkCreateShaderModule(device, &shaderModuleCreateInfo, VK_NULL_HANDLE, pShaderModule);
-    io_free_buf(buf);
+    VmaAllocationInfo allocationInfo = {};
+    err = vmaCreateBuffer(memoryAllocator, &bufferCreateInfo, &allocationCreateInfo, &page.vkBuffer, &page.allocation, &allocationInfo);
     VK_CHECK_ERROR(err);
 
+    page.pMapped = static_cast<uint8_t *>(allocationInfo.pMappedData);
+    vmaSetAllocationName(memoryAllocator, page.allocation, "driver/transient page");
+
+    VkBufferDeviceAddressInfo addressInfo = {};
+    addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+    addressInfo.buffer = page.vkBuffer;
+    page.address = vkGetBufferDeviceAddress(device, &addressInfo);
+
+    frame->transientPages.push_back(page);
+    frame->transientPageIndex = static_cast<uint32_t>(std::size(frame->transientPages) - 1);
+
     return err;
 }
 
+void RenderDriver::_ResetTransientPages(uint32_t frameIndex)
+{
+    FrameContext *frame = &frames[frameIndex];
 
-void RenderDriver::_DestroySwapchain()
+    /* 在 BeginFrame 之前分配时，上一次使用这组页面的帧可能还没执行完 */
+    if (frame->submittedFrameNumber > completedFrameNumber) {
+        vkWaitForFences(device, 1, &frame->fence, VK_TRUE, UINT64_MAX);
+        completedFrameNumber = frame->submittedFrameNumber;
+    }
+
+    /* 上一帧用到的普通页面留着复用，多出来的和超大的页面从后往前还给线性池 */
+    uint32_t usedPageCount = std::min(frame->transientPageIndex + 1, static_cast<uint32_t>(std::size(frame->transientPages)));
+
+    for (uint32_t i = static_cast<uint32_t>(std::size(frame->transientPages)); i-- > 0;) {
+        TransientPage& page = frame->transientPages[i];
+
+        if (i < usedPageCount && page.size == TRANSIENT_PAGE_SIZE) {
+            page.offset = 0;
+            continue;
+        }
+
+        vmaDestroyBuffer(memoryAllocator, page.vkBuffer, page.allocation);
+        frame->transientPages.erase(frame->transientPages.begin() + i);
+    }
+
+    frame->transientPageIndex = 0;
+    frame->transientFrameNumber = frameNumber;
+}
+
+void RenderDriver::_DestroyFrameResources()
 {
-    for (uint32_t i = 0; i < imageCount; i++)
-        vkDestroyImageView(device, swapchainImageViews[i], VK_NULL_HANDLE);
+    for (FrameContext &frame : frames) {
+        vkDestroyFence(device, frame.fence, VK_NULL_HANDLE);
+        vkDestroySemaphore(device, frame.imageAvailableSemaphore, VK_NULL_HANDLE);
+        frame = {};
+    }
+}
+
+void RenderDriver::_OnShaderChanged(const char *shaderName)
+{
+    /* 运行在 watcher 线程，锁内只拷贝需要重建的 pipeline 描述，编译时不持有 pipelineMutex，避免卡住主线程 */
+    struct ReloadTarget {
+        uint64_t key;
+        PipelineDesc desc;
+        uint64_t revision;
+        bool compute;
+        bool mesh;
+    };
+
+    std::vector<ReloadTarget> targets;
+
+    {
+        std::lock_guard<std::mutex> lock(pipelineMutex);
+
+        /* 预编译的结果来自旧的 shader，直接丢掉 */
+        _DestroyWarmPipelines(shaderName);
+
+        if (graphicsPipelineLibraryEnabled) {
+            /* 用到该 shader 的 library 作废，等后台编译任务都结束后再销毁 */
+            std::lock_guard<std::mutex> libraryLock(libraryMutex);
+            libraryGeneration++;
+            std::erase_if(pipelineLibraries, [this, shaderName](const auto &entry) {
+                if (strcmp(entry.second.shaderName, shaderName) != 0)
+                    return false;
+                staleLibraries.push_back(entry.second.vkPipeline);
+                return true;
+            });
+        }
+
+        /* 共用一份编译结果的句柄只重建一次 */
+        for (const auto& entry : sharedPipelines) {
+            const SharedPipeline& shared = entry.second;
+            if (strcmp(shared.shaderName, shaderName) != 0)
+                continue;
+
+            /* desc 里的名字指向 sharedPipelines，解锁后可能失效，改用参数里的同名字符串 */
+            ReloadTarget target = {};
+            target.key = entry.first;
+            target.desc = shared.desc;
+            target.desc.shaderName = shaderName;
+            target.revision = shared.revision;
+            target.compute = shared.compute;
+            target.mesh = shared.mesh;
+            targets.push_back(target);
+        }
+    }
+
+    for (const ReloadTarget& target : targets) {
+        PipelineSwap swap = {};
+        swap.key = target.key;
+
+        /* 编辑过程中 .spv 可能被删掉或者只写了一半，失败时保留旧的 pipeline，等下一次修改 */
+        VkResult err = VK_ERROR_INITIALIZATION_FAILED;
+
+        try {
+            if (target.compute)
+                err = _CreateComputePipeline(shaderName, &swap.vkPipeline);
+            else if (target.mesh)
+                err = _CreateMeshPipeline(target.desc, &swap.vkPipeline);
+            else if (shaderObjectEnabled)
+                err = _CreateShaderObjects(target.desc, swap.shaders);
+            else
+                err = _BuildPipeline(target.desc, &swap.vkPipeline);
+        } catch (const std::exception& e) {
+            printf("[shader] %s: %s\n", shaderName, e.what());
+            err = VK_ERROR_INITIALIZATION_FAILED;
+        }
+
+        if (err != VK_SUCCESS) {
+            printf("[shader] rebuild pipeline %s failed, err=%d\n", shaderName, err);
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(pipelineMutex);
+
+        /* 编译期间所有句柄可能都已经销毁，或者又被新的一次修改重建过 */
+        auto it = sharedPipelines.find(target.key);
+        if (it == sharedPipelines.end() || it->second.revision != target.revision) {
+            _DestroyPipelineObjects(swap.vkPipeline, swap.shaders);
+            continue;
+        }
+
+        it->second.revision = ++pipelineRevision;
+        swap.revision = it->second.revision;
+
+        {
+            std::lock_guard<std::mutex> swapLock(pendingSwapMutex);
+            pendingPipelineSwaps.push_back(swap);
+        }
+
+        if (graphicsPipelineLibraryEnabled && !shaderObjectEnabled && !target.compute && !target.mesh)
+            _QueueOptimizedPipeline(target.key);
+    }
+}
+
+void RenderDriver::_ApplyPendingPipelineSwaps()
+{
+    std::lock_guard<std::mutex> lock(pipelineMutex);
+    std::lock_guard<std::mutex> swapLock(pendingSwapMutex);
+
+    for (const PipelineSwap &swap : pendingPipelineSwaps) {
+        /* 所有句柄都已经销毁，或者之后又有更新的结果 */
+        auto it = sharedPipelines.find(swap.key);
+        if (it == sharedPipelines.end() || it->second.revision != swap.revision) {
+            _DestroyPipelineObjects(swap.vkPipeline, swap.shaders);
+            continue;
+        }
+
+        SharedPipeline& shared = it->second;
+
+        /* 当前帧还没开始录制，旧对象最后可能在上一帧被引用 */
+        _RetirePipelineObjects(shared.vkPipeline, shared.shaders, frameNumber - 1);
+
+        shared.vkPipeline = swap.vkPipeline;
+        memcpy(shared.shaders, swap.shaders, sizeof(shared.shaders));
+
+        /* 句柄里缓存了编译结果，绑定时不用查表 */
+        for (uint32_t slot : pipelineHandles.GetLiveSlots()) {
+            Pipeline_T& pipeline = pipelineSlots[slot];
+            if (pipeline.key != swap.key)
+                continue;
+
+            pipeline.vkPipeline = shared.vkPipeline;
+            memcpy(pipeline.shaders, shared.shaders, sizeof(pipeline.shaders));
+        }
+
+        printf("[shader] pipeline %s reloaded\n", shared.shaderName);
+    }
+
+    pendingPipelineSwaps.clear();
+}
+
+void RenderDriver::_RetireSwapchain(uint64_t lastUsedFrame)
+{
+    RetiredObject retired = {};
+    retired.frameNumber = lastUsedFrame;
+
+    for (uint32_t i = 0; i < std::size(swapchainImageViews); i++) {
+        retired.type = RETIRED_OBJECT_IMAGE_VIEW;
+        retired.vkImageView = swapchainImageViews[i];
+        retiredObjects.push_back(retired);
+
+        retired.type = RETIRED_OBJECT_SEMAPHORE;
+        retired.vkSemaphore = renderFinishedSemaphores[i];
+        retiredObjects.push_back(retired);
+    }
+
+    /* image 属于 swapchain，随 swapchain 一起销毁 */
+    retired.type = RETIRED_OBJECT_SWAPCHAIN;
+    retired.vkSwapchain = swapchain;
+    retiredObjects.push_back(retired);
+
     swapchainImages.clear();
     swapchainImageViews.clear();
-    vkDestroySwapchainKHR(device, swapchain, VK_NULL_HANDLE);
+    renderFinishedSemaphores.clear();
+    swapchain = VK_NULL_HANDLE;
+}
+
+void RenderDriver::_RetirePipelineObjects(VkPipeline vkPipeline, const VkShaderEXT *pShaders, uint64_t lastUsedFrame)
+{
+    RetiredObject retired = {};
+    retired.frameNumber = lastUsedFrame;
+
+    if (vkPipeline != VK_NULL_HANDLE) {
+        retired.type = RETIRED_OBJECT_PIPELINE;
+        retired.vkPipeline = vkPipeline;
+        retiredObjects.push_back(retired);
+    }
+
+    for (uint32_t i = 0; i < SHADER_OBJECT_STAGE_COUNT; i++) {
+        if (pShaders[i] == VK_NULL_HANDLE)
+            continue;
+        retired.type = RETIRED_OBJECT_SHADER;
+        retired.vkShader = pShaders[i];
+        retiredObjects.push_back(retired);
+    }
+}
+
+void RenderDriver::_CollectRetiredObjects()
+{
+    /* 对象所在帧的 fence 已经 signal，GPU 不会再访问 */
+    std::erase_if(retiredObjects, [this](const RetiredObject &retired) {
+        if (retired.frameNumber > completedFrameNumber)
+            return false;
+
+        switch (retired.type) {
+            case RETIRED_OBJECT_BUFFER:
+                if (retired.buffer.importedMemory != VK_NULL_HANDLE) {
+                    vkDestroyBuffer(device, retired.buffer.vkBuffer, VK_NULL_HANDLE);
+                    vkFreeMemory(device, retired.buffer.importedMemory, VK_NULL_HANDLE);
+                    break;
+                }
+                vmaDestroyBuffer(memoryAllocator, retired.buffer.vkBuffer, retired.buffer.allocation);
+                break;
+            case RETIRED_OBJECT_FILE_MAPPING:
+                io_unmap_file(retired.fileMapping.pData, retired.fileMapping.size);
+                break;
+            case RETIRED_OBJECT_PIPELINE:
+                vkDestroyPipeline(device, retired.vkPipeline, VK_NULL_HANDLE);
+                break;
+            case RETIRED_OBJECT_SHADER:
+                vkDestroyShaderEXT(device, retired.vkShader, VK_NULL_HANDLE);
+                break;
+            case RETIRED_OBJECT_IMAGE_VIEW:
+                vkDestroyImageView(device, retired.vkImageView, VK_NULL_HANDLE);
+                break;
+            case RETIRED_OBJECT_SEMAPHORE:
+                vkDestroySemaphore(device, retired.vkSemaphore, VK_NULL_HANDLE);
+                break;
+            case RETIRED_OBJECT_SWAPCHAIN:
+                vkDestroySwapchainKHR(device, retired.vkSwapchain, VK_NULL_HANDLE);
+                break;
+            case RETIRED_OBJECT_IMAGE:
+                vmaDestroyImage(memoryAllocator, retired.image.vkImage, retired.image.allocation);
+                break;
+        }
+
+        return true;
+    });
+
+    /* library 不会被 command buffer 引用，只要没有后台链接任务在用就可以销毁 */
+    if (pendingOptimizeJobs == 0 && pendingWarmupJobs == 0) {
+        std::lock_guard<std::mutex> lock(libraryMutex);
+        for (VkPipeline library : staleLibraries)
+            vkDestroyPipeline(device, library, VK_NULL_HANDLE);
+        staleLibraries.clear();
+    }
+}
+
+void RenderDriver::_DestroyPipelineLibraries()
+{
+    std::lock_guard<std::mutex> lock(libraryMutex);
+
+    for (const auto &entry : pipelineLibraries)
+        vkDestroyPipeline(device, entry.second.vkPipeline, VK_NULL_HANDLE);
+    pipelineLibraries.clear();
+
+    for (VkPipeline library : staleLibraries)
+        vkDestroyPipeline(device, library, VK_NULL_HANDLE);
+    staleLibraries.clear();
 }
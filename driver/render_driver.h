@@ -10,12 +10,84 @@
 #include <vma/vk_mem_alloc.h>
 #include <ashlands/typedefs.h>
 
+#include "dynamic_state.h"
+#include "handle_pool.h"
+#include "pipeline_manifest.h"
+#include "shader_watcher.h"
+#include "utils/job_system.h"
+
 // std
 #include <assert.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
-typedef struct Buffer_T *Buffer;
-typedef struct Pipeline_T *Pipeline;
+#define MAX_FRAMES_IN_FLIGHT 2
+#define SHADER_OBJECT_STAGE_COUNT 2
+#define PUSH_CONSTANT_SIZE 128              // Vulkan 保证的最小值
+#define TRANSIENT_PAGE_SIZE (4ull * 1024 * 1024)
+#define DEPTH_FORMAT VK_FORMAT_D32_SFLOAT
+#define DEPTH_CLEAR_VALUE 0.0f              // reverse-Z：近平面为 1，无穷远为 0
+
+struct Pipeline_T;
+
+/* 32 位代际句柄，id 为 0 表示空句柄，销毁后再使用会被 HandlePool 检测出来 */
+typedef struct Buffer {
+    uint32_t id = 0;
+    bool operator==(const Buffer&) const = default;
+} Buffer;
+
+/* 显存超出预算时驱逐可流式加载的 buffer 前调用，回调里丢掉对该句柄的引用即可，buffer 由驱动销毁 */
+typedef std::function<void(Buffer)> BufferEvictCallback;
+
+/* 当前帧临时分配的一段 host 可写内存，帧结束后自动失效，不需要也不能释放 */
+typedef struct TransientBuffer {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void *pMapped = NULL;           // 已经加上 offset
+    VkDeviceAddress address = 0;    // 已经加上 offset
+} TransientBuffer;
+
+/* 单个显存堆的统计，累计计数只包含 RenderDriver 创建的 buffer */
+typedef struct MemoryHeapStats {
+    VkDeviceSize budget = 0;                // 驱动给出的预算
+    VkDeviceSize usage = 0;                 // 整个进程在这个堆上的用量
+    VkDeviceSize blockBytes = 0;            // VMA 向驱动申请的 VkDeviceMemory
+    VkDeviceSize allocationBytes = 0;       // 其中已经分配出去的部分
+    uint32_t blockCount = 0;
+    uint32_t allocationCount = 0;
+    uint64_t totalAllocations = 0;
+    uint64_t totalFrees = 0;
+    VkDeviceSize totalAllocatedBytes = 0;
+    VkDeviceSize totalFreedBytes = 0;
+} MemoryHeapStats;
+
+typedef struct Pipeline {
+    uint32_t id = 0;
+    bool operator==(const Pipeline&) const = default;
+} Pipeline;
+
+/*
+ * 描述一个 pipeline 组合，GPL 路径下按状态拆分成四个 library 分别缓存。
+ * renderState 是绑定 pipeline 时的默认值，动态状态不参与 pipeline 编译，
+ * 只有这些状态不同的 CreatePipeline 共用同一个 VkPipeline。
+ */
+typedef struct PipelineDesc {
+    const char *shaderName = NULL;
+    RenderState renderState = {};
+    VertexLayout vertexLayout = VERTEX_LAYOUT_DEFAULT;
+    bool depthOnly = false;             // 深度预渲染变体：没有片元着色器，不写颜色
+} PipelineDesc;
+
+typedef struct PipelineWarmupStats {
+    uint32_t manifestEntries = 0;   // 清单中记录的 pipeline 数量
+    uint32_t warmedPipelines = 0;   // 后台预编译完成的数量
+    uint32_t warmHits = 0;          // 创建时直接取到预编译结果的次数
+    uint32_t firstUseCompiles = 0;  // 仍然在调用线程上同步编译的次数
+} PipelineWarmupStats;
 
 class RenderDriver
 {
@@ -26,16 +98,97 @@ public:
     VkResult Initialize(VkSurfaceKHR surface);
 
     VkResult CreateBuffer(size_t size, VkBufferUsageFlags usage, Buffer *pBuffer);
+    VkResult CreateStreamableBuffer(size_t size, VkBufferUsageFlags usage, BufferEvictCallback onEvict, Buffer *pBuffer);
     void DestroyBuffer(Buffer buffer);
+    /*
+     * 把 mmap 的文件区域直接导入为 buffer，省掉读文件和写 staging 的两次拷贝。
+     * 只能作为拷贝源，DestroyBuffer 之后内存要等当前帧执行完才释放，在那之前 host 指针必须有效。
+     * 对齐后的导入范围超出 size 所在的页时返回错误，调用方改用 WriteBuffer。
+     */
+    VkResult ImportHostBuffer(const void *pHostPointer, size_t size, Buffer *pBuffer);
+    bool IsHostImportSupported() const { return externalMemoryHostEnabled; }
     VkResult CreatePipeline(const char *shaderName, Pipeline* pPipeline);
+    VkResult CreatePipeline(const PipelineDesc& desc, Pipeline* pPipeline);
+    /* 加载 <shaderName>.comp.spv，和图形 pipeline 共用 layout，同样支持热重载 */
+    VkResult CreateComputePipeline(const char *shaderName, Pipeline* pPipeline);
+    /* 加载 <shaderName>.task/.mesh/.frag.spv，需要 VK_EXT_mesh_shader，不走 GPL 和预编译清单 */
+    VkResult CreateMeshPipeline(const PipelineDesc& desc, Pipeline* pPipeline);
     void DestroyPipeline(Pipeline pipeline);
 
     void RebuildSwapchain();
-    void WriteBuffer(Buffer buffer, size_t offset, void* data, size_t size);
+    void WaitIdle();
+    VkResult WriteBuffer(Buffer buffer, size_t offset, const void* data, size_t size);
+    /* 把整个文件上传到 buffer，支持时映射后直接导入拷贝，映射随导入的内存一起延迟释放 */
+    VkResult WriteBufferFromFile(Buffer buffer, size_t offset, const char *path);
+    VkResult CopyBuffer(Buffer srcBuffer, Buffer dstBuffer, uint32_t regionCount, const VkBufferCopy* pRegions);
+    VkDeviceAddress GetBufferAddress(Buffer buffer) const;
+    /* 名字会出现在 DumpMemoryStats 的输出里，用 "子系统/用途" 的形式方便归类 */
+    void SetBufferName(Buffer buffer, const char *name);
+    /* 通过 device address 访问的 buffer 需要手动标记使用，绑定命令会自动标记 */
+    void TouchBuffer(Buffer buffer);
+    /* 从当前帧的线性池里按 bump pointer 分配，用于 staging、每个 draw 的常量之类的临时数据 */
+    VkResult AllocateTransient(VkDeviceSize size, VkDeviceSize alignment, TransientBuffer *pBuffer);
+
+    VkResult BeginFrame();
+    VkResult EndFrame();
+    void BeginRendering(const VkClearColorValue& clearColor);
+    /* 保留颜色和深度继续绘制，用于遮挡剔除的第二阶段 */
+    void ResumeRendering();
+    void EndRendering();
+
+    void CmdBindPipeline(Pipeline pipeline);
+    void CmdSetRenderState(const RenderState& state);
+    void CmdPushConstants(const void* data, uint32_t size, uint32_t offset = 0);
+    void CmdBindVertexBuffer(Buffer buffer, VkDeviceSize offset);
+    /* 临时内存里的逐实例数据，VERTEX_LAYOUT_INSTANCED 绑定到 binding 1 */
+    void CmdBindVertexBuffer(const TransientBuffer& buffer, uint32_t binding);
+    void CmdBindIndexBuffer(Buffer buffer, VkDeviceSize offset, VkIndexType indexType);
+    void CmdDrawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance);
+    void CmdDrawIndexedIndirect(Buffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride);
+    /* draw 数量从 countBuffer 读取，需要 drawIndirectCount 支持 */
+    void CmdDrawIndexedIndirectCount(Buffer buffer, VkDeviceSize offset, Buffer countBuffer, VkDeviceSize countOffset, uint32_t maxDrawCount, uint32_t stride);
+    /* 需要绑定 CreateMeshPipeline 创建的 pipeline */
+    void CmdDrawMeshTasks(uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ);
+    /* 以下命令只能在 BeginRendering/EndRendering 之外录制 */
+    void CmdDispatch(uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ);
+    void CmdFillBuffer(Buffer buffer, VkDeviceSize offset, VkDeviceSize size, uint32_t data);
+    void CmdCopyBuffer(const TransientBuffer& src, Buffer dst, VkDeviceSize dstOffset);
+    void CmdMemoryBarrier(VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+    /* 按行紧密排列拷贝当前深度，每个像素一个 float */
+    void CmdCopyDepthToBuffer(Buffer dst);
+
+    /* 后台整理显存碎片，每帧最多搬动 DEFRAG_MAX_BYTES_PER_PASS */
+    void StartDefragmentation();
+    bool IsDefragmenting() const { return defragState != DEFRAG_STATE_IDLE; }
+    const VmaDefragmentationStats& GetDefragmentationStats() const { return defragStats; }
+
+    std::vector<MemoryHeapStats> GetMemoryStats() const;
+    /* 把 VMA 的完整分配情况以 JSON 写到文件，可以用 VMA 自带的 GpuMemDumpVis.py 查看 */
+    bool DumpMemoryStats(const char *path) const;
+
+    bool EnableShaderHotReload(const char *shaderDirectory);
+
+    bool WarmupPipelines(const char *manifestPath);
+    bool IsWarmupComplete() const { return pendingWarmupJobs == 0; }
+    bool SavePipelineManifest(const char *manifestPath);
+    PipelineWarmupStats GetPipelineWarmupStats();
 
     VkInstance GetInstance() const { return instance; }
     VkQueue GetGraphicsQueue() const { return queue; }
     VkQueue GetPresentQueue() const { return queue; }
+    VkCommandBuffer GetCommandBuffer() const { return frames[frameNumber % MAX_FRAMES_IN_FLIGHT].commandBuffer; }
+    uint64_t GetFrameNumber() const { return frameNumber; }
+    uint64_t GetCompletedFrameNumber() const { return completedFrameNumber; }
+    const VkPhysicalDeviceProperties& GetPhysicalDeviceProperties() const { return physicalDeviceProperties; }
+    VkExtent2D GetRenderExtent() const { return swapchainExtent; }
+    const DynamicStateCache& GetDynamicStateCache() const { return dynamicStateCache; }
+    uint32_t GetBufferCount() const { return buffers.handles.GetLiveCount(); }
+    uint32_t GetPipelineCount() const { return pipelineHandles.GetLiveCount(); }
+    const std::vector<VmaBudget>& GetHeapBudgets() const { return heapBudgets; }
+    uint32_t GetEvictedBufferCount() const { return evictedBufferCount; }
+    bool IsDrawIndirectCountSupported() const { return drawIndirectCountEnabled; }
+    bool IsDrawIndirectFirstInstanceSupported() const { return drawIndirectFirstInstanceEnabled; }
+    bool IsMeshShaderSupported() const { return meshShaderEnabled; }
 
 private:
     VkResult _CreateInstance();
@@ -43,9 +196,175 @@ private:
     VkResult _CreateMemoryAllocator();
     VkResult _CreateSwapchain(VkSwapchainKHR oldSwapchain);
     VkResult _CreateCommandPool();
+    VkResult _CreateFrameResources();
+    VkResult _CreateTransientPools();
     VkResult _CreateShaderModule(const char* shaderName, const char* stage, VkShaderModule* pShaderModule);
+    VkResult _CreatePipelineLayout();
+    VkResult _CreateGraphicsPipeline(const PipelineDesc& desc, VkGraphicsPipelineLibraryFlagsEXT libraryFlags, VkPipelineCreateFlags flags, VkPipeline *pPipeline);
+    VkResult _GetPipelineLibrary(const PipelineDesc& desc, VkGraphicsPipelineLibraryFlagsEXT libraryFlags, VkPipeline *pLibrary);
+    VkResult _LinkPipeline(const PipelineDesc& desc, bool optimized, VkPipeline *pPipeline);
+    VkResult _BuildPipeline(const PipelineDesc& desc, VkPipeline *pPipeline);
+    VkResult _CreateShaderObjects(const PipelineDesc& desc, VkShaderEXT *pShaders);
+    VkResult _CreateComputePipeline(const char *shaderName, VkPipeline *pPipeline);
+    VkResult _CreateMeshPipeline(const PipelineDesc& desc, VkPipeline *pPipeline);
+    void _DestroyPipelineObjects(VkPipeline vkPipeline, const VkShaderEXT *pShaders);
+    void _SetShaderObjectState(VkCommandBuffer commandBuffer, const PipelineDesc& desc);
+    void _SetShaderObjectFixedState(VkCommandBuffer commandBuffer);
+    void _RecordPipelineUsage(const PipelineDesc& desc);
+    bool _TakeWarmPipeline(const PipelineDesc& desc, VkPipeline *pPipeline, VkShaderEXT *pShaders, bool *pOptimized);
+    void _DestroyWarmPipelines(const char *shaderName);
+    void _QueueOptimizedPipeline(uint64_t key);
+    uint64_t _GetPipelineKey(const PipelineDesc& desc, bool compute, bool mesh) const;
+    bool _AcquireSharedPipeline(uint64_t key, const PipelineDesc& desc, bool compute, bool mesh, Pipeline *pPipeline);
+    void _AddSharedPipeline(uint64_t key, const PipelineDesc& desc, bool compute, bool mesh,
+        VkPipeline vkPipeline, const VkShaderEXT *pShaders, bool queueOptimize, Pipeline *pPipeline);
+    Pipeline _AllocatePipelineHandle(uint64_t key, const PipelineDesc& desc, bool compute, bool mesh);
+    VkResult _CreateBuffer(size_t size, VkBufferUsageFlags usage, VmaAllocationCreateFlags allocationFlags, Buffer *pBuffer);
+    uint32_t _AllocateBufferSlot();
+    void _UpdateMemoryBudget();
+    void _EvictStreamableBuffers();
+    void _UpdateDefragmentation();
+    VkResult _BeginDefragmentationPass();
+    void _EndDefragmentation();
+    VkResult _ImmediateSubmit(const std::function<void(VkCommandBuffer)>& record);
+    uint32_t _GetBufferSlot(Buffer buffer) const;
+    Pipeline_T& _GetPipelineSlot(Pipeline pipeline);
 
     void _DestroySwapchain();
+    VkResult _CreateDepthImage();
+    void _RetireDepthImage(uint64_t lastUsedFrame);
+    void _BeginRendering(const VkClearColorValue *pClearColor);
+    void _RetireSwapchain(uint64_t lastUsedFrame);
+    void _DestroyFrameResources();
+    void _DestroyTransientPools();
+    VkResult _CreateUploadStaging();
+    VkResult _AllocateTransientPage(uint32_t frameIndex, VkDeviceSize size);
+    void _ResetTransientPages(uint32_t frameIndex);
+
+    void _OnShaderChanged(const char *shaderName);
+    void _ApplyPendingPipelineSwaps();
+    void _RetirePipelineObjects(VkPipeline vkPipeline, const VkShaderEXT *pShaders, uint64_t lastUsedFrame);
+    void _CollectRetiredObjects();
+    void _DestroyPipelineLibraries();
+
+    enum DefragmentationState {
+        DEFRAG_STATE_IDLE,
+        DEFRAG_STATE_RUNNING,           // 等待开始下一个 pass
+        DEFRAG_STATE_PASS_IN_FLIGHT,    // 拷贝已提交，等 GPU 用完旧 buffer
+    };
+
+    /* 线性池里的一个 VkBuffer，帧内从头到尾依次切分 */
+    struct TransientPage {
+        VkBuffer vkBuffer;
+        VmaAllocation allocation;
+        VkDeviceSize size;
+        VkDeviceSize offset;
+        uint8_t *pMapped;
+        VkDeviceAddress address;
+    };
+
+    struct FrameContext {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        VkSemaphore imageAvailableSemaphore = VK_NULL_HANDLE;
+        uint64_t submittedFrameNumber = 0;
+
+        // 临时分配，fence 触发后整体重置
+        VmaPool transientPool = VK_NULL_HANDLE;
+        std::vector<TransientPage> transientPages;
+        uint32_t transientPageIndex = 0;
+        uint64_t transientFrameNumber = 0;          // 页面里的数据属于哪一帧
+    };
+
+    /* 非动态状态相同的句柄共用一份编译结果，句柄里只保存各自绑定时的默认状态 */
+    struct SharedPipeline {
+        VkPipeline vkPipeline;
+        VkShaderEXT shaders[SHADER_OBJECT_STAGE_COUNT];
+        PipelineDesc desc;
+        char shaderName[64];
+        uint32_t refCount;
+        uint64_t revision;                          // 热重载后递增，后台结果对不上就丢弃
+        bool compute;
+        bool mesh;
+
+        PipelineDesc GetDesc() const
+        {
+            PipelineDesc ret = desc;
+            ret.shaderName = shaderName;
+            return ret;
+        }
+    };
+
+    struct PipelineSwap {
+        uint64_t key;
+        uint64_t revision;
+        VkPipeline vkPipeline;
+        VkShaderEXT shaders[SHADER_OBJECT_STAGE_COUNT];
+    };
+
+    enum RetiredObjectType {
+        RETIRED_OBJECT_BUFFER,
+        RETIRED_OBJECT_PIPELINE,
+        RETIRED_OBJECT_SHADER,
+        RETIRED_OBJECT_IMAGE_VIEW,
+        RETIRED_OBJECT_SEMAPHORE,
+        RETIRED_OBJECT_SWAPCHAIN,
+        RETIRED_OBJECT_IMAGE,
+        RETIRED_OBJECT_FILE_MAPPING,
+    };
+
+    /* 等待销毁的对象，frameNumber 是最后一个可能引用它的帧 */
+    struct RetiredObject {
+        RetiredObjectType type;
+        uint64_t frameNumber;
+        union {
+            struct {
+                VkBuffer vkBuffer;
+                VmaAllocation allocation;
+                VkDeviceMemory importedMemory;              // 导入的 host 内存，不经过 VMA
+            } buffer;
+            VkPipeline vkPipeline;
+            VkShaderEXT vkShader;
+            VkImageView vkImageView;
+            VkSemaphore vkSemaphore;
+            VkSwapchainKHR vkSwapchain;
+            struct {
+                VkImage vkImage;
+                VmaAllocation allocation;
+            } image;
+            struct {
+                void *pData;
+                size_t size;
+            } fileMapping;
+        };
+    };
+
+    struct PipelineLibrary {
+        VkPipeline vkPipeline;
+        char shaderName[64];
+    };
+
+    /* buffer 数据按字段分开存放，slot 下标来自句柄 */
+    struct BufferPool {
+        HandlePool handles;
+        std::vector<VkBuffer> vkBuffers;
+        std::vector<VmaAllocation> allocations;
+        std::vector<VkDeviceSize> sizes;
+        std::vector<VkBufferUsageFlags> usages;
+        std::vector<VkDeviceAddress> addresses;
+        std::vector<uint32_t> heapIndices;
+        std::vector<uint64_t> lastUsedFrames;
+        std::vector<BufferEvictCallback> evictCallbacks;      // 为空表示常驻，不参与驱逐
+        std::vector<uint8_t> moving;                          // 正在被碎片整理搬动
+        std::vector<VkDeviceMemory> importedMemories;         // 导入的 host 内存，不经过 VMA
+    };
+
+    struct WarmPipeline {
+        VkPipeline vkPipeline;
+        VkShaderEXT shaders[SHADER_OBJECT_STAGE_COUNT];
+        bool optimized;
+        char shaderName[64];
+    };
 
     // Vulkan handles
     VkInstance instance = VK_NULL_HANDLE;
@@ -56,14 +375,101 @@ private:
     VmaAllocator memoryAllocator = VK_NULL_HANDLE;
     VkSwapchainKHR swapchain = VK_NULL_HANDLE;
     VkCommandPool commandPool = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
 
     // Vulkan swapchain resources
     uint32_t imageCount = 0;
     std::vector<VkImage> swapchainImages;
     std::vector<VkImageView> swapchainImageViews;
+    std::vector<VkSemaphore> renderFinishedSemaphores;
+
+    // 深度缓冲，尺寸跟随 swapchain
+    VkImage depthImage = VK_NULL_HANDLE;
+    VmaAllocation depthAllocation = VK_NULL_HANDLE;
+    VkImageView depthImageView = VK_NULL_HANDLE;
+
+    // Frame resources
+    FrameContext frames[MAX_FRAMES_IN_FLIGHT];
+    uint64_t frameNumber = 1;
+    uint64_t completedFrameNumber = 0;
+    uint32_t imageIndex = 0;
+
+    // Resource pools，buffer 只在主线程访问，pipeline slot 由 pipelineMutex 保护
+    BufferPool buffers;
+    HandlePool pipelineHandles;
+    std::vector<Pipeline_T> pipelineSlots;
+    std::unordered_map<uint64_t, SharedPipeline> sharedPipelines;     // 按 _GetPipelineKey 共享，同样由 pipelineMutex 保护
+
+    // Deferred destruction，只在主线程访问
+    std::vector<RetiredObject> retiredObjects;
+
+    // VK_EXT_memory_budget
+    bool memoryBudgetEnabled = false;
+    bool externalMemoryHostEnabled = false;
+    VkDeviceSize minImportedHostPointerAlignment = 0;
+    std::vector<VmaBudget> heapBudgets;
+    uint32_t evictedBufferCount = 0;
+    std::vector<MemoryHeapStats> heapCounters;                // 只用累计计数的字段
+    uint32_t transientMemoryTypeIndex = 0;
+    VkDeviceSize transientAlignment = 1;
+    TransientPage uploadStaging = {};                         // WriteBuffer 专用，不占用帧的临时页面
+
+    // VMA defragmentation
+    DefragmentationState defragState = DEFRAG_STATE_IDLE;
+    VmaDefragmentationContext defragContext = VK_NULL_HANDLE;
+    VmaDefragmentationPassMoveInfo defragPass = {};
+    std::vector<uint32_t> defragMoveSlots;                    // 每个 move 对应的 buffer slot
+    std::vector<VkBuffer> defragSourceBuffers;                // 搬走之后的旧 VkBuffer，拷贝完成前不能销毁
+    uint64_t defragPassFrame = 0;
+    VkCommandBuffer defragCommandBuffer = VK_NULL_HANDLE;
+    VkFence defragFence = VK_NULL_HANDLE;
+    VmaDefragmentationStats defragStats = {};
+
+    // Shader hot reload
+    ShaderWatcher shaderWatcher;
+    std::mutex pipelineMutex;
+    std::mutex pendingSwapMutex;
+    uint64_t pipelineRevision = 0;
+    std::vector<PipelineSwap> pendingPipelineSwaps;
+
+    // VK_EXT_graphics_pipeline_library
+    bool graphicsPipelineLibraryEnabled = false;
+    std::mutex libraryMutex;
+    std::unordered_map<uint64_t, PipelineLibrary> pipelineLibraries;
+    std::vector<VkPipeline> staleLibraries;
+    uint64_t libraryGeneration = 0;                           // 热重载作废 library 时递增，编译中途作废的结果不进缓存
+    std::atomic<uint32_t> pendingOptimizeJobs = 0;
+    JobSystem jobSystem { 2 };
+
+    // VK_EXT_shader_object
+    bool shaderObjectEnabled = false;
+    bool shaderObjectStateDirty = true;
+    VertexLayout shaderObjectVertexLayout = VERTEX_LAYOUT_COUNT;  // 当前设置的顶点输入，COUNT 表示还没设置
+    VkColorComponentFlags shaderObjectColorWriteMask = 0;
+
+    // Pipeline warm-up
+    std::mutex warmupMutex;
+    std::unordered_map<uint64_t, WarmPipeline> warmPipelines;
+    std::unordered_map<uint64_t, PipelineUsage> pipelineUsages;
+    std::unordered_map<uint64_t, PipelineUsage> manifestUsages;
+    std::atomic<uint32_t> pendingWarmupJobs = 0;
+    PipelineWarmupStats warmupStats = {};
+
+    // Extended dynamic state
+    bool colorBlendEnableDynamic = false;
+    DynamicStateCache dynamicStateCache;
+
+    bool multiDrawIndirectEnabled = false;
+    bool drawIndirectCountEnabled = false;
+    bool drawIndirectFirstInstanceEnabled = false;
+
+    // VK_EXT_mesh_shader
+    bool meshShaderEnabled = false;
+    bool meshPipelineBound = false;                 // 当前 command buffer 最后绑定的是 mesh pipeline
 
     uint32_t queueFamilyIndex = UINT32_MAX;
     VkSurfaceFormatKHR surfaceFormat = {};
+    VkExtent2D swapchainExtent = {};
     VkPhysicalDeviceProperties physicalDeviceProperties = {};
 };
 
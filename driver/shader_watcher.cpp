@@ -0,0 +1,168 @@
+#include "shader_watcher.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <filesystem>
+#include <set>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif /* __linux__ */
+
+/* 需要重新编译的 shader 阶段后缀 */
+static const char *watchedStages[] = { "vert", "frag", "comp", "task", "mesh" };
+
+static bool IsWatchedShader(const char *fileName)
+{
+    const char *ext = strrchr(fileName, '.');
+    if (ext == NULL || ext == fileName)
+        return false;
+
+    for (const char *stage : watchedStages) {
+        if (strcmp(ext + 1, stage) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+    Stop();
+}
+
+bool ShaderWatcher::Start(const char *shaderDirectory, Callback callback)
+{
+    if (running)
+        return true;
+
+    if (!std::filesystem::is_directory(shaderDirectory)) {
+        printf("[shader] hot reload disabled, directory not found: %s\n", shaderDirectory);
+        return false;
+    }
+
+    this->directory = shaderDirectory;
+    this->callback = std::move(callback);
+
+    running = true;
+    thread = std::thread(&ShaderWatcher::_Run, this);
+
+    printf("[shader] hot reload watching: %s\n", shaderDirectory);
+
+    return true;
+}
+
+void ShaderWatcher::Stop()
+{
+    if (!running)
+        return;
+
+    running = false;
+    if (thread.joinable())
+        thread.join();
+}
+
+void ShaderWatcher::_Compile(const char *fileName)
+{
+    char command[1024];
+    snprintf(command, sizeof(command), "glslangValidator -V --target-env vulkan1.3 \"%s/%s\" -o \"%s.spv\"",
+        directory.c_str(), fileName, fileName);
+
+    printf("[shader] recompiling %s ...\n", fileName);
+
+    if (system(command) != 0) {
+        printf("[shader] compile %s failed, keep previous pipeline\n", fileName);
+        return;
+    }
+
+    /* universal.vert -> universal */
+    std::string shaderName(fileName, strrchr(fileName, '.') - fileName);
+    callback(shaderName.c_str());
+}
+
+#ifdef __linux__
+
+void ShaderWatcher::_Run()
+{
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        printf("[shader] inotify_init1 failed, hot reload disabled\n");
+        running = false;
+        return;
+    }
+
+    /* 编辑器通常写临时文件再 rename，所以同时关心 IN_MOVED_TO */
+    int wd = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0) {
+        printf("[shader] inotify_add_watch failed, hot reload disabled\n");
+        close(fd);
+        running = false;
+        return;
+    }
+
+    alignas(struct inotify_event) char buf[4096];
+
+    while (running) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 200) <= 0)
+            continue;
+
+        /* 同一批事件里重复的文件只编译一次 */
+        std::set<std::string> changed;
+
+        ssize_t len;
+        while ((len = read(fd, buf, sizeof(buf))) > 0) {
+            for (char *ptr = buf; ptr < buf + len; ) {
+                const struct inotify_event *event = (const struct inotify_event *) ptr;
+                if (event->len > 0 && IsWatchedShader(event->name))
+                    changed.insert(event->name);
+                ptr += sizeof(struct inotify_event) + event->len;
+            }
+        }
+
+        for (const std::string &fileName : changed)
+            _Compile(fileName.c_str());
+    }
+
+    inotify_rm_watch(fd, wd);
+    close(fd);
+}
+
+#else
+
+/* 没有 inotify 的平台退化为轮询文件修改时间 */
+void ShaderWatcher::_Run()
+{
+    namespace fs = std::filesystem;
+
+    std::unordered_map<std::string, fs::file_time_type> timestamps;
+    std::error_code ec;
+
+    for (const fs::directory_entry &entry : fs::directory_iterator(directory, ec))
+        timestamps[entry.path().filename().string()] = entry.last_write_time(ec);
+
+    while (running) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+        for (const fs::directory_entry &entry : fs::directory_iterator(directory, ec)) {
+            std::string fileName = entry.path().filename().string();
+            if (!IsWatchedShader(fileName.c_str()))
+                continue;
+
+            fs::file_time_type time = entry.last_write_time(ec);
+            auto it = timestamps.find(fileName);
+            if (it != timestamps.end() && it->second == time)
+                continue;
+
+            timestamps[fileName] = time;
+            _Compile(fileName.c_str());
+        }
+    }
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,38 @@
+#ifndef SHADER_WATCHER_H_
+#define SHADER_WATCHER_H_
+
+// std
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+/*
+ * 监听 shader 源码目录，文件变更后在后台线程调用 glslangValidator 重新编译，
+ * 编译成功的 spv 写入当前工作目录（与 _CreateShaderModule 的加载路径一致），
+ * 然后以 shaderName 回调通知。回调运行在 watcher 线程上。
+ */
+class ShaderWatcher
+{
+public:
+    typedef std::function<void(const char *shaderName)> Callback;
+
+    ShaderWatcher() = default;
+   ~ShaderWatcher();
+
+    bool Start(const char *shaderDirectory, Callback callback);
+    void Stop();
+
+    bool IsRunning() const { return running; }
+
+private:
+    void _Run();
+    void _Compile(const char *fileName);
+
+    std::string directory;
+    Callback callback;
+    std::thread thread;
+    std::atomic<bool> running = false;
+};
+
+#endif /* SHADER_WATCHER_H_ */
@@ -7,6 +7,7 @@
 
 #include <vector>
 #include <assert.h>
+#include <string.h>
 
 namespace VkUtils
 {
@@ -80,6 +81,27 @@ namespace VkUtils
         return chosenSurfaceFormat;
     }
 
+    inline static std::vector<VkExtensionProperties> EnumerateDeviceExtensions(VkPhysicalDevice physicalDevice)
+    {
+        uint32_t count = 0;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, VK_NULL_HANDLE, &count, VK_NULL_HANDLE);
+
+        std::vector<VkExtensionProperties> extensions(count);
+        vkEnumerateDeviceExtensionProperties(physicalDevice, VK_NULL_HANDLE, &count, std::data(extensions));
+
+        return extensions;
+    }
+
+    inline static bool IsExtensionSupported(const std::vector<VkExtensionProperties>& extensions, const char* name)
+    {
+        for (const VkExtensionProperties& extension : extensions) {
+            if (strcmp(extension.extensionName, name) == 0)
+                return true;
+        }
+
+        return false;
+    }
+
 }
 
 #endif /* VKUTILS_H_ */
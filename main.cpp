@@ -36,15 +36,54 @@ int main()
     assert(!err);
     driver->Initialize(surface);
 
-    Pipeline pipeline = VK_NULL_HANDLE;
+    /* 按上次运行记录的清单在后台预编译 pipeline，完成前显示 loading 画面 */
+    driver->WarmupPipelines("pipeline_manifest.txt");
+
+    const VkClearColorValue loadingColor = { { 0.1f, 0.1f, 0.1f, 1.0f } };
+
+    while (!driver->IsWarmupComplete() && !glfwWindowShouldClose(hwindow)) {
+        glfwPollEvents();
+
+        if (driver->BeginFrame() != VK_SUCCESS)
+            continue;
+
+        driver->BeginRendering(loadingColor);
+        driver->EndRendering();
+
+        driver->EndFrame();
+    }
+
+    Pipeline pipeline = {};
     driver->CreatePipeline("universal", &pipeline);
 
+    /* 修改 shaders 目录下的源码后自动重新编译并替换 pipeline */
+    driver->EnableShaderHotReload("../shaders");
+
+    const VkClearColorValue clearColor = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+
     while (!glfwWindowShouldClose(hwindow)) {
         glfwPollEvents();
+
+        if (driver->BeginFrame() != VK_SUCCESS)
+            continue;
+
+        driver->BeginRendering(clearColor);
+        driver->CmdBindPipeline(pipeline);
+        driver->EndRendering();
+
+        driver->EndFrame();
     }
 
+    driver->WaitIdle();
     driver->DestroyPipeline(pipeline);
 
+    PipelineWarmupStats warmupStats = driver->GetPipelineWarmupStats();
+    printf("[pipeline] warm up: manifest=%u warmed=%u hits=%u first-use compiles=%u\n",
+        warmupStats.manifestEntries, warmupStats.warmedPipelines,
+        warmupStats.warmHits, warmupStats.firstUseCompiles);
+
+    driver->SavePipelineManifest("pipeline_manifest.txt");
+
     glfwDestroyWindow(hwindow);
     glfwTerminate();
 
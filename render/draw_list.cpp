@@ -0,0 +1,231 @@
+#include "draw_list.h"
+#include "gpu_culling.h"
+
+#include <assert.h>
+#include <string.h>
+
+#define VK_CHECK_ERROR(err) \
+    if (err != VK_SUCCESS) \
+        return err;
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1u << RADIX_BITS)
+#define RADIX_PASSES (64 / RADIX_BITS)
+
+#define DRAW_KEY_DEPTH_SHIFT    0
+#define DRAW_KEY_MATERIAL_SHIFT (DRAW_KEY_DEPTH_SHIFT + DRAW_KEY_DEPTH_BITS)
+#define DRAW_KEY_PIPELINE_SHIFT (DRAW_KEY_MATERIAL_SHIFT + DRAW_KEY_MATERIAL_BITS)
+#define DRAW_KEY_PASS_SHIFT     (DRAW_KEY_PIPELINE_SHIFT + DRAW_KEY_PIPELINE_BITS)
+
+static_assert(DRAW_KEY_PASS_SHIFT + DRAW_KEY_PASS_BITS == 64, "draw sort key must fill 64 bits");
+
+#define DRAW_KEY_MASK(bits) ((1ull << (bits)) - 1)
+
+DrawList::DrawList(RenderDriver *driver)
+    : driver(driver)
+{
+
+}
+
+DrawList::~DrawList()
+{
+
+}
+
+uint64_t DrawList::MakeSortKey(uint32_t pass, Pipeline pipeline, uint32_t material, uint32_t depthBucket)
+{
+    assert(pass < MAX_DRAW_PASSES);
+    assert(material <= DRAW_KEY_MASK(DRAW_KEY_MATERIAL_BITS));
+
+    /* pipeline 的 id 带有代数，只取低位作为分组依据，偶尔冲突只影响排序效果 */
+    uint64_t key = 0;
+    key |= ((uint64_t) pass & DRAW_KEY_MASK(DRAW_KEY_PASS_BITS)) << DRAW_KEY_PASS_SHIFT;
+    key |= ((uint64_t) pipeline.id & DRAW_KEY_MASK(DRAW_KEY_PIPELINE_BITS)) << DRAW_KEY_PIPELINE_SHIFT;
+    key |= ((uint64_t) material & DRAW_KEY_MASK(DRAW_KEY_MATERIAL_BITS)) << DRAW_KEY_MATERIAL_SHIFT;
+    key |= ((uint64_t) depthBucket & DRAW_KEY_MASK(DRAW_KEY_DEPTH_BITS)) << DRAW_KEY_DEPTH_SHIFT;
+
+    return key;
+}
+
+uint32_t DrawList::GetDepthBucket(float viewDepth, float zNear, float zFar, bool backToFront)
+{
+    float t = (viewDepth - zNear) / (zFar - zNear);
+    t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+
+    const uint32_t maxBucket = (uint32_t) DRAW_KEY_MASK(DRAW_KEY_DEPTH_BITS);
+    uint32_t bucket = (uint32_t) (t * (float) maxBucket);
+    if (bucket > maxBucket)
+        bucket = maxBucket;
+
+    return backToFront ? maxBucket - bucket : bucket;
+}
+
+void DrawList::SetMaterial(uint32_t material, VkDeviceAddress paramsAddress)
+{
+    assert(material <= DRAW_KEY_MASK(DRAW_KEY_MATERIAL_BITS));
+
+    if (material >= std::size(materials))
+        materials.resize(material + 1, 0);
+
+    materials[material] = paramsAddress;
+}
+
+void DrawList::Add(uint64_t sortKey, Pipeline pipeline, uint32_t material, GeometryManager *geometry, Mesh mesh, const glm::mat4& model)
+{
+    SortEntry entry = {};
+    entry.key = sortKey;
+    entry.index = static_cast<uint32_t>(std::size(draws));
+    entries.push_back(entry);
+
+    Draw draw = {};
+    draw.pipeline = pipeline;
+    draw.material = material;
+    draw.geometry = geometry;
+    draw.mesh = mesh;
+    draw.model = model;
+    draws.push_back(draw);
+}
+
+void DrawList::_RadixSort()
+{
+    const uint32_t count = static_cast<uint32_t>(std::size(entries));
+    scratch.resize(count);
+
+    /* 一次遍历统计所有 8 位的直方图，LSD 排序是稳定的，相同键保持 Add 的顺序 */
+    uint32_t histograms[RADIX_PASSES][RADIX_BUCKETS] = {};
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t key = entries[i].key;
+        for (uint32_t pass = 0; pass < RADIX_PASSES; pass++)
+            histograms[pass][(key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+    }
+
+    SortEntry *src = entries.data();
+    SortEntry *dst = scratch.data();
+
+    for (uint32_t pass = 0; pass < RADIX_PASSES; pass++) {
+        uint32_t *histogram = histograms[pass];
+        const uint32_t shift = pass * RADIX_BITS;
+
+        /* 所有键在这 8 位上相同（比如没用到的 pass 或 pipeline 高位），这一趟不会改变顺序 */
+        if (histogram[(src[0].key >> shift) & (RADIX_BUCKETS - 1)] == count)
+            continue;
+
+        uint32_t offset = 0;
+        for (uint32_t bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+            uint32_t bucketCount = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucketCount;
+        }
+
+        for (uint32_t i = 0; i < count; i++)
+            dst[histogram[(src[i].key >> shift) & (RADIX_BUCKETS - 1)]++] = src[i];
+
+        std::swap(src, dst);
+    }
+
+    if (src != entries.data())
+        memcpy(entries.data(), src, count * sizeof(SortEntry));
+}
+
+VkResult DrawList::Submit(const glm::mat4& viewProjection)
+{
+    VkResult err = VK_SUCCESS;
+
+    stats = {};
+
+    if (std::empty(draws))
+        return err;
+
+    _RadixSort();
+
+    const uint32_t count = static_cast<uint32_t>(std::size(entries));
+
+    TransientBuffer objectBuffer = {};
+    err = driver->AllocateTransient(count * sizeof(GpuObject), 16, &objectBuffer);
+    if (err != VK_SUCCESS) {
+        draws.clear();
+        entries.clear();
+        return err;
+    }
+
+    GpuObject *objects = (GpuObject *) objectBuffer.pMapped;
+
+    /*
+     * 当前 command buffer 绑定状态的记录，Submit 开始时外面可能绑过任何东西，全部视为未知。
+     * 所有 pipeline 共用一个 layout，push constant 在切换 pipeline 后依然有效。
+     */
+    Pipeline boundPipeline = {};
+    Buffer boundVertexBuffer = {};
+    Buffer boundIndexBuffer = {};
+    VkDeviceAddress boundMaterial = 0;
+    bool materialValid = false;
+
+    PushConstants pushConstants = {};
+    pushConstants.viewProjection = viewProjection;
+    pushConstants.objectAddress = objectBuffer.address;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const Draw& draw = draws[entries[i].index];
+        const MeshRange& range = draw.geometry->GetMeshRange(draw.mesh);
+
+        GpuObject& object = objects[i];
+        object.model = draw.model;
+        object.boundingSphere = glm::vec4(0.0f);
+        object.firstIndex = range.firstIndex;
+        object.indexCount = range.indexCount;
+        object.vertexOffset = (int32_t) range.firstVertex;
+        object.vertexFormat = range.vertexFormat;
+
+        if (draw.pipeline != boundPipeline) {
+            driver->CmdBindPipeline(draw.pipeline);
+            boundPipeline = draw.pipeline;
+            stats.pipelineBinds++;
+        } else {
+            stats.pipelineBindsElided++;
+        }
+
+        VkDeviceAddress material = draw.material < std::size(materials) ? materials[draw.material] : 0;
+        if (!materialValid || material != boundMaterial) {
+            pushConstants.materialAddress = material;
+
+            /* 第一次连同 viewProjection 一起写，之后只更新材质地址 */
+            if (!materialValid)
+                driver->CmdPushConstants(&pushConstants, sizeof(pushConstants));
+            else
+                driver->CmdPushConstants(&pushConstants.materialAddress, sizeof(VkDeviceAddress), offsetof(PushConstants, materialAddress));
+
+            boundMaterial = material;
+            materialValid = true;
+            stats.materialBinds++;
+        } else {
+            stats.materialBindsElided++;
+        }
+
+        Buffer vertexBuffer = draw.geometry->GetVertexBuffer();
+        if (vertexBuffer != boundVertexBuffer) {
+            driver->CmdBindVertexBuffer(vertexBuffer, 0);
+            boundVertexBuffer = vertexBuffer;
+            stats.vertexBufferBinds++;
+        } else {
+            stats.vertexBufferBindsElided++;
+        }
+
+        Buffer indexBuffer = draw.geometry->GetIndexBuffer();
+        if (indexBuffer != boundIndexBuffer) {
+            driver->CmdBindIndexBuffer(indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+            boundIndexBuffer = indexBuffer;
+            stats.indexBufferBinds++;
+        } else {
+            stats.indexBufferBindsElided++;
+        }
+
+        /* firstInstance 指向排序后的下标，shader 用 gl_InstanceIndex 取变换 */
+        driver->CmdDrawIndexed(range.indexCount, 1, range.firstIndex, (int32_t) range.firstVertex, i);
+        stats.drawCount++;
+    }
+
+    draws.clear();
+    entries.clear();
+
+    return err;
+}
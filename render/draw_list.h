@@ -0,0 +1,96 @@
+#ifndef DRAW_LIST_H_
+#define DRAW_LIST_H_
+
+#include "driver/render_driver.h"
+#include "render/geometry_manager.h"
+
+#include <glm/glm.hpp>
+
+// std
+#include <vector>
+
+/*
+ * 64 位排序键，从高位到低位：
+ *   pass(4) | pipeline(16) | material(16) | depth(28)
+ * 先按 pass 分开，同一个 pass 内相同 pipeline、相同材质的 draw 排在一起，最后按深度从近到远。
+ */
+#define DRAW_KEY_PASS_BITS      4
+#define DRAW_KEY_PIPELINE_BITS  16
+#define DRAW_KEY_MATERIAL_BITS  16
+#define DRAW_KEY_DEPTH_BITS     28
+
+#define MAX_DRAW_PASSES         (1u << DRAW_KEY_PASS_BITS)
+
+typedef struct DrawListStats {
+    uint32_t drawCount = 0;
+    uint32_t pipelineBinds = 0;
+    uint32_t pipelineBindsElided = 0;
+    uint32_t materialBinds = 0;             // 材质参数地址的 push constant
+    uint32_t materialBindsElided = 0;
+    uint32_t vertexBufferBinds = 0;
+    uint32_t vertexBufferBindsElided = 0;
+    uint32_t indexBufferBinds = 0;
+    uint32_t indexBufferBindsElided = 0;
+} DrawListStats;
+
+/*
+ * 每帧收集的 draw 列表：Add 时生成排序键，Submit 前对键做基数排序，
+ * 录制时记住当前绑定的 pipeline、材质和顶点/索引 buffer，和上一个 draw 相同就不再绑定。
+ * 物体变换按排序后的顺序写进临时内存的 GpuObject 数组，顶点着色器用 gl_InstanceIndex 读取（参考 indirect.vert）。
+ * 只能在主线程使用。
+ */
+class DrawList
+{
+public:
+    explicit DrawList(RenderDriver *driver);
+   ~DrawList();
+
+    static uint64_t MakeSortKey(uint32_t pass, Pipeline pipeline, uint32_t material, uint32_t depthBucket);
+    /* 把相机空间的深度线性映射到 depth 字段，backToFront 用于半透明 pass */
+    static uint32_t GetDepthBucket(float viewDepth, float zNear, float zFar, bool backToFront = false);
+
+    /* 材质 id 对应的参数 buffer 地址，绘制时以 push constant 传给 shader，id 必须小于 2^16 */
+    void SetMaterial(uint32_t material, VkDeviceAddress paramsAddress);
+
+    void Add(uint64_t sortKey, Pipeline pipeline, uint32_t material, GeometryManager *geometry, Mesh mesh, const glm::mat4& model);
+    /* 在 BeginRendering 之后调用，画完清空列表 */
+    VkResult Submit(const glm::mat4& viewProjection);
+
+    uint32_t GetDrawCount() const { return static_cast<uint32_t>(std::size(draws)); }
+    /* 上一次 Submit 的统计 */
+    DrawListStats GetStats() const { return stats; }
+
+private:
+    struct Draw {
+        Pipeline pipeline;
+        uint32_t material;
+        GeometryManager *geometry;
+        Mesh mesh;
+        glm::mat4 model;
+    };
+
+    struct SortEntry {
+        uint64_t key;
+        uint32_t index;             // 在 draws 里的下标
+    };
+
+    /* 前两个成员和 indirect.vert 的 PushConstants 一致 */
+    struct PushConstants {
+        glm::mat4 viewProjection;
+        VkDeviceAddress objectAddress;
+        VkDeviceAddress materialAddress;
+    };
+
+    void _RadixSort();
+
+    RenderDriver *driver = VK_NULL_HANDLE;
+
+    std::vector<Draw> draws;
+    std::vector<SortEntry> entries;
+    std::vector<SortEntry> scratch;             // 基数排序的乒乓缓冲
+    std::vector<VkDeviceAddress> materials;
+
+    DrawListStats stats = {};
+};
+
+#endif /* DRAW_LIST_H_ */
@@ -0,0 +1,66 @@
+#ifndef FRUSTUM_H_
+#define FRUSTUM_H_
+
+#include <glm/glm.hpp>
+
+/* 平面方程 dot(n, p) + d >= 0 表示在内侧，法线已经归一化，球体测试可以直接和半径比较 */
+typedef struct Frustum {
+    glm::vec4 planes[6];    // left, right, bottom, top, near, far
+} Frustum;
+
+/*
+ * reverse-Z、远平面在无穷远的右手系透视投影：相机看向 -Z，近平面深度为 1，无穷远处趋近 0。
+ * 浮点数在 0 附近精度最高，正好抵消透视除法让远处深度挤在一起的问题，远处不会 z-fighting。
+ * 配合 DEPTH_CLEAR_VALUE 和 VK_COMPARE_OP_GREATER_OR_EQUAL 使用。
+ */
+static inline glm::mat4 MakeReverseZPerspective(float fovy, float aspect, float zNear)
+{
+    const float f = 1.0f / glm::tan(fovy * 0.5f);
+
+    glm::mat4 projection(0.0f);
+    projection[0][0] = f / aspect;
+    projection[1][1] = f;
+    projection[2][3] = -1.0f;       // w = -z
+    projection[3][2] = zNear;       // z = zNear，透视除法后为 zNear / -z
+
+    return projection;
+}
+
+/*
+ * 从 viewProjection 矩阵提取六个平面（Gribb-Hartmann），裁剪空间深度范围是 Vulkan 的 [0, 1]。
+ * reverse-Z 时 near/far 两个平面互换，无穷远的远平面退化为恒成立的 (0, 0, 0, 1)。
+ */
+static inline Frustum ExtractFrustum(const glm::mat4& viewProjection)
+{
+    /* glm 按列存储，第 i 行要跨列取 */
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+    Frustum frustum = {};
+    frustum.planes[0] = rows[3] + rows[0];
+    frustum.planes[1] = rows[3] - rows[0];
+    frustum.planes[2] = rows[3] + rows[1];
+    frustum.planes[3] = rows[3] - rows[1];
+    frustum.planes[4] = rows[2];
+    frustum.planes[5] = rows[3] - rows[2];
+
+    for (glm::vec4& plane : frustum.planes) {
+        float length = glm::length(glm::vec3(plane));
+        plane = length > 0.0f ? plane / length : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+
+    return frustum;
+}
+
+static inline bool IsSphereVisible(const Frustum& frustum, const glm::vec3& center, float radius)
+{
+    for (const glm::vec4& plane : frustum.planes) {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+            return false;
+    }
+
+    return true;
+}
+
+#endif /* FRUSTUM_H_ */
@@ -0,0 +1,367 @@
+#include "geometry_manager.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define VK_CHECK_ERROR(err) \
+    if (err != VK_SUCCESS) \
+        return err;
+
+GeometryManager::GeometryManager(RenderDriver *driver, uint32_t vertexStride, uint32_t maxVertices, uint32_t maxIndices)
+    : driver(driver), vertexStride(vertexStride), maxVertices(maxVertices), maxIndices(maxIndices)
+{
+
+}
+
+GeometryManager::~GeometryManager()
+{
+    if (vertexBlock != VK_NULL_HANDLE)
+        _DestroyMegabuffers(vertexBuffer, indexBuffer, vertexBlock, indexBlock);
+}
+
+VkResult GeometryManager::Initialize()
+{
+    return _CreateMegabuffers(&vertexBuffer, &indexBuffer, &vertexBlock, &indexBlock);
+}
+
+VkResult GeometryManager::UploadMesh(const void *vertices, uint32_t vertexCount, const uint32_t *indices, uint32_t indexCount, Mesh *pMesh)
+{
+    return _UploadMesh(vertices, vertexCount, VERTEX_FORMAT_FLOAT, indices, indexCount, NULL, 0, pMesh);
+}
+
+VkResult GeometryManager::UploadMeshLods(const void *vertices, uint32_t vertexCount, const uint32_t *indices, const MeshLod *lods, uint32_t lodCount, Mesh *pMesh)
+{
+    assert(lodCount > 0 && lodCount <= MAX_MESH_LODS);
+
+    const MeshLod& last = lods[lodCount - 1];
+    return _UploadMesh(vertices, vertexCount, VERTEX_FORMAT_FLOAT, indices, last.indexOffset + last.indexCount, lods, lodCount, pMesh);
+}
+
+VkResult GeometryManager::UploadPackedMesh(const PackedVertex *vertices, uint32_t vertexCount, const uint32_t *indices, uint32_t indexCount, Mesh *pMesh)
+{
+    /*
+     * 槽位大小是 vertexStride，末尾不满一个槽位的部分补零。
+     * 索引依然相对 firstVertex，shader 用 gl_VertexIndex - vertexOffset 算出 mesh 内的下标再乘以格式自己的大小。
+     */
+    const size_t packedSize = (size_t) vertexCount * sizeof(PackedVertex);
+    const uint32_t slotCount = (uint32_t) ((packedSize + vertexStride - 1) / vertexStride);
+
+    std::vector<uint8_t> slots((size_t) slotCount * vertexStride, 0);
+    memcpy(std::data(slots), vertices, packedSize);
+
+    return _UploadMesh(std::data(slots), slotCount, VERTEX_FORMAT_PACKED, indices, indexCount, NULL, 0, pMesh);
+}
+
+VkResult GeometryManager::_UploadMesh(const void *vertices, uint32_t vertexCount, VertexFormat vertexFormat, const uint32_t *indices, uint32_t indexCount,
+                                      const MeshLod *lods, uint32_t lodCount, Mesh *pMesh)
+{
+    VkResult err;
+
+    VmaVirtualAllocation vertexAllocation = VK_NULL_HANDLE;
+    VmaVirtualAllocation indexAllocation = VK_NULL_HANDLE;
+    MeshRange range = {};
+
+    err = _AllocateRanges(vertexCount, indexCount, &vertexAllocation, &indexAllocation, &range);
+
+    /* 总空间够、只是碎片太多时压紧后再试一次 */
+    if (err != VK_SUCCESS &&
+        maxVertices - usedVertices >= vertexCount &&
+        maxIndices - usedIndices >= indexCount) {
+        printf("[geometry] megabuffer fragmented, compacting\n");
+
+        err = Compact();
+        VK_CHECK_ERROR(err);
+
+        err = _AllocateRanges(vertexCount, indexCount, &vertexAllocation, &indexAllocation, &range);
+    }
+
+    VK_CHECK_ERROR(err);
+
+    err = driver->WriteBuffer(vertexBuffer, (size_t) range.firstVertex * vertexStride, vertices, (size_t) vertexCount * vertexStride);
+
+    if (err == VK_SUCCESS)
+        err = driver->WriteBuffer(indexBuffer, (size_t) range.firstIndex * sizeof(uint32_t), indices, (size_t) indexCount * sizeof(uint32_t));
+
+    if (err != VK_SUCCESS) {
+        vmaVirtualFree(vertexBlock, vertexAllocation);
+        vmaVirtualFree(indexBlock, indexAllocation);
+        return err;
+    }
+
+    uint32_t handle = meshHandles.Allocate();
+    uint32_t slot = HandlePool::IndexOf(handle);
+
+    if (slot >= std::size(meshRanges)) {
+        uint32_t capacity = meshHandles.GetCapacity();
+        meshRanges.resize(capacity);
+        vertexAllocations.resize(capacity, VK_NULL_HANDLE);
+        indexAllocations.resize(capacity, VK_NULL_HANDLE);
+    }
+
+    range.vertexFormat = vertexFormat;
+
+    /* 没有 LOD 的 mesh 只有第 0 级，就是全部索引 */
+    if (lodCount > 0) {
+        memcpy(range.lods, lods, lodCount * sizeof(MeshLod));
+        range.lodCount = lodCount;
+        range.indexCount = lods[0].indexCount;
+    } else {
+        range.lods[0].indexCount = indexCount;
+        range.lodCount = 1;
+    }
+
+    meshRanges[slot] = range;
+    vertexAllocations[slot] = vertexAllocation;
+    indexAllocations[slot] = indexAllocation;
+
+    usedVertices += vertexCount;
+    usedIndices += indexCount;
+
+    pMesh->id = handle;
+
+    return err;
+}
+
+void GeometryManager::FreeMesh(Mesh mesh)
+{
+    uint32_t slot = _GetMeshSlot(mesh);
+
+    /* 当前帧可能还会用到这段数据，帧结束后再回收空间 */
+    PendingFree pending = {};
+    pending.vertexAllocation = vertexAllocations[slot];
+    pending.indexAllocation = indexAllocations[slot];
+    pending.frameNumber = driver->GetFrameNumber();
+    pendingFrees.push_back(pending);
+
+    usedVertices -= meshRanges[slot].vertexCount;
+    usedIndices -= meshRanges[slot].totalIndexCount;
+
+    meshRanges[slot] = {};
+    vertexAllocations[slot] = VK_NULL_HANDLE;
+    indexAllocations[slot] = VK_NULL_HANDLE;
+
+    meshHandles.Free(mesh.id);
+}
+
+VkResult GeometryManager::Compact()
+{
+    VkResult err;
+
+    Buffer newVertexBuffer = {};
+    Buffer newIndexBuffer = {};
+    VmaVirtualBlock newVertexBlock = VK_NULL_HANDLE;
+    VmaVirtualBlock newIndexBlock = VK_NULL_HANDLE;
+
+    err = _CreateMegabuffers(&newVertexBuffer, &newIndexBuffer, &newVertexBlock, &newIndexBlock);
+    VK_CHECK_ERROR(err);
+
+    const std::vector<uint32_t>& liveSlots = meshHandles.GetLiveSlots();
+    const uint32_t liveCount = meshHandles.GetLiveCount();
+
+    std::vector<MeshRange> newRanges(liveCount);
+    std::vector<VmaVirtualAllocation> newVertexAllocations(liveCount);
+    std::vector<VmaVirtualAllocation> newIndexAllocations(liveCount);
+    std::vector<VkBufferCopy> vertexCopies(liveCount);
+    std::vector<VkBufferCopy> indexCopies(liveCount);
+
+    /* 新 block 是空的，依次分配就是连续的 */
+    for (uint32_t i = 0; i < liveCount; i++) {
+        const MeshRange& range = meshRanges[liveSlots[i]];
+
+        VmaVirtualAllocationCreateInfo allocationCreateInfo = {};
+        VkDeviceSize offset = 0;
+
+        /* 只有起始位置会变，LOD 的偏移相对 firstIndex 不用改 */
+        newRanges[i] = range;
+
+        allocationCreateInfo.size = range.vertexCount;
+        vmaVirtualAllocate(newVertexBlock, &allocationCreateInfo, &newVertexAllocations[i], &offset);
+        newRanges[i].firstVertex = (uint32_t) offset;
+
+        allocationCreateInfo.size = range.totalIndexCount;
+        vmaVirtualAllocate(newIndexBlock, &allocationCreateInfo, &newIndexAllocations[i], &offset);
+        newRanges[i].firstIndex = (uint32_t) offset;
+
+        vertexCopies[i].srcOffset = (VkDeviceSize) range.firstVertex * vertexStride;
+        vertexCopies[i].dstOffset = (VkDeviceSize) newRanges[i].firstVertex * vertexStride;
+        vertexCopies[i].size = (VkDeviceSize) range.vertexCount * vertexStride;
+
+        indexCopies[i].srcOffset = (VkDeviceSize) range.firstIndex * sizeof(uint32_t);
+        indexCopies[i].dstOffset = (VkDeviceSize) newRanges[i].firstIndex * sizeof(uint32_t);
+        indexCopies[i].size = (VkDeviceSize) range.totalIndexCount * sizeof(uint32_t);
+    }
+
+    if (liveCount > 0) {
+        err = driver->CopyBuffer(vertexBuffer, newVertexBuffer, liveCount, std::data(vertexCopies));
+
+        if (err == VK_SUCCESS)
+            err = driver->CopyBuffer(indexBuffer, newIndexBuffer, liveCount, std::data(indexCopies));
+    }
+
+    /* 拷贝失败时保留旧的 megabuffer */
+    if (err != VK_SUCCESS) {
+        _DestroyMegabuffers(newVertexBuffer, newIndexBuffer, newVertexBlock, newIndexBlock);
+        return err;
+    }
+
+    for (uint32_t i = 0; i < liveCount; i++) {
+        meshRanges[liveSlots[i]] = newRanges[i];
+        vertexAllocations[liveSlots[i]] = newVertexAllocations[i];
+        indexAllocations[liveSlots[i]] = newIndexAllocations[i];
+    }
+
+    /* 等待回收的空间都在旧 block 里，随旧 block 一起丢掉 */
+    pendingFrees.clear();
+    _DestroyMegabuffers(vertexBuffer, indexBuffer, vertexBlock, indexBlock);
+
+    vertexBuffer = newVertexBuffer;
+    indexBuffer = newIndexBuffer;
+    vertexBlock = newVertexBlock;
+    indexBlock = newIndexBlock;
+    compactions++;
+
+    return err;
+}
+
+void GeometryManager::Collect()
+{
+    uint64_t completedFrameNumber = driver->GetCompletedFrameNumber();
+
+    std::erase_if(pendingFrees, [this, completedFrameNumber](const PendingFree& pending) {
+        if (pending.frameNumber > completedFrameNumber)
+            return false;
+
+        vmaVirtualFree(vertexBlock, pending.vertexAllocation);
+        vmaVirtualFree(indexBlock, pending.indexAllocation);
+        return true;
+    });
+}
+
+void GeometryManager::CmdBindBuffers()
+{
+    driver->CmdBindVertexBuffer(vertexBuffer, 0);
+    driver->CmdBindIndexBuffer(indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+VkDrawIndexedIndirectCommand GeometryManager::GetDrawCommand(Mesh mesh, uint32_t instanceCount, uint32_t firstInstance, uint32_t lod) const
+{
+    const MeshRange& range = meshRanges[_GetMeshSlot(mesh)];
+    const MeshLod& level = range.lods[std::min(lod, range.lodCount - 1)];
+
+    VkDrawIndexedIndirectCommand command = {};
+    command.indexCount = level.indexCount;
+    command.instanceCount = instanceCount;
+    command.firstIndex = range.firstIndex + level.indexOffset;
+    command.vertexOffset = (int32_t) range.firstVertex;
+    command.firstInstance = firstInstance;
+
+    return command;
+}
+
+const MeshRange& GeometryManager::GetMeshRange(Mesh mesh) const
+{
+    return meshRanges[_GetMeshSlot(mesh)];
+}
+
+GeometryStats GeometryManager::GetStats() const
+{
+    GeometryStats stats = {};
+    stats.meshCount = meshHandles.GetLiveCount();
+    stats.usedVertices = usedVertices;
+    stats.usedIndices = usedIndices;
+    stats.compactions = compactions;
+
+    return stats;
+}
+
+VkResult GeometryManager::_CreateMegabuffers(Buffer *pVertexBuffer, Buffer *pIndexBuffer, VmaVirtualBlock *pVertexBlock, VmaVirtualBlock *pIndexBlock)
+{
+    VkResult err;
+
+    /* 压紧时要从旧 buffer 拷贝出来，mesh shader 通过地址直接读顶点 */
+    err = driver->CreateBuffer((size_t) maxVertices * vertexStride,
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, pVertexBuffer);
+    VK_CHECK_ERROR(err);
+
+    err = driver->CreateBuffer((size_t) maxIndices * sizeof(uint32_t),
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, pIndexBuffer);
+    if (err != VK_SUCCESS) {
+        driver->DestroyBuffer(*pVertexBuffer);
+        return err;
+    }
+
+    driver->SetBufferName(*pVertexBuffer, "geometry/vertices");
+    driver->SetBufferName(*pIndexBuffer, "geometry/indices");
+
+    /* virtual block 以顶点/索引个数为单位，分配出的 offset 直接就是 firstVertex/firstIndex */
+    VmaVirtualBlockCreateInfo virtualBlockCreateInfo = {};
+
+    virtualBlockCreateInfo.size = maxVertices;
+    err = vmaCreateVirtualBlock(&virtualBlockCreateInfo, pVertexBlock);
+
+    if (err == VK_SUCCESS) {
+        virtualBlockCreateInfo.size = maxIndices;
+        err = vmaCreateVirtualBlock(&virtualBlockCreateInfo, pIndexBlock);
+        if (err != VK_SUCCESS)
+            vmaDestroyVirtualBlock(*pVertexBlock);
+    }
+
+    if (err != VK_SUCCESS) {
+        driver->DestroyBuffer(*pVertexBuffer);
+        driver->DestroyBuffer(*pIndexBuffer);
+        return err;
+    }
+
+    return err;
+}
+
+void GeometryManager::_DestroyMegabuffers(Buffer vertexBuffer, Buffer indexBuffer, VmaVirtualBlock vertexBlock, VmaVirtualBlock indexBlock)
+{
+    /* buffer 可能还被在途的帧引用，由驱动延迟销毁；virtual block 里剩下的分配直接清掉 */
+    vmaClearVirtualBlock(vertexBlock);
+    vmaDestroyVirtualBlock(vertexBlock);
+    vmaClearVirtualBlock(indexBlock);
+    vmaDestroyVirtualBlock(indexBlock);
+
+    driver->DestroyBuffer(vertexBuffer);
+    driver->DestroyBuffer(indexBuffer);
+}
+
+VkResult GeometryManager::_AllocateRanges(uint32_t vertexCount, uint32_t indexCount, VmaVirtualAllocation *pVertexAllocation, VmaVirtualAllocation *pIndexAllocation, MeshRange *pRange)
+{
+    VkResult err;
+
+    VmaVirtualAllocationCreateInfo allocationCreateInfo = {};
+    VkDeviceSize offset = 0;
+
+    allocationCreateInfo.size = vertexCount;
+    err = vmaVirtualAllocate(vertexBlock, &allocationCreateInfo, pVertexAllocation, &offset);
+    VK_CHECK_ERROR(err);
+
+    pRange->firstVertex = (uint32_t) offset;
+    pRange->vertexCount = vertexCount;
+
+    allocationCreateInfo.size = indexCount;
+    err = vmaVirtualAllocate(indexBlock, &allocationCreateInfo, pIndexAllocation, &offset);
+    if (err != VK_SUCCESS) {
+        vmaVirtualFree(vertexBlock, *pVertexAllocation);
+        return err;
+    }
+
+    pRange->firstIndex = (uint32_t) offset;
+    pRange->indexCount = indexCount;
+    pRange->totalIndexCount = indexCount;
+
+    return err;
+}
+
+uint32_t GeometryManager::_GetMeshSlot(Mesh mesh) const
+{
+    if (!meshHandles.IsValid(mesh.id)) {
+        printf("[geometry] invalid mesh handle 0x%08x\n", mesh.id);
+        assert(!"invalid mesh handle");
+    }
+
+    return HandlePool::IndexOf(mesh.id);
+}
@@ -0,0 +1,105 @@
+#ifndef GEOMETRY_MANAGER_H_
+#define GEOMETRY_MANAGER_H_
+
+#include "driver/render_driver.h"
+#include "render/mesh_lod.h"
+#include "render/vertex_format.h"
+
+// std
+#include <vector>
+
+typedef struct Mesh {
+    uint32_t id = 0;
+    bool operator==(const Mesh&) const = default;
+} Mesh;
+
+/* mesh 在 megabuffer 中的位置，单位是顶点/索引个数，索引值相对 firstVertex */
+typedef struct MeshRange {
+    uint32_t firstVertex = 0;
+    uint32_t vertexCount = 0;
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;        // 第 0 级 LOD 的索引个数，直接绘制整个 mesh 时用它
+    uint32_t vertexFormat = 0;      // VertexFormat，非默认格式时 vertexCount 是占用的顶点槽位数
+    uint32_t totalIndexCount = 0;   // 占用的索引个数，包括所有 LOD
+    uint32_t lodCount = 0;
+    MeshLod lods[MAX_MESH_LODS] = {};
+} MeshRange;
+
+typedef struct GeometryStats {
+    uint32_t meshCount = 0;
+    uint32_t usedVertices = 0;
+    uint32_t usedIndices = 0;
+    uint32_t compactions = 0;
+} GeometryStats;
+
+/*
+ * 所有静态 mesh 共用一个顶点 buffer 和一个索引 buffer，整帧只需要绑定一次。
+ * 空间由 VMA virtual block 按顶点/索引个数分配，碎片太多放不下时整体搬到新 buffer 里压紧。
+ * 只能在主线程使用。
+ */
+class GeometryManager
+{
+public:
+    GeometryManager(RenderDriver *driver, uint32_t vertexStride, uint32_t maxVertices, uint32_t maxIndices);
+   ~GeometryManager();
+
+    VkResult Initialize();
+
+    VkResult UploadMesh(const void *vertices, uint32_t vertexCount, const uint32_t *indices, uint32_t indexCount, Mesh *pMesh);
+    /* 压缩过的顶点按字节塞进 megabuffer 的槽位里，只能用顶点拉取的 shader 绘制 */
+    VkResult UploadPackedMesh(const PackedVertex *vertices, uint32_t vertexCount, const uint32_t *indices, uint32_t indexCount, Mesh *pMesh);
+    /* indices 是 BuildMeshLods 输出的所有级别首尾相接的索引，lods 的偏移相对 indices 开头 */
+    VkResult UploadMeshLods(const void *vertices, uint32_t vertexCount, const uint32_t *indices, const MeshLod *lods, uint32_t lodCount, Mesh *pMesh);
+    void FreeMesh(Mesh mesh);
+
+    /* 把所有存活的 mesh 拷贝到新的 megabuffer 中连续存放，句柄不变但偏移会变 */
+    VkResult Compact();
+    /* 回收 GPU 已经用完的空间，每帧调用一次 */
+    void Collect();
+
+    void CmdBindBuffers();
+    VkDrawIndexedIndirectCommand GetDrawCommand(Mesh mesh, uint32_t instanceCount = 1, uint32_t firstInstance = 0, uint32_t lod = 0) const;
+
+    const MeshRange& GetMeshRange(Mesh mesh) const;
+    Buffer GetVertexBuffer() const { return vertexBuffer; }
+    Buffer GetIndexBuffer() const { return indexBuffer; }
+    uint32_t GetVertexStride() const { return vertexStride; }
+    GeometryStats GetStats() const;
+
+private:
+    struct PendingFree {
+        VmaVirtualAllocation vertexAllocation;
+        VmaVirtualAllocation indexAllocation;
+        uint64_t frameNumber;
+    };
+
+    VkResult _CreateMegabuffers(Buffer *pVertexBuffer, Buffer *pIndexBuffer, VmaVirtualBlock *pVertexBlock, VmaVirtualBlock *pIndexBlock);
+    void _DestroyMegabuffers(Buffer vertexBuffer, Buffer indexBuffer, VmaVirtualBlock vertexBlock, VmaVirtualBlock indexBlock);
+    VkResult _UploadMesh(const void *vertices, uint32_t vertexCount, VertexFormat vertexFormat, const uint32_t *indices, uint32_t indexCount,
+                         const MeshLod *lods, uint32_t lodCount, Mesh *pMesh);
+    VkResult _AllocateRanges(uint32_t vertexCount, uint32_t indexCount, VmaVirtualAllocation *pVertexAllocation, VmaVirtualAllocation *pIndexAllocation, MeshRange *pRange);
+    uint32_t _GetMeshSlot(Mesh mesh) const;
+
+    RenderDriver *driver = VK_NULL_HANDLE;
+    uint32_t vertexStride = 0;
+    uint32_t maxVertices = 0;
+    uint32_t maxIndices = 0;
+
+    Buffer vertexBuffer = {};
+    Buffer indexBuffer = {};
+    VmaVirtualBlock vertexBlock = VK_NULL_HANDLE;
+    VmaVirtualBlock indexBlock = VK_NULL_HANDLE;
+
+    // Mesh pool，按 slot 下标存放
+    HandlePool meshHandles;
+    std::vector<MeshRange> meshRanges;
+    std::vector<VmaVirtualAllocation> vertexAllocations;
+    std::vector<VmaVirtualAllocation> indexAllocations;
+
+    std::vector<PendingFree> pendingFrees;
+    uint32_t usedVertices = 0;
+    uint32_t usedIndices = 0;
+    uint32_t compactions = 0;
+};
+
+#endif /* GEOMETRY_MANAGER_H_ */
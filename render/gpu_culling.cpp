@@ -0,0 +1,498 @@
+#include "gpu_culling.h"
+#include "frustum.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#define VK_CHECK_ERROR(err) \
+    if (err != VK_SUCCESS) \
+        return err;
+
+#define CULL_WORKGROUP_SIZE 64      // 和 cull.comp 的 local_size_x 一致
+#define PYRAMID_WORKGROUP_SIZE 8    // 和 hiz.comp 的 local_size_x/y 一致
+
+GpuCulling::GpuCulling(RenderDriver *driver, GeometryManager *geometry, uint32_t maxObjects)
+    : driver(driver), geometry(geometry), maxObjects(maxObjects)
+{
+
+}
+
+GpuCulling::~GpuCulling()
+{
+    /* 都由驱动延迟销毁，在途的帧还能继续使用 */
+    if (cullPipeline.id != 0)
+        driver->DestroyPipeline(cullPipeline);
+
+    if (drawPipeline.id != 0)
+        driver->DestroyPipeline(drawPipeline);
+
+    if (depthPipeline.id != 0)
+        driver->DestroyPipeline(depthPipeline);
+
+    if (shadePipeline.id != 0)
+        driver->DestroyPipeline(shadePipeline);
+
+    if (pyramidPipeline.id != 0)
+        driver->DestroyPipeline(pyramidPipeline);
+
+    if (objectBuffer.id != 0)
+        driver->DestroyBuffer(objectBuffer);
+
+    if (drawBuffer.id != 0)
+        driver->DestroyBuffer(drawBuffer);
+
+    if (countBuffer.id != 0)
+        driver->DestroyBuffer(countBuffer);
+
+    if (visibilityBuffer.id != 0)
+        driver->DestroyBuffer(visibilityBuffer);
+
+    if (lodBuffer.id != 0)
+        driver->DestroyBuffer(lodBuffer);
+
+    if (pyramidBuffer.id != 0)
+        driver->DestroyBuffer(pyramidBuffer);
+}
+
+VkResult GpuCulling::Initialize()
+{
+    VkResult err;
+
+    /* 顶点着色器靠 firstInstance 找到物体，必须支持非 0 的 firstInstance */
+    if (!driver->IsDrawIndirectFirstInstanceSupported())
+        return VK_ERROR_FEATURE_NOT_PRESENT;
+
+    /* 没有 drawIndirectCount 时每个物体原位写一条命令，剔除掉的 instanceCount 为 0 */
+    compact = driver->IsDrawIndirectCountSupported();
+
+    err = driver->CreateBuffer((size_t) maxObjects * sizeof(GpuObject),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, &objectBuffer);
+    VK_CHECK_ERROR(err);
+
+    err = driver->CreateBuffer(2 * (size_t) maxObjects * sizeof(VkDrawIndexedIndirectCommand),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, &drawBuffer);
+    VK_CHECK_ERROR(err);
+
+    err = driver->CreateBuffer(2 * sizeof(uint32_t),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, &countBuffer);
+    VK_CHECK_ERROR(err);
+
+    err = driver->CreateBuffer((size_t) maxObjects * sizeof(uint32_t),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, &visibilityBuffer);
+    VK_CHECK_ERROR(err);
+
+    err = driver->CreateBuffer((size_t) maxObjects * sizeof(GpuObjectLods),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, &lodBuffer);
+    VK_CHECK_ERROR(err);
+
+    driver->SetBufferName(objectBuffer, "culling/objects");
+    driver->SetBufferName(drawBuffer, "culling/draws");
+    driver->SetBufferName(countBuffer, "culling/count");
+    driver->SetBufferName(visibilityBuffer, "culling/visibility");
+    driver->SetBufferName(lodBuffer, "culling/lods");
+
+    err = driver->CreateComputePipeline("cull", &cullPipeline);
+    VK_CHECK_ERROR(err);
+
+    err = driver->CreateComputePipeline("hiz", &pyramidPipeline);
+    VK_CHECK_ERROR(err);
+
+    /* 遮挡剔除依赖 early 阶段写下的深度 */
+    PipelineDesc drawDesc = {};
+    drawDesc.shaderName = vertexPulling ? "pulled" : "indirect";
+    drawDesc.vertexLayout = vertexPulling ? VERTEX_LAYOUT_NONE : VERTEX_LAYOUT_DEFAULT;
+    drawDesc.renderState.depthTestEnable = VK_TRUE;
+    drawDesc.renderState.depthWriteEnable = VK_TRUE;
+    drawDesc.renderState.depthCompareOp = VK_COMPARE_OP_GREATER_OR_EQUAL;
+
+    err = driver->CreatePipeline(drawDesc, &drawPipeline);
+    VK_CHECK_ERROR(err);
+
+    /* 深度预渲染：先只写深度，着色时深度相等才通过，每个像素只执行一次 fragment shader */
+    PipelineDesc depthDesc = drawDesc;
+    depthDesc.depthOnly = true;
+
+    err = driver->CreatePipeline(depthDesc, &depthPipeline);
+    VK_CHECK_ERROR(err);
+
+    PipelineDesc shadeDesc = drawDesc;
+    shadeDesc.renderState.depthWriteEnable = VK_FALSE;
+    shadeDesc.renderState.depthCompareOp = VK_COMPARE_OP_EQUAL;
+
+    err = driver->CreatePipeline(shadeDesc, &shadePipeline);
+    VK_CHECK_ERROR(err);
+
+    geometryCompactions = geometry->GetStats().compactions;
+
+    printf("[culling] gpu culling initialized, max objects=%u, draw count %s\n",
+        maxObjects, compact ? "from gpu" : "fixed");
+
+    return err;
+}
+
+VkResult GpuCulling::AddObject(Mesh mesh, const glm::vec4& boundingSphere, const glm::mat4& model, CullObject *pObject)
+{
+    /* 固定顶点输入的 indirect pipeline 只能按 24 字节的 float 顶点读取，其他格式要靠顶点拉取解码 */
+    if (!vertexPulling && geometry->GetMeshRange(mesh).vertexFormat != VERTEX_FORMAT_FLOAT)
+        return VK_ERROR_FORMAT_NOT_SUPPORTED;
+
+    uint32_t handle = objectHandles.Allocate();
+    uint32_t slot = HandlePool::IndexOf(handle);
+
+    if (slot >= maxObjects) {
+        objectHandles.Free(handle);
+        return VK_ERROR_OUT_OF_POOL_MEMORY;
+    }
+
+    if (slot >= std::size(objects)) {
+        uint32_t capacity = std::min(objectHandles.GetCapacity(), maxObjects);
+        objects.resize(capacity, {});
+        objectLods.resize(capacity, {});
+        meshes.resize(capacity);
+    }
+
+    VkDrawIndexedIndirectCommand command = geometry->GetDrawCommand(mesh);
+
+    GpuObject& object = objects[slot];
+    object.model = model;
+    object.boundingSphere = boundingSphere;
+    object.firstIndex = command.firstIndex;
+    object.indexCount = command.indexCount;
+    object.vertexOffset = command.vertexOffset;
+    object.vertexFormat = geometry->GetMeshRange(mesh).vertexFormat;
+
+    /* LOD 的偏移相对 firstIndex，megabuffer 压紧后不用更新 */
+    const MeshRange& range = geometry->GetMeshRange(mesh);
+    GpuObjectLods& lods = objectLods[slot];
+    lods = {};
+    for (uint32_t i = 0; i < range.lodCount; i++) {
+        uint32_t errorBits;
+        memcpy(&errorBits, &range.lods[i].error, sizeof(errorBits));
+        lods.levels[i] = glm::uvec4(range.lods[i].indexOffset, range.lods[i].indexCount, errorBits, 0);
+    }
+
+    meshes[slot] = mesh;
+    objectHighWater = std::max(objectHighWater, slot + 1);
+    _MarkDirty(slot);
+
+    pObject->id = handle;
+
+    return VK_SUCCESS;
+}
+
+void GpuCulling::RemoveObject(CullObject object)
+{
+    uint32_t slot = _GetObjectSlot(object);
+
+    /* 留下空位，shader 看到 indexCount 为 0 直接跳过 */
+    objects[slot] = {};
+    objectLods[slot] = {};
+    meshes[slot] = {};
+    _MarkDirty(slot);
+
+    objectHandles.Free(object.id);
+}
+
+void GpuCulling::SetTransform(CullObject object, const glm::mat4& model)
+{
+    uint32_t slot = _GetObjectSlot(object);
+
+    objects[slot].model = model;
+    _MarkDirty(slot);
+}
+
+VkResult GpuCulling::CmdCull(const glm::mat4& viewProjection)
+{
+    VkResult err;
+
+    /* megabuffer 压紧后所有 mesh 的偏移都变了 */
+    uint32_t compactions = geometry->GetStats().compactions;
+    if (compactions != geometryCompactions) {
+        geometryCompactions = compactions;
+        _RefreshMeshRanges();
+    }
+
+    /* 上一帧的间接绘制、剔除和金字塔构建可能还在读写这些 buffer */
+    driver->CmdMemoryBarrier(
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    /* 只上传改动过的一段，经过当前帧的临时内存随命令提交 */
+    if (dirtyBegin < dirtyEnd) {
+        VkDeviceSize size = (VkDeviceSize) (dirtyEnd - dirtyBegin) * sizeof(GpuObject);
+
+        TransientBuffer staging = {};
+        err = driver->AllocateTransient(size, 16, &staging);
+        VK_CHECK_ERROR(err);
+
+        memcpy(staging.pMapped, &objects[dirtyBegin], size);
+        driver->CmdCopyBuffer(staging, objectBuffer, (VkDeviceSize) dirtyBegin * sizeof(GpuObject));
+
+        VkDeviceSize lodSize = (VkDeviceSize) (dirtyEnd - dirtyBegin) * sizeof(GpuObjectLods);
+
+        TransientBuffer lodStaging = {};
+        err = driver->AllocateTransient(lodSize, 16, &lodStaging);
+        VK_CHECK_ERROR(err);
+
+        memcpy(lodStaging.pMapped, &objectLods[dirtyBegin], lodSize);
+        driver->CmdCopyBuffer(lodStaging, lodBuffer, (VkDeviceSize) dirtyBegin * sizeof(GpuObjectLods));
+
+        dirtyBegin = UINT32_MAX;
+        dirtyEnd = 0;
+    }
+
+    if (compact)
+        driver->CmdFillBuffer(countBuffer, 0, 2 * sizeof(uint32_t), 0);
+
+    /* 除了剔除的 compute，indirect.vert 和 pulled.vert 也按 gl_InstanceIndex 读 objects */
+    driver->CmdMemoryBarrier(
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    /* 分辨率变了金字塔就对不上屏幕坐标，这一帧只做视锥剔除 */
+    VkExtent2D extent = driver->GetRenderExtent();
+    if (extent.width != pyramidExtent.width || extent.height != pyramidExtent.height)
+        pyramidValid = false;
+
+    lateActive = pyramidValid;
+
+    return _Dispatch(viewProjection, 0);
+}
+
+void GpuCulling::CmdDraw(const glm::mat4& viewProjection)
+{
+    _Draw(viewProjection, 0);
+}
+
+VkResult GpuCulling::CmdCullLate(const glm::mat4& viewProjection)
+{
+    VkResult err;
+
+    if (!lateActive)
+        return VK_SUCCESS;
+
+    err = CmdBuildDepthPyramid();
+    VK_CHECK_ERROR(err);
+
+    /* 除了新的金字塔，还要读 early 阶段写下的 visibility */
+    driver->CmdMemoryBarrier(
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+    return _Dispatch(viewProjection, 1);
+}
+
+void GpuCulling::CmdDrawLate(const glm::mat4& viewProjection)
+{
+    if (!lateActive)
+        return;
+
+    _Draw(viewProjection, 1);
+}
+
+VkResult GpuCulling::CmdBuildDepthPyramid()
+{
+    VkResult err;
+
+    VkExtent2D extent = driver->GetRenderExtent();
+    if (extent.width != pyramidExtent.width || extent.height != pyramidExtent.height) {
+        err = _CreatePyramid(extent);
+        VK_CHECK_ERROR(err);
+    }
+
+    /* 之前的剔除和降采样还在读写金字塔 */
+    driver->CmdMemoryBarrier(
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    driver->CmdCopyDepthToBuffer(pyramidBuffer);
+
+    driver->CmdMemoryBarrier(
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+    VkDeviceAddress pyramidAddress = driver->GetBufferAddress(pyramidBuffer);
+
+    driver->CmdBindPipeline(pyramidPipeline);
+
+    /* 逐级降采样，每一级都要等上一级写完 */
+    for (uint32_t level = 1; level < pyramidLevelCount; level++) {
+        const glm::uvec4& src = pyramidLevels[level - 1];
+        const glm::uvec4& dst = pyramidLevels[level];
+
+        PyramidPushConstants pushConstants = {};
+        pushConstants.srcAddress = pyramidAddress + (VkDeviceAddress) src.x * sizeof(float);
+        pushConstants.dstAddress = pyramidAddress + (VkDeviceAddress) dst.x * sizeof(float);
+        pushConstants.srcWidth = src.y;
+        pushConstants.srcHeight = src.z;
+        pushConstants.dstWidth = dst.y;
+        pushConstants.dstHeight = dst.z;
+
+        driver->CmdPushConstants(&pushConstants, sizeof(pushConstants));
+        driver->CmdDispatch((dst.y + PYRAMID_WORKGROUP_SIZE - 1) / PYRAMID_WORKGROUP_SIZE,
+                            (dst.z + PYRAMID_WORKGROUP_SIZE - 1) / PYRAMID_WORKGROUP_SIZE, 1);
+
+        driver->CmdMemoryBarrier(
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+
+    driver->TouchBuffer(pyramidBuffer);
+    pyramidValid = true;
+
+    return VK_SUCCESS;
+}
+
+VkResult GpuCulling::_Dispatch(const glm::mat4& viewProjection, uint32_t phase)
+{
+    VkResult err;
+
+    /* 两个阶段的命令和计数各占一半，late 阶段不会覆盖 early 阶段还要用的命令 */
+    const VkDeviceAddress drawOffset = (VkDeviceAddress) phase * maxObjects * sizeof(VkDrawIndexedIndirectCommand);
+    const VkDeviceAddress countOffset = (VkDeviceAddress) phase * sizeof(uint32_t);
+
+    TransientBuffer paramsBuffer = {};
+    err = driver->AllocateTransient(sizeof(CullParams), 16, &paramsBuffer);
+    VK_CHECK_ERROR(err);
+
+    Frustum frustum = ExtractFrustum(viewProjection);
+
+    CullParams *params = (CullParams *) paramsBuffer.pMapped;
+    params->viewProjection = viewProjection;
+    memcpy(params->frustumPlanes, frustum.planes, sizeof(frustum.planes));
+    memcpy(params->pyramidLevels, pyramidLevels, sizeof(pyramidLevels));
+    params->objectAddress = driver->GetBufferAddress(objectBuffer);
+    params->drawAddress = driver->GetBufferAddress(drawBuffer) + drawOffset;
+    params->countAddress = driver->GetBufferAddress(countBuffer) + countOffset;
+    params->visibilityAddress = driver->GetBufferAddress(visibilityBuffer);
+    params->pyramidAddress = pyramidValid ? driver->GetBufferAddress(pyramidBuffer) : 0;
+    params->objectCount = objectHighWater;
+    params->compact = compact ? 1 : 0;
+    params->phase = phase;
+    params->pyramidLevelCount = pyramidValid ? pyramidLevelCount : 0;
+    params->lodAddress = driver->GetBufferAddress(lodBuffer);
+    params->lodScale = lodPixelError > 0.0f ? lodProjectionScale * driver->GetRenderExtent().height * 0.5f : 0.0f;
+    params->lodPixelError = lodPixelError;
+
+    CullPushConstants pushConstants = {};
+    pushConstants.paramsAddress = paramsBuffer.address;
+
+    driver->CmdBindPipeline(cullPipeline);
+    driver->CmdPushConstants(&pushConstants, sizeof(pushConstants));
+    driver->CmdDispatch((objectHighWater + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+
+    /* 只通过地址访问，驱逐和碎片整理需要知道这一帧用到了 */
+    driver->TouchBuffer(objectBuffer);
+    driver->TouchBuffer(visibilityBuffer);
+    driver->TouchBuffer(lodBuffer);
+    if (pyramidValid)
+        driver->TouchBuffer(pyramidBuffer);
+
+    driver->CmdMemoryBarrier(
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+
+    return VK_SUCCESS;
+}
+
+void GpuCulling::_Draw(const glm::mat4& viewProjection, uint32_t phase)
+{
+    if (objectHighWater == 0)
+        return;
+
+    DrawPushConstants pushConstants = {};
+    pushConstants.viewProjection = viewProjection;
+    pushConstants.objectAddress = driver->GetBufferAddress(objectBuffer);
+    pushConstants.vertexAddress = driver->GetBufferAddress(geometry->GetVertexBuffer());
+    pushConstants.vertexStride = geometry->GetVertexStride() / sizeof(uint32_t);
+
+    driver->CmdBindPipeline(depthPrepass ? depthPipeline : drawPipeline);
+    driver->CmdPushConstants(&pushConstants, sizeof(pushConstants));
+    geometry->CmdBindBuffers();
+
+    _DrawCommands(phase);
+
+    /* 同一批间接命令再画一遍，push constant 和顶点 buffer 在切换 pipeline 后依然有效 */
+    if (depthPrepass) {
+        driver->CmdBindPipeline(shadePipeline);
+        _DrawCommands(phase);
+    }
+}
+
+void GpuCulling::_DrawCommands(uint32_t phase)
+{
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    const VkDeviceSize drawOffset = (VkDeviceSize) phase * maxObjects * stride;
+    const VkDeviceSize countOffset = (VkDeviceSize) phase * sizeof(uint32_t);
+
+    if (compact)
+        driver->CmdDrawIndexedIndirectCount(drawBuffer, drawOffset, countBuffer, countOffset, objectHighWater, stride);
+    else
+        driver->CmdDrawIndexedIndirect(drawBuffer, drawOffset, objectHighWater, stride);
+}
+
+VkResult GpuCulling::_CreatePyramid(VkExtent2D extent)
+{
+    VkResult err;
+
+    /* 旧的金字塔可能还在被在途的帧使用，交给驱动延迟销毁 */
+    if (pyramidBuffer.id != 0) {
+        driver->DestroyBuffer(pyramidBuffer);
+        pyramidBuffer = {};
+    }
+
+    pyramidValid = false;
+    pyramidExtent = {};
+    pyramidLevelCount = 0;
+    memset(pyramidLevels, 0, sizeof(pyramidLevels));
+
+    /* 第 0 层就是深度本身，之后每层宽高向上取整减半直到 1x1，所有层级首尾相接 */
+    uint32_t width = extent.width;
+    uint32_t height = extent.height;
+    uint32_t offset = 0;
+
+    while (pyramidLevelCount < MAX_PYRAMID_LEVELS) {
+        pyramidLevels[pyramidLevelCount++] = glm::uvec4(offset, width, height, 0);
+        offset += width * height;
+
+        if (width == 1 && height == 1)
+            break;
+
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+
+    err = driver->CreateBuffer((size_t) offset * sizeof(float),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, &pyramidBuffer);
+    VK_CHECK_ERROR(err);
+
+    driver->SetBufferName(pyramidBuffer, "culling/depth pyramid");
+    pyramidExtent = extent;
+
+    printf("[culling] depth pyramid %ux%u, %u levels\n", extent.width, extent.height, pyramidLevelCount);
+
+    return err;
+}
+
+void GpuCulling::_MarkDirty(uint32_t slot)
+{
+    dirtyBegin = std::min(dirtyBegin, slot);
+    dirtyEnd = std::max(dirtyEnd, slot + 1);
+}
+
+void GpuCulling::_RefreshMeshRanges()
+{
+    for (uint32_t slot : objectHandles.GetLiveSlots()) {
+        VkDrawIndexedIndirectCommand command = geometry->GetDrawCommand(meshes[slot]);
+        objects[slot].firstIndex = command.firstIndex;
+        objects[slot].vertexOffset = command.vertexOffset;
+        _MarkDirty(slot);
+    }
+}
+
+uint32_t GpuCulling::_GetObjectSlot(CullObject object) const
+{
+    assert(objectHandles.IsValid(object.id));
+    return HandlePool::IndexOf(object.id);
+}
@@ -0,0 +1,173 @@
+#ifndef GPU_CULLING_H_
+#define GPU_CULLING_H_
+
+#include "driver/render_driver.h"
+#include "render/geometry_manager.h"
+
+#include <glm/glm.hpp>
+
+// std
+#include <vector>
+
+/* 和 cull.comp、indirect.vert 中的 GpuObject 保持一致，std430 布局 */
+typedef struct GpuObject {
+    glm::mat4 model;
+    glm::vec4 boundingSphere;       // 模型空间的中心和半径
+    uint32_t firstIndex;
+    uint32_t indexCount;            // 为 0 表示空位，shader 直接跳过
+    int32_t vertexOffset;
+    uint32_t vertexFormat;          // VertexFormat，只有顶点拉取的 shader 使用
+} GpuObject;
+
+static_assert(sizeof(GpuObject) == 96, "GpuObject must match the std430 layout in cull.comp");
+
+#define MAX_PYRAMID_LEVELS 16     // 和 cull.comp 一致，足够覆盖 65536 的边长
+
+/* 每个物体的 LOD 表，x 为相对 firstIndex 的偏移，y 为索引个数（0 表示没有这一级），z 为误差的位模式 */
+typedef struct GpuObjectLods {
+    glm::uvec4 levels[MAX_MESH_LODS];
+} GpuObjectLods;
+
+typedef struct CullObject {
+    uint32_t id = 0;
+    bool operator==(const CullObject&) const = default;
+} CullObject;
+
+/*
+ * GPU 驱动的绘制：物体的包围球和 draw 参数常驻在 storage buffer 里，
+ * compute pass 做视锥剔除并写出间接绘制命令，图形 pass 一次 vkCmdDrawIndexedIndirectCount 画完，
+ * CPU 每帧的开销和物体数量无关。只能在主线程使用。
+ *
+ * 遮挡剔除分两个阶段，一帧的顺序是：
+ *   CmdCull -> BeginRendering -> CmdDraw -> EndRendering
+ *   -> CmdCullLate -> ResumeRendering -> CmdDrawLate -> EndRendering -> CmdBuildDepthPyramid
+ * 只用 CmdCull/CmdDraw 时不要调用 CmdBuildDepthPyramid，没有金字塔就只做视锥剔除。
+ */
+class GpuCulling
+{
+public:
+    GpuCulling(RenderDriver *driver, GeometryManager *geometry, uint32_t maxObjects);
+   ~GpuCulling();
+
+    VkResult Initialize();
+
+    /* 没有开启顶点拉取时只接受 VERTEX_FORMAT_FLOAT 的 mesh，否则返回 VK_ERROR_FORMAT_NOT_SUPPORTED */
+    VkResult AddObject(Mesh mesh, const glm::vec4& boundingSphere, const glm::mat4& model, CullObject *pObject);
+    void RemoveObject(CullObject object);
+    void SetTransform(CullObject object, const glm::mat4& model);
+
+    /* 上传改动并执行剔除，在 BeginRendering 之前调用 */
+    VkResult CmdCull(const glm::mat4& viewProjection);
+    /* 在 BeginRendering 之后调用，使用 CmdCull 生成的命令 */
+    void CmdDraw(const glm::mat4& viewProjection);
+    /* 在 EndRendering 之后调用，用 early 阶段画出的深度重建金字塔，重新测试被遮挡的物体 */
+    VkResult CmdCullLate(const glm::mat4& viewProjection);
+    /* 在 ResumeRendering 之后调用，补画 late 阶段判定可见的物体 */
+    void CmdDrawLate(const glm::mat4& viewProjection);
+    /* 一帧画完之后调用，金字塔留给下一帧的 early 阶段 */
+    VkResult CmdBuildDepthPyramid();
+
+    /*
+     * 按屏幕误差在 cull shader 里选 LOD：projectionScaleY 是 projection[1][1]，
+     * 简化误差投影到屏幕不超过 pixelError 个像素时用更粗的一级，pixelError 为 0 时总是画第 0 级。
+     */
+    void SetLodSelection(float projectionScaleY, float pixelError) { lodProjectionScale = projectionScaleY; lodPixelError = pixelError; }
+    /* 在 Initialize 之前调用：不用固定的顶点输入，按物体的 vertexFormat 在 shader 里解码，不同格式的 mesh 可以一起画 */
+    void SetVertexPulling(bool enable) { vertexPulling = enable; }
+    /* 开启后 CmdDraw/CmdDrawLate 先画一遍只写深度，再以 EQUAL 比较着色，减少 overdraw */
+    void SetDepthPrepass(bool enable) { depthPrepass = enable; }
+
+    uint32_t GetObjectCount() const { return objectHandles.GetLiveCount(); }
+
+private:
+    /* 和 cull.comp 的 CullParams 一致，超过 PUSH_CONSTANT_SIZE，每次剔除写到临时内存里 */
+    struct CullParams {
+        glm::mat4 viewProjection;
+        glm::vec4 frustumPlanes[6];
+        glm::uvec4 pyramidLevels[MAX_PYRAMID_LEVELS];
+        VkDeviceAddress objectAddress;
+        VkDeviceAddress drawAddress;
+        VkDeviceAddress countAddress;
+        VkDeviceAddress visibilityAddress;
+        VkDeviceAddress pyramidAddress;
+        uint32_t objectCount;
+        uint32_t compact;
+        uint32_t phase;
+        uint32_t pyramidLevelCount;
+        VkDeviceAddress lodAddress;
+        float lodScale;                             // projection[1][1] * 视口高度 / 2，0 表示不选 LOD
+        float lodPixelError;
+    };
+
+    static_assert(sizeof(CullParams) == 488, "CullParams must match the std430 layout in cull.comp");
+
+    struct CullPushConstants {
+        VkDeviceAddress paramsAddress;
+    };
+
+    struct PyramidPushConstants {
+        VkDeviceAddress srcAddress;
+        VkDeviceAddress dstAddress;
+        uint32_t srcWidth;
+        uint32_t srcHeight;
+        uint32_t dstWidth;
+        uint32_t dstHeight;
+    };
+
+    /* indirect.vert 只用前两个成员，pulled.vert 还要顶点 buffer 的地址 */
+    struct DrawPushConstants {
+        glm::mat4 viewProjection;
+        VkDeviceAddress objectAddress;
+        VkDeviceAddress vertexAddress;
+        uint32_t vertexStride;                      // megabuffer 的顶点大小，单位是 uint
+    };
+
+    VkResult _Dispatch(const glm::mat4& viewProjection, uint32_t phase);
+    void _Draw(const glm::mat4& viewProjection, uint32_t phase);
+    void _DrawCommands(uint32_t phase);
+    VkResult _CreatePyramid(VkExtent2D extent);
+    void _MarkDirty(uint32_t slot);
+    void _RefreshMeshRanges();
+    uint32_t _GetObjectSlot(CullObject object) const;
+
+    RenderDriver *driver = VK_NULL_HANDLE;
+    GeometryManager *geometry = VK_NULL_HANDLE;
+    uint32_t maxObjects = 0;
+    bool compact = false;
+    bool depthPrepass = false;
+    bool vertexPulling = false;
+    float lodProjectionScale = 0.0f;
+    float lodPixelError = 0.0f;
+
+    Pipeline cullPipeline = {};
+    Pipeline drawPipeline = {};
+    Pipeline depthPipeline = {};                    // 深度预渲染，没有 fragment shader
+    Pipeline shadePipeline = {};                    // 预渲染之后着色，不写深度
+    Pipeline pyramidPipeline = {};
+    Buffer objectBuffer = {};
+    Buffer drawBuffer = {};                         // early 和 late 两份命令，各 maxObjects 条
+    Buffer countBuffer = {};
+    Buffer visibilityBuffer = {};
+    Buffer lodBuffer = {};
+
+    // 深度金字塔，尺寸跟随渲染分辨率
+    Buffer pyramidBuffer = {};
+    VkExtent2D pyramidExtent = {};
+    uint32_t pyramidLevelCount = 0;
+    glm::uvec4 pyramidLevels[MAX_PYRAMID_LEVELS] = {};
+    bool pyramidValid = false;                      // 已经用上一帧的深度构建过
+    bool lateActive = false;                        // 本帧 early 阶段做了遮挡测试，需要 late 阶段
+
+    // 按 slot 下标存放，和 GPU 上的 object buffer 一一对应
+    HandlePool objectHandles;
+    std::vector<GpuObject> objects;
+    std::vector<GpuObjectLods> objectLods;
+    std::vector<Mesh> meshes;
+
+    uint32_t objectHighWater = 0;                   // 需要 dispatch 的物体个数
+    uint32_t dirtyBegin = UINT32_MAX;
+    uint32_t dirtyEnd = 0;
+    uint32_t geometryCompactions = 0;
+};
+
+#endif /* GPU_CULLING_H_ */
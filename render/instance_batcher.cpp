@@ -0,0 +1,94 @@
+#include "instance_batcher.h"
+
+#include <algorithm>
+
+#define VK_CHECK_ERROR(err) \
+    if (err != VK_SUCCESS) \
+        return err;
+
+InstanceBatcher::InstanceBatcher(RenderDriver *driver, GeometryManager *geometry)
+    : driver(driver), geometry(geometry)
+{
+
+}
+
+InstanceBatcher::~InstanceBatcher()
+{
+
+}
+
+void InstanceBatcher::Add(Pipeline pipeline, Mesh mesh, const glm::mat4& model)
+{
+    Instance instance = {};
+    instance.key = ((uint64_t) pipeline.id << 32) | mesh.id;
+    instance.index = (uint32_t) transforms.size();
+
+    instances.push_back(instance);
+    transforms.push_back(model);
+}
+
+VkResult InstanceBatcher::Flush(const glm::mat4& viewProjection)
+{
+    VkResult err = VK_SUCCESS;
+
+    stats = {};
+
+    if (instances.empty())
+        return err;
+
+    /* 相同 key 的实例排到一起，同一个 pipeline 的各个 mesh 也相邻，减少 pipeline 切换 */
+    std::sort(instances.begin(), instances.end(), [](const Instance& a, const Instance& b) {
+        return a.key != b.key ? a.key < b.key : a.index < b.index;
+    });
+
+    TransientBuffer instanceBuffer = {};
+    err = driver->AllocateTransient(instances.size() * sizeof(glm::mat4), 16, &instanceBuffer);
+    if (err != VK_SUCCESS) {
+        instances.clear();
+        transforms.clear();
+        return err;
+    }
+
+    glm::mat4 *mapped = (glm::mat4 *) instanceBuffer.pMapped;
+    for (size_t i = 0; i < instances.size(); i++)
+        mapped[i] = transforms[instances[i].index];
+
+    PushConstants pushConstants = {};
+    pushConstants.viewProjection = viewProjection;
+
+    geometry->CmdBindBuffers();
+    driver->CmdBindVertexBuffer(instanceBuffer, 1);
+
+    uint32_t boundPipeline = 0;
+
+    for (uint32_t first = 0; first < (uint32_t) instances.size();) {
+        const uint64_t key = instances[first].key;
+
+        uint32_t last = first + 1;
+        while (last < (uint32_t) instances.size() && instances[last].key == key)
+            last++;
+
+        Pipeline pipeline = { (uint32_t) (key >> 32) };
+        Mesh mesh = { (uint32_t) key };
+
+        if (pipeline.id != boundPipeline) {
+            driver->CmdBindPipeline(pipeline);
+            driver->CmdPushConstants(&pushConstants, sizeof(pushConstants));
+            boundPipeline = pipeline.id;
+        }
+
+        /* instance rate 的属性从 firstInstance 开始取，整帧只需要绑定一次 instance buffer */
+        VkDrawIndexedIndirectCommand command = geometry->GetDrawCommand(mesh, last - first, first);
+        driver->CmdDrawIndexed(command.indexCount, command.instanceCount, command.firstIndex, command.vertexOffset, command.firstInstance);
+
+        stats.drawCount++;
+        first = last;
+    }
+
+    stats.instanceCount = (uint32_t) instances.size();
+
+    instances.clear();
+    transforms.clear();
+
+    return err;
+}
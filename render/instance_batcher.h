@@ -0,0 +1,56 @@
+#ifndef INSTANCE_BATCHER_H_
+#define INSTANCE_BATCHER_H_
+
+#include "driver/render_driver.h"
+#include "render/geometry_manager.h"
+
+#include <glm/glm.hpp>
+
+// std
+#include <vector>
+
+typedef struct InstanceStats {
+    uint32_t instanceCount = 0;
+    uint32_t drawCount = 0;         // 实际发出的 vkCmdDrawIndexed 次数
+} InstanceStats;
+
+/*
+ * 把同一个 pipeline + mesh 的物体合并成一次 instanced draw：每帧 Add 收集变换，
+ * Flush 按 (pipeline, mesh) 排序分组，所有变换写进同一块临时内存绑定到 binding 1，
+ * 每组用 firstInstance 指向自己的那一段。pipeline 必须以 VERTEX_LAYOUT_INSTANCED 创建，
+ * 顶点着色器从 location 2~5 读 model 矩阵，push constant 是 viewProjection（参考 instanced.vert）。
+ * 只能在主线程使用。
+ */
+class InstanceBatcher
+{
+public:
+    InstanceBatcher(RenderDriver *driver, GeometryManager *geometry);
+   ~InstanceBatcher();
+
+    void Add(Pipeline pipeline, Mesh mesh, const glm::mat4& model);
+    /* 在 BeginRendering 之后调用，画完清空本帧收集的实例 */
+    VkResult Flush(const glm::mat4& viewProjection);
+
+    InstanceStats GetStats() const { return stats; }
+
+private:
+    struct Instance {
+        uint64_t key;               // pipeline 在高 32 位，mesh 在低 32 位
+        uint32_t index;             // 在 transforms 里的下标
+    };
+
+    struct PushConstants {
+        glm::mat4 viewProjection;
+    };
+
+    RenderDriver *driver = VK_NULL_HANDLE;
+    GeometryManager *geometry = VK_NULL_HANDLE;
+
+    // 每帧重用，避免反复分配
+    std::vector<Instance> instances;
+    std::vector<glm::mat4> transforms;
+
+    InstanceStats stats = {};       // 上一次 Flush 的统计
+};
+
+#endif /* INSTANCE_BATCHER_H_ */
@@ -0,0 +1,348 @@
+#include "mesh_lod.h"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <queue>
+#include <unordered_map>
+
+#define LOD_BOUNDARY_WEIGHT 10.0    // 边界的约束平面比普通面更重，轮廓不会往里缩
+#define LOD_MIN_REDUCTION 0.9f      // 一级 LOD 至少要减少 10% 的索引
+
+/* 对称矩阵 A、向量 b 和常数 c，误差 = (x^T A x + 2 b.x + c) / w，用 double 避免累加后的精度问题 */
+typedef struct Quadric {
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c;
+    double w;
+} Quadric;
+
+typedef struct Collapse {
+    float cost;
+    uint32_t from;
+    uint32_t to;
+
+    bool operator>(const Collapse& other) const { return cost > other.cost; }
+} Collapse;
+
+static glm::vec3 GetPosition(const void *positions, size_t positionStride, uint32_t index)
+{
+    const float *p = (const float *) ((const uint8_t *) positions + positionStride * index);
+    return glm::vec3(p[0], p[1], p[2]);
+}
+
+static void AddPlane(Quadric *q, const glm::vec3& n, float d, double weight)
+{
+    q->a00 += weight * n.x * n.x;
+    q->a01 += weight * n.x * n.y;
+    q->a02 += weight * n.x * n.z;
+    q->a11 += weight * n.y * n.y;
+    q->a12 += weight * n.y * n.z;
+    q->a22 += weight * n.z * n.z;
+    q->b0 += weight * n.x * d;
+    q->b1 += weight * n.y * d;
+    q->b2 += weight * n.z * d;
+    q->c += weight * d * d;
+    q->w += weight;
+}
+
+static void AddQuadric(Quadric *q, const Quadric& other)
+{
+    q->a00 += other.a00;
+    q->a01 += other.a01;
+    q->a02 += other.a02;
+    q->a11 += other.a11;
+    q->a12 += other.a12;
+    q->a22 += other.a22;
+    q->b0 += other.b0;
+    q->b1 += other.b1;
+    q->b2 += other.b2;
+    q->c += other.c;
+    q->w += other.w;
+}
+
+/* 返回到所有平面的加权平均平方距离 */
+static float EvaluateQuadric(const Quadric& q, const glm::vec3& v)
+{
+    if (q.w <= 0.0)
+        return 0.0f;
+
+    double x = v.x, y = v.y, z = v.z;
+    double r = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z
+             + 2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z)
+             + 2.0 * (q.b0 * x + q.b1 * y + q.b2 * z)
+             + q.c;
+
+    return (float) std::max(r / q.w, 0.0);
+}
+
+static uint64_t EdgeKey(uint32_t a, uint32_t b)
+{
+    return a < b ? ((uint64_t) a << 32) | b : ((uint64_t) b << 32) | a;
+}
+
+void SimplifyMesh(const void *positions, size_t positionStride, uint32_t vertexCount,
+                  const uint32_t *indices, uint32_t indexCount, uint32_t targetIndexCount, float maxError,
+                  std::vector<uint32_t> *pIndices, float *pError)
+{
+    pIndices->clear();
+    *pError = 0.0f;
+
+    /* 位置相同的顶点焊到第一次出现的那个上，之后只在焊接后的顶点上操作 */
+    struct PositionHash {
+        size_t operator()(const glm::vec3& p) const {
+            uint32_t bits[3];
+            memcpy(bits, &p, sizeof(bits));
+            return (size_t) (bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+        }
+    };
+
+    std::unordered_map<glm::vec3, uint32_t, PositionHash> firstByPosition;
+    std::vector<uint32_t> weld(vertexCount);
+    std::vector<glm::vec3> points(vertexCount);
+
+    for (uint32_t v = 0; v < vertexCount; v++) {
+        points[v] = GetPosition(positions, positionStride, v);
+        weld[v] = firstByPosition.emplace(points[v], v).first->second;
+    }
+
+    std::vector<uint32_t> triangles;
+    triangles.reserve(indexCount);
+
+    for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+        uint32_t a = weld[indices[i]], b = weld[indices[i + 1]], c = weld[indices[i + 2]];
+        if (a != b && b != c && a != c)
+            triangles.insert(triangles.end(), { a, b, c });
+    }
+
+    const uint32_t triangleCount = (uint32_t) (std::size(triangles) / 3);
+    uint32_t liveTriangles = triangleCount;
+
+    std::vector<bool> triangleAlive(triangleCount, true);
+    std::vector<std::vector<uint32_t>> vertexTriangles(vertexCount);
+    std::vector<Quadric> quadrics(vertexCount, Quadric{});
+    std::unordered_map<uint64_t, uint32_t> edgeUses;
+
+    /* 每个三角形的平面按面积加权累加到三个顶点 */
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        const uint32_t *tri = &triangles[t * 3];
+        glm::vec3 n = glm::cross(points[tri[1]] - points[tri[0]], points[tri[2]] - points[tri[0]]);
+        float area2 = glm::length(n);
+
+        for (uint32_t k = 0; k < 3; k++) {
+            vertexTriangles[tri[k]].push_back(t);
+            edgeUses[EdgeKey(tri[k], tri[(k + 1) % 3])]++;
+        }
+
+        if (area2 <= 0.0f)
+            continue;
+
+        n /= area2;
+        for (uint32_t k = 0; k < 3; k++)
+            AddPlane(&quadrics[tri[k]], n, -glm::dot(n, points[tri[0]]), area2 * 0.5);
+    }
+
+    /* 只属于一个三角形的边是边界，加一个垂直于三角形、过这条边的平面 */
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        const uint32_t *tri = &triangles[t * 3];
+        glm::vec3 n = glm::cross(points[tri[1]] - points[tri[0]], points[tri[2]] - points[tri[0]]);
+
+        for (uint32_t k = 0; k < 3; k++) {
+            uint32_t a = tri[k], b = tri[(k + 1) % 3];
+            if (edgeUses[EdgeKey(a, b)] != 1)
+                continue;
+
+            glm::vec3 edge = points[b] - points[a];
+            glm::vec3 bn = glm::cross(edge, n);
+            float length = glm::length(bn);
+            if (length <= 0.0f)
+                continue;
+
+            bn /= length;
+            double weight = LOD_BOUNDARY_WEIGHT * glm::dot(edge, edge);
+            AddPlane(&quadrics[a], bn, -glm::dot(bn, points[a]), weight);
+            AddPlane(&quadrics[b], bn, -glm::dot(bn, points[a]), weight);
+        }
+    }
+
+    auto collapseCost = [&](uint32_t from, uint32_t to) {
+        Quadric q = quadrics[from];
+        AddQuadric(&q, quadrics[to]);
+        return EvaluateQuadric(q, points[to]);
+    };
+
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+
+    auto pushEdge = [&](uint32_t a, uint32_t b) {
+        float ab = collapseCost(a, b);
+        float ba = collapseCost(b, a);
+        heap.push(ab <= ba ? Collapse{ ab, a, b } : Collapse{ ba, b, a });
+    };
+
+    for (const auto& [key, uses] : edgeUses)
+        pushEdge((uint32_t) (key >> 32), (uint32_t) key);
+
+    std::vector<bool> removed(vertexCount, false);
+    const float maxCost = maxError < FLT_MAX ? maxError * maxError : FLT_MAX;
+    float appliedCost = 0.0f;
+
+    while (!heap.empty() && liveTriangles * 3 > targetIndexCount) {
+        Collapse collapse = heap.top();
+        heap.pop();
+
+        if (collapse.cost > maxCost)
+            break;
+
+        if (removed[collapse.from] || removed[collapse.to])
+            continue;
+
+        /* 堆里的代价可能已经过时，重新计算，变大了就放回去按新代价排序 */
+        float cost = collapseCost(collapse.from, collapse.to);
+        if (cost > collapse.cost * 1.0001f + FLT_MIN) {
+            heap.push(Collapse{ cost, collapse.from, collapse.to });
+            continue;
+        }
+
+        /* 边可能已经随着别的折叠消失了 */
+        bool connected = false;
+        for (uint32_t t : vertexTriangles[collapse.from]) {
+            const uint32_t *tri = &triangles[t * 3];
+            if (triangleAlive[t] && (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to)) {
+                connected = true;
+                break;
+            }
+        }
+
+        if (!connected)
+            continue;
+
+        /* 折叠后法线翻转的三角形会在表面上折出褶皱，放弃这次折叠 */
+        bool flips = false;
+        for (uint32_t t : vertexTriangles[collapse.from]) {
+            const uint32_t *tri = &triangles[t * 3];
+            if (!triangleAlive[t] || tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to)
+                continue;
+
+            glm::vec3 p[3], q[3];
+            for (uint32_t k = 0; k < 3; k++) {
+                p[k] = points[tri[k]];
+                q[k] = tri[k] == collapse.from ? points[collapse.to] : p[k];
+            }
+
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+            if (glm::dot(before, after) <= 0.0f) {
+                flips = true;
+                break;
+            }
+        }
+
+        if (flips)
+            continue;
+
+        AddQuadric(&quadrics[collapse.to], quadrics[collapse.from]);
+        removed[collapse.from] = true;
+        appliedCost = std::max(appliedCost, cost);
+
+        for (uint32_t t : vertexTriangles[collapse.from]) {
+            if (!triangleAlive[t])
+                continue;
+
+            uint32_t *tri = &triangles[t * 3];
+            if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to) {
+                triangleAlive[t] = false;
+                liveTriangles--;
+                continue;
+            }
+
+            for (uint32_t k = 0; k < 3; k++) {
+                if (tri[k] == collapse.from)
+                    tri[k] = collapse.to;
+            }
+
+            vertexTriangles[collapse.to].push_back(t);
+        }
+
+        vertexTriangles[collapse.from].clear();
+
+        /* 合并后的顶点周围的边代价都变了 */
+        for (uint32_t t : vertexTriangles[collapse.to]) {
+            if (!triangleAlive[t])
+                continue;
+
+            const uint32_t *tri = &triangles[t * 3];
+            for (uint32_t k = 0; k < 3; k++) {
+                if (tri[k] != collapse.to)
+                    pushEdge(collapse.to, tri[k]);
+            }
+        }
+    }
+
+    pIndices->reserve((size_t) liveTriangles * 3);
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        if (triangleAlive[t])
+            pIndices->insert(pIndices->end(), { triangles[t * 3], triangles[t * 3 + 1], triangles[t * 3 + 2] });
+    }
+
+    *pError = sqrtf(appliedCost);
+}
+
+void BuildMeshLods(const void *positions, size_t positionStride, uint32_t vertexCount,
+                   const uint32_t *indices, uint32_t indexCount,
+                   std::vector<uint32_t> *pIndices, std::vector<MeshLod> *pLods)
+{
+    pIndices->assign(indices, indices + indexCount);
+    pLods->clear();
+
+    MeshLod base = {};
+    base.indexOffset = 0;
+    base.indexCount = indexCount;
+    base.error = 0.0f;
+    pLods->push_back(base);
+
+    std::vector<uint32_t> current(indices, indices + indexCount);
+    std::vector<uint32_t> next;
+    float error = 0.0f;
+
+    while (std::size(*pLods) < MAX_MESH_LODS) {
+        uint32_t currentCount = (uint32_t) std::size(current);
+        uint32_t target = currentCount / 6 * 3;
+
+        float lodError = 0.0f;
+        SimplifyMesh(positions, positionStride, vertexCount, std::data(current), currentCount, target, FLT_MAX, &next, &lodError);
+
+        if (std::empty(next) || (float) std::size(next) > (float) currentCount * LOD_MIN_REDUCTION)
+            break;
+
+        /* 每级以上一级为输入，误差累加是相对原始网格的上界 */
+        error += lodError;
+
+        MeshLod lod = {};
+        lod.indexOffset = (uint32_t) std::size(*pIndices);
+        lod.indexCount = (uint32_t) std::size(next);
+        lod.error = error;
+        pLods->push_back(lod);
+
+        pIndices->insert(pIndices->end(), next.begin(), next.end());
+        current.swap(next);
+    }
+}
+
+uint32_t SelectMeshLod(const MeshLod *lods, uint32_t lodCount, float distance, float scale, float projectionScale, float pixelError)
+{
+    /* 相机在包围球里面时总是用最精细的一级 */
+    if (distance <= 0.0f)
+        return 0;
+
+    uint32_t lod = 0;
+    for (uint32_t i = 1; i < lodCount; i++) {
+        float pixels = lods[i].error * scale * projectionScale / distance;
+        if (pixels > pixelError)
+            break;
+
+        lod = i;
+    }
+
+    return lod;
+}
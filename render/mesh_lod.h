@@ -0,0 +1,43 @@
+#ifndef MESH_LOD_H_
+#define MESH_LOD_H_
+
+#include <glm/glm.hpp>
+
+// std
+#include <stdint.h>
+#include <vector>
+
+#define MAX_MESH_LODS 8             // 和 cull.comp 一致
+
+/* 一级 LOD 的索引范围，所有级别共用 mesh 的顶点，索引首尾相接放在 mesh 的索引范围里 */
+typedef struct MeshLod {
+    uint32_t indexOffset = 0;       // 相对 mesh 的 firstIndex
+    uint32_t indexCount = 0;
+    float error = 0.0f;             // 相对原始网格的几何误差，模型空间的距离
+} MeshLod;
+
+/*
+ * 二次误差度量（QEM）的边折叠简化：只把顶点折叠到已有的顶点上，输出的索引依然引用原来的顶点，
+ * 所以各级 LOD 可以共用同一段顶点数据。位置完全相同的顶点（比如颜色不同的硬边）先焊在一起再简化，不会裂开。
+ * 折叠到 targetIndexCount 或者误差超过 maxError 为止，pError 返回实际的最大误差。
+ */
+void SimplifyMesh(const void *positions, size_t positionStride, uint32_t vertexCount,
+                  const uint32_t *indices, uint32_t indexCount, uint32_t targetIndexCount, float maxError,
+                  std::vector<uint32_t> *pIndices, float *pError);
+
+/*
+ * 生成 LOD 链：第 0 级是原始索引，之后每级以上一级为输入把三角形减半，
+ * 减少不到 10% 或者达到 MAX_MESH_LODS 时停止。pIndices 是所有级别首尾相接的索引。
+ */
+void BuildMeshLods(const void *positions, size_t positionStride, uint32_t vertexCount,
+                   const uint32_t *indices, uint32_t indexCount,
+                   std::vector<uint32_t> *pIndices, std::vector<MeshLod> *pLods);
+
+/*
+ * 按屏幕上的误差选择 LOD：误差投影到屏幕不超过 pixelError 个像素的最粗的一级。
+ * distance 是到包围球最近处的相机空间深度，scale 是模型矩阵最大的轴向缩放，
+ * projectionScale 是 projection[1][1] * 视口高度 / 2。
+ */
+uint32_t SelectMeshLod(const MeshLod *lods, uint32_t lodCount, float distance, float scale, float projectionScale, float pixelError);
+
+#endif /* MESH_LOD_H_ */
@@ -0,0 +1,141 @@
+#include "meshlet_builder.h"
+
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+
+/* 法线锥的半角超过这个余弦值就不可能整体背向相机，不值得测试 */
+#define MESHLET_CONE_MIN_DOT 0.1f
+
+static glm::vec3 GetPosition(const void *positions, size_t positionStride, uint32_t index)
+{
+    const float *p = (const float *) ((const uint8_t *) positions + positionStride * index);
+    return glm::vec3(p[0], p[1], p[2]);
+}
+
+static void ComputeMeshletBounds(const void *positions, size_t positionStride, const MeshletData *pData, Meshlet *pMeshlet)
+{
+    const uint32_t *vertices = &pData->vertices[pMeshlet->vertexOffset];
+    const uint32_t *triangles = &pData->triangles[pMeshlet->triangleOffset];
+
+    /* 包围球取包围盒中心，半径是到最远顶点的距离 */
+    glm::vec3 minPosition = GetPosition(positions, positionStride, vertices[0]);
+    glm::vec3 maxPosition = minPosition;
+
+    for (uint32_t i = 1; i < pMeshlet->vertexCount; i++) {
+        glm::vec3 position = GetPosition(positions, positionStride, vertices[i]);
+        minPosition = glm::min(minPosition, position);
+        maxPosition = glm::max(maxPosition, position);
+    }
+
+    glm::vec3 center = (minPosition + maxPosition) * 0.5f;
+    float radius = 0.0f;
+
+    for (uint32_t i = 0; i < pMeshlet->vertexCount; i++)
+        radius = std::max(radius, glm::length(GetPosition(positions, positionStride, vertices[i]) - center));
+
+    pMeshlet->boundingSphere = glm::vec4(center, radius);
+
+    /* 法线锥：轴是三角形法线的平均方向，半角由偏离轴最远的法线决定 */
+    glm::vec3 normals[MESHLET_MAX_TRIANGLES];
+    uint32_t normalCount = 0;
+    glm::vec3 axis = glm::vec3(0.0f);
+
+    for (uint32_t i = 0; i < pMeshlet->triangleCount; i++) {
+        uint32_t packed = triangles[i];
+        glm::vec3 p0 = GetPosition(positions, positionStride, vertices[packed & 0xFF]);
+        glm::vec3 p1 = GetPosition(positions, positionStride, vertices[(packed >> 8) & 0xFF]);
+        glm::vec3 p2 = GetPosition(positions, positionStride, vertices[(packed >> 16) & 0xFF]);
+
+        glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(normal);
+
+        /* 退化三角形没有方向，不参与计算 */
+        if (length == 0.0f)
+            continue;
+
+        normals[normalCount] = normal / length;
+        axis += normals[normalCount];
+        normalCount++;
+    }
+
+    pMeshlet->cone = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+    float axisLength = glm::length(axis);
+    if (normalCount == 0 || axisLength == 0.0f)
+        return;
+
+    axis /= axisLength;
+
+    float minDot = 1.0f;
+    for (uint32_t i = 0; i < normalCount; i++)
+        minDot = std::min(minDot, glm::dot(axis, normals[i]));
+
+    if (minDot <= MESHLET_CONE_MIN_DOT)
+        return;
+
+    /*
+     * 视线和轴的夹角小于 90° 减去半角时所有三角形都背向相机，
+     * shader 里测试 dot(center - camera, axis) >= cutoff * |center - camera| + radius。
+     */
+    pMeshlet->cone = glm::vec4(axis, sqrtf(1.0f - minDot * minDot));
+}
+
+void BuildMeshlets(const void *positions, size_t positionStride, uint32_t vertexCount,
+                   const uint32_t *indices, uint32_t indexCount, MeshletData *pData)
+{
+    assert(indexCount % 3 == 0);
+
+    pData->meshlets.clear();
+    pData->vertices.clear();
+    pData->triangles.clear();
+
+    /* 顶点在当前 meshlet 中的局部下标，0xFF 表示还没加入 */
+    std::vector<uint8_t> localIndices(vertexCount, 0xFF);
+
+    Meshlet meshlet = {};
+
+    auto flush = [&]() {
+        if (meshlet.triangleCount == 0)
+            return;
+
+        ComputeMeshletBounds(positions, positionStride, pData, &meshlet);
+        pData->meshlets.push_back(meshlet);
+
+        for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+            localIndices[pData->vertices[meshlet.vertexOffset + i]] = 0xFF;
+
+        meshlet = {};
+        meshlet.vertexOffset = (uint32_t) pData->vertices.size();
+        meshlet.triangleOffset = (uint32_t) pData->triangles.size();
+    };
+
+    for (uint32_t i = 0; i < indexCount; i += 3) {
+        const uint32_t *triangle = &indices[i];
+
+        uint32_t newVertices = 0;
+        for (uint32_t j = 0; j < 3; j++)
+            newVertices += localIndices[triangle[j]] == 0xFF ? 1 : 0;
+
+        if (meshlet.vertexCount + newVertices > MESHLET_MAX_VERTICES || meshlet.triangleCount + 1 > MESHLET_MAX_TRIANGLES)
+            flush();
+
+        uint32_t packed = 0;
+        for (uint32_t j = 0; j < 3; j++) {
+            uint32_t vertex = triangle[j];
+            assert(vertex < vertexCount);
+
+            if (localIndices[vertex] == 0xFF) {
+                localIndices[vertex] = (uint8_t) meshlet.vertexCount++;
+                pData->vertices.push_back(vertex);
+            }
+
+            packed |= (uint32_t) localIndices[vertex] << (8 * j);
+        }
+
+        pData->triangles.push_back(packed);
+        meshlet.triangleCount++;
+    }
+
+    flush();
+}
@@ -0,0 +1,39 @@
+#ifndef MESHLET_BUILDER_H_
+#define MESHLET_BUILDER_H_
+
+#include <glm/glm.hpp>
+
+// std
+#include <stdint.h>
+#include <vector>
+
+#define MESHLET_MAX_VERTICES 64     // 和 meshlet.mesh 的 max_vertices 一致
+#define MESHLET_MAX_TRIANGLES 124   // 和 meshlet.mesh 的 max_primitives 一致
+
+/* 和 meshlet.task、meshlet.mesh 中的 Meshlet 保持一致，std430 布局 */
+typedef struct Meshlet {
+    glm::vec4 boundingSphere;       // 模型空间的中心和半径
+    glm::vec4 cone;                 // 法线锥的轴和 cutoff，cutoff 为 1 表示不做背面剔除
+    uint32_t vertexOffset;          // 在 MeshletData::vertices 中的起始下标
+    uint32_t triangleOffset;        // 在 MeshletData::triangles 中的起始下标
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+} Meshlet;
+
+static_assert(sizeof(Meshlet) == 48, "Meshlet must match the std430 layout in meshlet.task");
+
+typedef struct MeshletData {
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> vertices;     // 相对 mesh 第一个顶点的下标
+    std::vector<uint32_t> triangles;    // 每个三角形一个 uint，低 24 位依次是三个 meshlet 内的局部下标
+} MeshletData;
+
+/*
+ * 按索引顺序贪心地把三角形装进 meshlet，顶点或三角形数超出上限就开始新的一个，
+ * 索引最好先做过顶点缓存优化，相邻的三角形才会落在同一个 meshlet 里。
+ * positions 指向第一个顶点的位置，positionStride 是相邻顶点之间的字节数。
+ */
+void BuildMeshlets(const void *positions, size_t positionStride, uint32_t vertexCount,
+                   const uint32_t *indices, uint32_t indexCount, MeshletData *pData);
+
+#endif /* MESHLET_BUILDER_H_ */
@@ -0,0 +1,262 @@
+#include "meshlet_renderer.h"
+#include "frustum.h"
+#include "gpu_culling.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define VK_CHECK_ERROR(err) \
+    if (err != VK_SUCCESS) \
+        return err;
+
+#define MESHLET_TASK_GROUP_SIZE 32  // 和 meshlet.task 的 local_size_x 一致
+#define MESHLET_DATA_ALIGNMENT 16
+
+MeshletRenderer::MeshletRenderer(RenderDriver *driver, GeometryManager *geometry, VkDeviceSize capacity)
+    : driver(driver), geometry(geometry), capacity(capacity)
+{
+
+}
+
+MeshletRenderer::~MeshletRenderer()
+{
+    if (meshPipeline.id != 0)
+        driver->DestroyPipeline(meshPipeline);
+
+    if (fallbackPipeline.id != 0)
+        driver->DestroyPipeline(fallbackPipeline);
+
+    if (meshletBuffer.id != 0)
+        driver->DestroyBuffer(meshletBuffer);
+
+    if (meshletBlock != VK_NULL_HANDLE) {
+        vmaClearVirtualBlock(meshletBlock);
+        vmaDestroyVirtualBlock(meshletBlock);
+    }
+}
+
+VkResult MeshletRenderer::Initialize()
+{
+    VkResult err;
+
+    PipelineDesc desc = {};
+    desc.renderState.depthTestEnable = VK_TRUE;
+    desc.renderState.depthWriteEnable = VK_TRUE;
+
+    /* 不支持 mesh shader 时不需要 meshlet 数据，整个 mesh 用 GpuCulling 的顶点着色器画 */
+    meshShaderPath = driver->IsMeshShaderSupported();
+
+    if (!meshShaderPath) {
+        desc.shaderName = "indirect";
+        err = driver->CreatePipeline(desc, &fallbackPipeline);
+        VK_CHECK_ERROR(err);
+
+        printf("[meshlet] mesh shader not supported, falling back to indexed draws\n");
+        return err;
+    }
+
+    desc.shaderName = "meshlet";
+    err = driver->CreateMeshPipeline(desc, &meshPipeline);
+    VK_CHECK_ERROR(err);
+
+    err = driver->CreateBuffer(capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, &meshletBuffer);
+    VK_CHECK_ERROR(err);
+
+    driver->SetBufferName(meshletBuffer, "meshlet/clusters");
+
+    VmaVirtualBlockCreateInfo virtualBlockCreateInfo = {};
+    virtualBlockCreateInfo.size = capacity;
+
+    err = vmaCreateVirtualBlock(&virtualBlockCreateInfo, &meshletBlock);
+    VK_CHECK_ERROR(err);
+
+    printf("[meshlet] mesh shader path, capacity=%llu bytes\n", (unsigned long long) capacity);
+
+    return err;
+}
+
+VkResult MeshletRenderer::AddMesh(Mesh mesh, const void *vertices, uint32_t vertexCount, const uint32_t *indices, uint32_t indexCount, MeshletMesh *pMesh)
+{
+    VkResult err;
+
+    /* meshlet 和 indirect 路径都按 float 顶点读取，不解码压缩格式 */
+    if (geometry->GetMeshRange(mesh).vertexFormat != VERTEX_FORMAT_FLOAT)
+        return VK_ERROR_FORMAT_NOT_SUPPORTED;
+
+    MeshletRange range = {};
+    range.mesh = mesh;
+
+    if (meshShaderPath) {
+        MeshletData data;
+        BuildMeshlets(vertices, geometry->GetVertexStride(), vertexCount, indices, indexCount, &data);
+
+        const VkDeviceSize meshletBytes = std::size(data.meshlets) * sizeof(Meshlet);
+        const VkDeviceSize vertexBytes = std::size(data.vertices) * sizeof(uint32_t);
+        const VkDeviceSize triangleBytes = std::size(data.triangles) * sizeof(uint32_t);
+
+        VmaVirtualAllocationCreateInfo allocationCreateInfo = {};
+        allocationCreateInfo.size = meshletBytes + vertexBytes + triangleBytes;
+        allocationCreateInfo.alignment = MESHLET_DATA_ALIGNMENT;
+
+        err = vmaVirtualAllocate(meshletBlock, &allocationCreateInfo, &range.allocation, &range.offset);
+        VK_CHECK_ERROR(err);
+
+        /* 三段数据拼成一块，一次写入 */
+        std::vector<uint8_t> packed(allocationCreateInfo.size);
+        memcpy(std::data(packed), std::data(data.meshlets), meshletBytes);
+        memcpy(std::data(packed) + meshletBytes, std::data(data.vertices), vertexBytes);
+        memcpy(std::data(packed) + meshletBytes + vertexBytes, std::data(data.triangles), triangleBytes);
+
+        err = driver->WriteBuffer(meshletBuffer, range.offset, std::data(packed), std::size(packed));
+        if (err != VK_SUCCESS) {
+            vmaVirtualFree(meshletBlock, range.allocation);
+            return err;
+        }
+
+        range.meshletCount = (uint32_t) std::size(data.meshlets);
+        range.vertexCount = (uint32_t) std::size(data.vertices);
+        range.triangleCount = (uint32_t) std::size(data.triangles);
+
+        meshletCount += range.meshletCount;
+        usedBytes += allocationCreateInfo.size;
+    }
+
+    uint32_t handle = meshHandles.Allocate();
+    uint32_t slot = HandlePool::IndexOf(handle);
+
+    if (slot >= std::size(ranges))
+        ranges.resize(meshHandles.GetCapacity());
+
+    ranges[slot] = range;
+    pMesh->id = handle;
+
+    return VK_SUCCESS;
+}
+
+void MeshletRenderer::RemoveMesh(MeshletMesh mesh)
+{
+    uint32_t slot = _GetMeshSlot(mesh);
+    MeshletRange& range = ranges[slot];
+
+    /* 当前帧可能还会用到这段数据，帧结束后再回收空间 */
+    if (range.allocation != VK_NULL_HANDLE) {
+        PendingFree pending = {};
+        pending.allocation = range.allocation;
+        pending.frameNumber = driver->GetFrameNumber();
+        pendingFrees.push_back(pending);
+
+        VmaVirtualAllocationInfo allocationInfo = {};
+        vmaGetVirtualAllocationInfo(meshletBlock, range.allocation, &allocationInfo);
+
+        meshletCount -= range.meshletCount;
+        usedBytes -= allocationInfo.size;
+    }
+
+    range = {};
+    meshHandles.Free(mesh.id);
+}
+
+void MeshletRenderer::Collect()
+{
+    uint64_t completedFrameNumber = driver->GetCompletedFrameNumber();
+
+    std::erase_if(pendingFrees, [this, completedFrameNumber](const PendingFree& pending) {
+        if (pending.frameNumber > completedFrameNumber)
+            return false;
+
+        vmaVirtualFree(meshletBlock, pending.allocation);
+        return true;
+    });
+}
+
+VkResult MeshletRenderer::CmdDraw(const glm::mat4& viewProjection, const glm::vec3& cameraPosition, MeshletMesh mesh, const glm::mat4& model)
+{
+    VkResult err;
+
+    const MeshletRange& range = ranges[_GetMeshSlot(mesh)];
+
+    if (!meshShaderPath)
+        return _DrawFallback(viewProjection, range, model);
+
+    if (range.meshletCount == 0)
+        return VK_SUCCESS;
+
+    TransientBuffer paramsBuffer = {};
+    err = driver->AllocateTransient(sizeof(DrawParams), 16, &paramsBuffer);
+    VK_CHECK_ERROR(err);
+
+    /* megabuffer 压紧后顶点位置会变，每次绘制都重新取 */
+    const MeshRange& meshRange = geometry->GetMeshRange(range.mesh);
+    const uint32_t vertexStride = geometry->GetVertexStride();
+    const VkDeviceAddress meshletAddress = driver->GetBufferAddress(meshletBuffer) + range.offset;
+
+    Frustum frustum = ExtractFrustum(viewProjection);
+
+    DrawParams *params = (DrawParams *) paramsBuffer.pMapped;
+    params->viewProjection = viewProjection;
+    params->model = model;
+    memcpy(params->frustumPlanes, frustum.planes, sizeof(frustum.planes));
+    params->cameraPosition = glm::vec4(cameraPosition, 1.0f);
+    params->vertexAddress = driver->GetBufferAddress(geometry->GetVertexBuffer()) + (VkDeviceAddress) meshRange.firstVertex * vertexStride;
+    params->meshletAddress = meshletAddress;
+    params->meshletVertexAddress = meshletAddress + (VkDeviceAddress) range.meshletCount * sizeof(Meshlet);
+    params->meshletTriangleAddress = params->meshletVertexAddress + (VkDeviceAddress) range.vertexCount * sizeof(uint32_t);
+    params->meshletCount = range.meshletCount;
+    params->vertexStride = vertexStride / sizeof(float);
+
+    PushConstants pushConstants = {};
+    pushConstants.paramsAddress = paramsBuffer.address;
+
+    driver->CmdBindPipeline(meshPipeline);
+    driver->CmdPushConstants(&pushConstants, sizeof(pushConstants));
+    driver->CmdDrawMeshTasks((range.meshletCount + MESHLET_TASK_GROUP_SIZE - 1) / MESHLET_TASK_GROUP_SIZE, 1, 1);
+
+    /* 只通过地址访问，驱逐和碎片整理需要知道这一帧用到了 */
+    driver->TouchBuffer(meshletBuffer);
+    driver->TouchBuffer(geometry->GetVertexBuffer());
+
+    return VK_SUCCESS;
+}
+
+MeshletStats MeshletRenderer::GetStats() const
+{
+    MeshletStats stats = {};
+    stats.meshCount = meshHandles.GetLiveCount();
+    stats.meshletCount = meshletCount;
+    stats.usedBytes = usedBytes;
+
+    return stats;
+}
+
+VkResult MeshletRenderer::_DrawFallback(const glm::mat4& viewProjection, const MeshletRange& range, const glm::mat4& model)
+{
+    VkResult err;
+
+    /* indirect.vert 用 gl_InstanceIndex 从 object buffer 取变换，这里临时写一个物体 */
+    TransientBuffer objectBuffer = {};
+    err = driver->AllocateTransient(sizeof(GpuObject), 16, &objectBuffer);
+    VK_CHECK_ERROR(err);
+
+    VkDrawIndexedIndirectCommand command = geometry->GetDrawCommand(range.mesh);
+
+    GpuObject *object = (GpuObject *) objectBuffer.pMapped;
+    *object = {};
+    object->model = model;
+
+    FallbackPushConstants pushConstants = {};
+    pushConstants.viewProjection = viewProjection;
+    pushConstants.objectAddress = objectBuffer.address;
+
+    driver->CmdBindPipeline(fallbackPipeline);
+    driver->CmdPushConstants(&pushConstants, sizeof(pushConstants));
+    geometry->CmdBindBuffers();
+    driver->CmdDrawIndexed(command.indexCount, 1, command.firstIndex, command.vertexOffset, 0);
+
+    return VK_SUCCESS;
+}
+
+uint32_t MeshletRenderer::_GetMeshSlot(MeshletMesh mesh) const
+{
+    assert(meshHandles.IsValid(mesh.id));
+    return HandlePool::IndexOf(mesh.id);
+}
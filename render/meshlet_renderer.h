@@ -0,0 +1,114 @@
+#ifndef MESHLET_RENDERER_H_
+#define MESHLET_RENDERER_H_
+
+#include "driver/render_driver.h"
+#include "render/geometry_manager.h"
+#include "render/meshlet_builder.h"
+
+#include <glm/glm.hpp>
+
+// std
+#include <vector>
+
+typedef struct MeshletMesh {
+    uint32_t id = 0;
+    bool operator==(const MeshletMesh&) const = default;
+} MeshletMesh;
+
+typedef struct MeshletStats {
+    uint32_t meshCount = 0;
+    uint32_t meshletCount = 0;
+    VkDeviceSize usedBytes = 0;
+} MeshletStats;
+
+/*
+ * 以 meshlet 为粒度绘制 GeometryManager 里的 mesh：task shader 对每个 meshlet 做视锥和法线锥背面剔除，
+ * mesh shader 直接从 megabuffer 读顶点。设备不支持 VK_EXT_mesh_shader 时退回整个 mesh 的 indexed draw，
+ * 调用方式不变。meshlet 数据按 mesh 放在同一个 buffer 里，空间由 VMA virtual block 管理。
+ * 只能在主线程使用。
+ */
+class MeshletRenderer
+{
+public:
+    MeshletRenderer(RenderDriver *driver, GeometryManager *geometry, VkDeviceSize capacity);
+   ~MeshletRenderer();
+
+    VkResult Initialize();
+
+    /* 生成 meshlet 并上传，vertices/indices 必须和 UploadMesh 传给 geometry 的一致，只支持 VERTEX_FORMAT_FLOAT */
+    VkResult AddMesh(Mesh mesh, const void *vertices, uint32_t vertexCount, const uint32_t *indices, uint32_t indexCount, MeshletMesh *pMesh);
+    void RemoveMesh(MeshletMesh mesh);
+    /* 回收 GPU 已经用完的空间，每帧调用一次 */
+    void Collect();
+
+    /* 在 BeginRendering 之后调用，cameraPosition 是世界空间的相机位置，用于背面剔除 */
+    VkResult CmdDraw(const glm::mat4& viewProjection, const glm::vec3& cameraPosition, MeshletMesh mesh, const glm::mat4& model);
+
+    bool IsMeshShaderPath() const { return meshShaderPath; }
+    MeshletStats GetStats() const;
+
+private:
+    /* 和 meshlet.task、meshlet.mesh 的 DrawParams 一致，放在临时内存里 */
+    struct DrawParams {
+        glm::mat4 viewProjection;
+        glm::mat4 model;
+        glm::vec4 frustumPlanes[6];
+        glm::vec4 cameraPosition;
+        VkDeviceAddress vertexAddress;          // mesh 第一个顶点的地址
+        VkDeviceAddress meshletAddress;
+        VkDeviceAddress meshletVertexAddress;
+        VkDeviceAddress meshletTriangleAddress;
+        uint32_t meshletCount;
+        uint32_t vertexStride;                  // 单位是 float
+        uint32_t padding[2];
+    };
+
+    static_assert(sizeof(DrawParams) == 288, "DrawParams must match the std430 layout in meshlet.task");
+
+    struct PushConstants {
+        VkDeviceAddress paramsAddress;
+    };
+
+    struct FallbackPushConstants {
+        glm::mat4 viewProjection;
+        VkDeviceAddress objectAddress;
+    };
+
+    /* 一个 mesh 的数据依次是 meshlets、vertices、triangles，偏移单位是字节 */
+    struct MeshletRange {
+        Mesh mesh;
+        VmaVirtualAllocation allocation;
+        VkDeviceSize offset;
+        uint32_t meshletCount;
+        uint32_t vertexCount;
+        uint32_t triangleCount;
+    };
+
+    struct PendingFree {
+        VmaVirtualAllocation allocation;
+        uint64_t frameNumber;
+    };
+
+    VkResult _DrawFallback(const glm::mat4& viewProjection, const MeshletRange& range, const glm::mat4& model);
+    uint32_t _GetMeshSlot(MeshletMesh mesh) const;
+
+    RenderDriver *driver = VK_NULL_HANDLE;
+    GeometryManager *geometry = VK_NULL_HANDLE;
+    VkDeviceSize capacity = 0;
+    bool meshShaderPath = false;
+
+    Pipeline meshPipeline = {};
+    Pipeline fallbackPipeline = {};
+    Buffer meshletBuffer = {};
+    VmaVirtualBlock meshletBlock = VK_NULL_HANDLE;
+
+    // 按 slot 下标存放
+    HandlePool meshHandles;
+    std::vector<MeshletRange> ranges;
+
+    std::vector<PendingFree> pendingFrees;
+    uint32_t meshletCount = 0;
+    VkDeviceSize usedBytes = 0;
+};
+
+#endif /* MESHLET_RENDERER_H_ */
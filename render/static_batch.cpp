@@ -0,0 +1,292 @@
+#include "static_batch.h"
+
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#define VK_CHECK_ERROR(err) \
+    if (err != VK_SUCCESS) \
+        return err;
+
+#define STATIC_BATCH_MAGIC "ASHSTBT"
+#define STATIC_BATCH_VERSION 2       // 2：header 记录 chunk 结构体大小
+#define STATIC_BATCH_VERTEX_FLOATS 6
+#define MAX_CHUNK_VERTICES 65536        // 超过后同一组拆成多个 chunk，单个 mesh 超过时不拆
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+typedef struct StaticBatchHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t chunkCount;
+    uint64_t sourceHash;
+    uint32_t vertexFloatCount;
+    uint32_t indexCount;
+    uint32_t chunkStride;           // sizeof(StaticBatchChunk)，结构体改了忘记升版本时也能发现
+} StaticBatchHeader;
+
+static uint64_t HashBytes(uint64_t hash, const void *data, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t *) data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+StaticBatchBuilder::StaticBatchBuilder(float chunkSize)
+    : chunkSize(chunkSize)
+{
+    sourceHash = HashBytes(FNV_OFFSET_BASIS, &chunkSize, sizeof(chunkSize));
+}
+
+void StaticBatchBuilder::AddMesh(const float *vertices, uint32_t vertexCount, const uint32_t *indices, uint32_t indexCount, const glm::mat4& model, uint32_t material)
+{
+    glm::vec3 boundsMin(FLT_MAX);
+    glm::vec3 boundsMax(-FLT_MAX);
+
+    for (uint32_t i = 0; i < vertexCount; i++) {
+        const float *v = &vertices[i * STATIC_BATCH_VERTEX_FLOATS];
+        glm::vec3 position = glm::vec3(model * glm::vec4(v[0], v[1], v[2], 1.0f));
+        boundsMin = glm::min(boundsMin, position);
+        boundsMax = glm::max(boundsMax, position);
+    }
+
+    Source source = {};
+    source.vertices = vertices;
+    source.vertexCount = vertexCount;
+    source.indices = indices;
+    source.indexCount = indexCount;
+    source.model = model;
+    source.material = material;
+    source.cell = vertexCount > 0 ? glm::ivec3(glm::floor((boundsMin + boundsMax) * 0.5f / chunkSize)) : glm::ivec3(0);
+    sources.push_back(source);
+
+    sourceHash = HashBytes(sourceHash, vertices, (size_t) vertexCount * STATIC_BATCH_VERTEX_FLOATS * sizeof(float));
+    sourceHash = HashBytes(sourceHash, indices, (size_t) indexCount * sizeof(uint32_t));
+    sourceHash = HashBytes(sourceHash, &model, sizeof(model));
+    sourceHash = HashBytes(sourceHash, &material, sizeof(material));
+}
+
+void StaticBatchBuilder::Build(StaticBatchData *pData) const
+{
+    pData->sourceHash = sourceHash;
+    pData->chunks.clear();
+    pData->vertices.clear();
+    pData->indices.clear();
+
+    /* 同一材质、同一网格的 mesh 排到一起，相同键保持添加顺序，结果是确定的 */
+    std::vector<uint32_t> order(std::size(sources));
+    for (uint32_t i = 0; i < (uint32_t) std::size(order); i++)
+        order[i] = i;
+
+    auto groupLess = [this](uint32_t a, uint32_t b) {
+        const Source& sa = sources[a];
+        const Source& sb = sources[b];
+        if (sa.material != sb.material)
+            return sa.material < sb.material;
+        if (sa.cell.x != sb.cell.x)
+            return sa.cell.x < sb.cell.x;
+        if (sa.cell.y != sb.cell.y)
+            return sa.cell.y < sb.cell.y;
+        return sa.cell.z < sb.cell.z;
+    };
+
+    std::stable_sort(order.begin(), order.end(), groupLess);
+
+    for (uint32_t first = 0; first < (uint32_t) std::size(order);) {
+        /* 一个 chunk 从 first 开始，同组内按顶点上限截断 */
+        uint32_t last = first;
+        uint32_t chunkVertices = 0;
+
+        while (last < (uint32_t) std::size(order) &&
+               !groupLess(order[first], order[last]) &&
+               (last == first || chunkVertices + sources[order[last]].vertexCount <= MAX_CHUNK_VERTICES)) {
+            chunkVertices += sources[order[last]].vertexCount;
+            last++;
+        }
+
+        /* 先求世界空间包围盒，中心作为 chunk 原点，坐标变小后 float 精度也更好 */
+        glm::vec3 boundsMin(FLT_MAX);
+        glm::vec3 boundsMax(-FLT_MAX);
+
+        for (uint32_t i = first; i < last; i++) {
+            const Source& source = sources[order[i]];
+            for (uint32_t v = 0; v < source.vertexCount; v++) {
+                const float *src = &source.vertices[v * STATIC_BATCH_VERTEX_FLOATS];
+                glm::vec3 position = glm::vec3(source.model * glm::vec4(src[0], src[1], src[2], 1.0f));
+                boundsMin = glm::min(boundsMin, position);
+                boundsMax = glm::max(boundsMax, position);
+            }
+        }
+
+        StaticBatchChunk chunk = {};
+        chunk.origin = chunkVertices > 0 ? (boundsMin + boundsMax) * 0.5f : glm::vec3(0.0f);
+        chunk.material = sources[order[first]].material;
+        chunk.firstVertex = (uint32_t) (std::size(pData->vertices) / STATIC_BATCH_VERTEX_FLOATS);
+        chunk.firstIndex = (uint32_t) std::size(pData->indices);
+
+        float radius = 0.0f;
+
+        for (uint32_t i = first; i < last; i++) {
+            const Source& source = sources[order[i]];
+            const uint32_t baseVertex = chunk.vertexCount;
+
+            for (uint32_t v = 0; v < source.vertexCount; v++) {
+                const float *src = &source.vertices[v * STATIC_BATCH_VERTEX_FLOATS];
+                glm::vec3 position = glm::vec3(source.model * glm::vec4(src[0], src[1], src[2], 1.0f)) - chunk.origin;
+                radius = glm::max(radius, glm::length(position));
+
+                pData->vertices.insert(pData->vertices.end(), { position.x, position.y, position.z, src[3], src[4], src[5] });
+            }
+
+            /* 镜像变换会翻转三角形的绕序，交换两个顶点保持正面朝向 */
+            const bool flip = glm::determinant(glm::mat3(source.model)) < 0.0f;
+
+            for (uint32_t t = 0; t + 2 < source.indexCount; t += 3) {
+                uint32_t i0 = source.indices[t] + baseVertex;
+                uint32_t i1 = source.indices[t + 1] + baseVertex;
+                uint32_t i2 = source.indices[t + 2] + baseVertex;
+
+                if (flip)
+                    pData->indices.insert(pData->indices.end(), { i0, i2, i1 });
+                else
+                    pData->indices.insert(pData->indices.end(), { i0, i1, i2 });
+            }
+
+            chunk.vertexCount += source.vertexCount;
+        }
+
+        chunk.indexCount = (uint32_t) std::size(pData->indices) - chunk.firstIndex;
+        chunk.boundingSphere = glm::vec4(0.0f, 0.0f, 0.0f, radius);
+        pData->chunks.push_back(chunk);
+
+        first = last;
+    }
+
+    printf("[static] %u meshes batched into %u chunks, %u vertices, %u indices\n",
+        (uint32_t) std::size(sources), (uint32_t) std::size(pData->chunks),
+        (uint32_t) (std::size(pData->vertices) / STATIC_BATCH_VERTEX_FLOATS), (uint32_t) std::size(pData->indices));
+}
+
+bool LoadStaticBatches(const char *path, uint64_t sourceHash, StaticBatchData *pData)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return false;
+
+    StaticBatchHeader header = {};
+
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, STATIC_BATCH_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != STATIC_BATCH_VERSION) {
+        printf("[static] ignore batch cache %s, unknown version\n", path);
+        fclose(file);
+        return false;
+    }
+
+    if (header.sourceHash != sourceHash) {
+        printf("[static] batch cache %s is stale\n", path);
+        fclose(file);
+        return false;
+    }
+
+    /* 先用文件长度检查计数，损坏的 header 不会导致超大的分配 */
+    uint64_t expectedSize = sizeof(header) + (uint64_t) header.chunkCount * sizeof(StaticBatchChunk) +
+        (uint64_t) header.vertexFloatCount * sizeof(float) + (uint64_t) header.indexCount * sizeof(uint32_t);
+
+    long fileSize = -1;
+    if (fseek(file, 0, SEEK_END) == 0)
+        fileSize = ftell(file);
+
+    if (header.chunkStride != sizeof(StaticBatchChunk) || header.vertexFloatCount % STATIC_BATCH_VERTEX_FLOATS != 0 ||
+        fileSize < 0 || (uint64_t) fileSize != expectedSize || fseek(file, sizeof(header), SEEK_SET) != 0) {
+        printf("[static] batch cache %s is corrupt\n", path);
+        fclose(file);
+        return false;
+    }
+
+    pData->sourceHash = header.sourceHash;
+    pData->chunks.resize(header.chunkCount);
+    pData->vertices.resize(header.vertexFloatCount);
+    pData->indices.resize(header.indexCount);
+
+    bool ok = fread(std::data(pData->chunks), sizeof(StaticBatchChunk), header.chunkCount, file) == header.chunkCount &&
+              fread(std::data(pData->vertices), sizeof(float), header.vertexFloatCount, file) == header.vertexFloatCount &&
+              fread(std::data(pData->indices), sizeof(uint32_t), header.indexCount, file) == header.indexCount;
+
+    fclose(file);
+
+    if (!ok) {
+        printf("[static] batch cache %s is truncated\n", path);
+        *pData = {};
+        return false;
+    }
+
+    /* UploadStaticBatches 直接按 chunk 里的范围取数据，越界的缓存整个丢掉重新生成 */
+    const uint64_t vertexCount = header.vertexFloatCount / STATIC_BATCH_VERTEX_FLOATS;
+
+    for (const StaticBatchChunk& chunk : pData->chunks) {
+        ok = (uint64_t) chunk.firstVertex + chunk.vertexCount <= vertexCount &&
+             (uint64_t) chunk.firstIndex + chunk.indexCount <= header.indexCount;
+
+        for (uint32_t i = 0; ok && i < chunk.indexCount; i++)
+            ok = pData->indices[chunk.firstIndex + i] < chunk.vertexCount;
+
+        if (!ok) {
+            printf("[static] batch cache %s has an out of range chunk\n", path);
+            *pData = {};
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool SaveStaticBatches(const char *path, const StaticBatchData& data)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+        return false;
+
+    StaticBatchHeader header = {};
+    memcpy(header.magic, STATIC_BATCH_MAGIC, sizeof(header.magic));
+    header.version = STATIC_BATCH_VERSION;
+    header.chunkCount = (uint32_t) std::size(data.chunks);
+    header.sourceHash = data.sourceHash;
+    header.vertexFloatCount = (uint32_t) std::size(data.vertices);
+    header.indexCount = (uint32_t) std::size(data.indices);
+    header.chunkStride = sizeof(StaticBatchChunk);
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(std::data(data.chunks), sizeof(StaticBatchChunk), header.chunkCount, file) == header.chunkCount &&
+              fwrite(std::data(data.vertices), sizeof(float), header.vertexFloatCount, file) == header.vertexFloatCount &&
+              fwrite(std::data(data.indices), sizeof(uint32_t), header.indexCount, file) == header.indexCount;
+
+    fclose(file);
+
+    return ok;
+}
+
+VkResult UploadStaticBatches(GeometryManager *geometry, const StaticBatchData& data, std::vector<Mesh> *pMeshes)
+{
+    VkResult err = VK_SUCCESS;
+
+    pMeshes->clear();
+    pMeshes->reserve(std::size(data.chunks));
+
+    for (const StaticBatchChunk& chunk : data.chunks) {
+        Mesh mesh = {};
+        err = geometry->UploadMesh(&data.vertices[(size_t) chunk.firstVertex * STATIC_BATCH_VERTEX_FLOATS], chunk.vertexCount,
+            &data.indices[chunk.firstIndex], chunk.indexCount, &mesh);
+        VK_CHECK_ERROR(err);
+
+        pMeshes->push_back(mesh);
+    }
+
+    return err;
+}
@@ -0,0 +1,69 @@
+#ifndef STATIC_BATCH_H_
+#define STATIC_BATCH_H_
+
+#include "render/geometry_manager.h"
+
+#include <glm/glm.hpp>
+
+// std
+#include <vector>
+
+/* 合并后的一个 chunk，范围是 StaticBatchData 数组里的下标，索引相对 firstVertex */
+typedef struct StaticBatchChunk {
+    glm::vec3 origin;               // chunk 空间的原点（世界坐标），绘制时 model 就是平移到这里
+    uint32_t material;
+    glm::vec4 boundingSphere;       // chunk 空间
+    uint32_t firstVertex;
+    uint32_t vertexCount;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+} StaticBatchChunk;
+
+typedef struct StaticBatchData {
+    uint64_t sourceHash = 0;        // 生成时输入的哈希，缓存文件和场景对不上就重新生成
+    std::vector<StaticBatchChunk> chunks;
+    std::vector<float> vertices;    // VERTEX_FORMAT_FLOAT，chunk 空间
+    std::vector<uint32_t> indices;
+} StaticBatchData;
+
+/*
+ * 场景构建步骤：不会移动的 mesh 按 (材质, 空间网格) 分组合并，每组变成一个 chunk，
+ * 顶点变换到以 chunk 包围盒中心为原点的空间，一个 chunk 只需要一次 draw，
+ * 网格足够小时视锥和遮挡剔除依然有效。顶点格式是 position + color。
+ */
+class StaticBatchBuilder
+{
+public:
+    explicit StaticBatchBuilder(float chunkSize);
+
+    /* 数据在 Build 之前必须保持有效 */
+    void AddMesh(const float *vertices, uint32_t vertexCount, const uint32_t *indices, uint32_t indexCount, const glm::mat4& model, uint32_t material);
+
+    /* 所有输入的哈希，不用 Build 就能判断缓存文件是否可用 */
+    uint64_t GetSourceHash() const { return sourceHash; }
+    void Build(StaticBatchData *pData) const;
+
+private:
+    struct Source {
+        const float *vertices;
+        uint32_t vertexCount;
+        const uint32_t *indices;
+        uint32_t indexCount;
+        glm::mat4 model;
+        uint32_t material;
+        glm::ivec3 cell;            // 世界空间包围盒中心所在的网格
+    };
+
+    float chunkSize = 0.0f;
+    std::vector<Source> sources;
+    uint64_t sourceHash = 0;
+};
+
+/* 二进制缓存，sourceHash 不一致或者版本不对时返回 false */
+bool LoadStaticBatches(const char *path, uint64_t sourceHash, StaticBatchData *pData);
+bool SaveStaticBatches(const char *path, const StaticBatchData& data);
+
+/* 每个 chunk 上传为一个 mesh，pMeshes 和 chunks 一一对应 */
+VkResult UploadStaticBatches(GeometryManager *geometry, const StaticBatchData& data, std::vector<Mesh> *pMeshes);
+
+#endif /* STATIC_BATCH_H_ */
@@ -0,0 +1,29 @@
+#include "vertex_format.h"
+
+#include <glm/gtc/packing.hpp>
+
+void PackVertices(const float *vertices, uint32_t vertexCount, std::vector<PackedVertex> *pPacked)
+{
+    pPacked->resize(vertexCount);
+
+    for (uint32_t i = 0; i < vertexCount; i++) {
+        const float *v = &vertices[i * 6];
+        PackedVertex& packed = (*pPacked)[i];
+
+        packed.positionXY = glm::packHalf2x16(glm::vec2(v[0], v[1]));
+        packed.positionZ = glm::packHalf2x16(glm::vec2(v[2], 0.0f));
+        packed.color = glm::packUnorm4x8(glm::vec4(v[3], v[4], v[5], 1.0f));
+    }
+}
+
+uint32_t GetVertexFormatSize(VertexFormat format)
+{
+    switch (format) {
+        case VERTEX_FORMAT_FLOAT:
+            return sizeof(float) * 6;
+        case VERTEX_FORMAT_PACKED:
+            return sizeof(PackedVertex);
+    }
+
+    return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef VERTEX_FORMAT_H_
+#define VERTEX_FORMAT_H_
+
+#include <glm/glm.hpp>
+
+// std
+#include <stdint.h>
+#include <vector>
+
+/* 顶点拉取（pulled.vert）支持的顶点格式，数值和 shader 一致，存在 GpuObject::vertexFormat 里 */
+typedef enum VertexFormat {
+    VERTEX_FORMAT_FLOAT = 0,        // position + color，各 3 个 float，24 字节
+    VERTEX_FORMAT_PACKED = 1,       // PackedVertex，12 字节
+} VertexFormat;
+
+/* position 是半精度浮点，color 是 8 位 unorm，shader 用 unpackHalf2x16/unpackUnorm4x8 解码 */
+typedef struct PackedVertex {
+    uint32_t positionXY;
+    uint32_t positionZ;             // 高 16 位未使用
+    uint32_t color;                 // alpha 固定为 1
+} PackedVertex;
+
+static_assert(sizeof(PackedVertex) == 12, "PackedVertex must match the decoder in pulled.vert");
+
+/* vertices 是 VERTEX_FORMAT_FLOAT 布局，color 分量在 [0, 1] 之外的会被截断 */
+void PackVertices(const float *vertices, uint32_t vertexCount, std::vector<PackedVertex> *pPacked);
+
+uint32_t GetVertexFormatSize(VertexFormat format);
+
+#endif /* VERTEX_FORMAT_H_ */
@@ -0,0 +1,247 @@
+#include "visibility.h"
+
+#include <string.h>
+#include <algorithm>
+
+/*
+ * 和 glm/simd/platform.h 的检测方式一致，但不定义 GLM_FORCE_INTRINSICS：
+ * 那样会改变 glm 类型的对齐，和 GPU 结构体的布局对不上。
+ */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VISIBILITY_SIMD_WIDTH 8
+#elif defined(__SSE2__) || defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VISIBILITY_SIMD_WIDTH 4
+#else
+#define VISIBILITY_SIMD_WIDTH 1
+#endif
+
+#define VISIBILITY_BATCH_SIZE 1024      // 每个任务处理的物体数，SIMD 宽度的整数倍
+
+static_assert(VISIBILITY_BATCH_SIZE % VISIBILITY_SIMD_WIDTH == 0, "batch must be a multiple of the SIMD width");
+
+VisibilityCuller::VisibilityCuller(JobSystem *jobSystem)
+    : jobSystem(jobSystem)
+{
+
+}
+
+VisibilityObject VisibilityCuller::AddObject(const glm::vec4& boundingSphere, const glm::vec3& aabbMin, const glm::vec3& aabbMax, uint32_t data)
+{
+    uint32_t handle = objectHandles.Allocate();
+    uint32_t slot = HandlePool::IndexOf(handle);
+
+    if (slot >= std::size(slotToDense))
+        slotToDense.resize(objectHandles.GetCapacity(), UINT32_MAX);
+
+    uint32_t dense = GetObjectCount();
+    slotToDense[slot] = dense;
+    denseToSlot.push_back(slot);
+
+    centerX.push_back(0.0f);
+    centerY.push_back(0.0f);
+    centerZ.push_back(0.0f);
+    radius.push_back(0.0f);
+    minX.push_back(0.0f);
+    minY.push_back(0.0f);
+    minZ.push_back(0.0f);
+    maxX.push_back(0.0f);
+    maxY.push_back(0.0f);
+    maxZ.push_back(0.0f);
+    userData.push_back(data);
+
+    VisibilityObject object = {};
+    object.id = handle;
+
+    SetBounds(object, boundingSphere, aabbMin, aabbMax);
+
+    return object;
+}
+
+void VisibilityCuller::RemoveObject(VisibilityObject object)
+{
+    uint32_t dense = _GetDenseIndex(object);
+    uint32_t last = GetObjectCount() - 1;
+
+    /* 末尾的物体搬到空位上，数组保持连续 */
+    if (dense != last) {
+        centerX[dense] = centerX[last];
+        centerY[dense] = centerY[last];
+        centerZ[dense] = centerZ[last];
+        radius[dense] = radius[last];
+        minX[dense] = minX[last];
+        minY[dense] = minY[last];
+        minZ[dense] = minZ[last];
+        maxX[dense] = maxX[last];
+        maxY[dense] = maxY[last];
+        maxZ[dense] = maxZ[last];
+        userData[dense] = userData[last];
+
+        uint32_t movedSlot = denseToSlot[last];
+        denseToSlot[dense] = movedSlot;
+        slotToDense[movedSlot] = dense;
+    }
+
+    centerX.pop_back();
+    centerY.pop_back();
+    centerZ.pop_back();
+    radius.pop_back();
+    minX.pop_back();
+    minY.pop_back();
+    minZ.pop_back();
+    maxX.pop_back();
+    maxY.pop_back();
+    maxZ.pop_back();
+    userData.pop_back();
+    denseToSlot.pop_back();
+
+    slotToDense[HandlePool::IndexOf(object.id)] = UINT32_MAX;
+    objectHandles.Free(object.id);
+}
+
+void VisibilityCuller::SetBounds(VisibilityObject object, const glm::vec4& boundingSphere, const glm::vec3& aabbMin, const glm::vec3& aabbMax)
+{
+    uint32_t dense = _GetDenseIndex(object);
+
+    centerX[dense] = boundingSphere.x;
+    centerY[dense] = boundingSphere.y;
+    centerZ[dense] = boundingSphere.z;
+    radius[dense] = boundingSphere.w;
+    minX[dense] = aabbMin.x;
+    minY[dense] = aabbMin.y;
+    minZ[dense] = aabbMin.z;
+    maxX[dense] = aabbMax.x;
+    maxY[dense] = aabbMax.y;
+    maxZ[dense] = aabbMax.z;
+}
+
+void VisibilityCuller::Cull(const Frustum& frustum, std::vector<uint32_t> *pVisible)
+{
+    const uint32_t count = GetObjectCount();
+    const uint32_t batchCount = (count + VISIBILITY_BATCH_SIZE - 1) / VISIBILITY_BATCH_SIZE;
+
+    /* 每块先写到和输入对应的区间里，不需要同步 */
+    pVisible->resize(count);
+    batchCounts.resize(batchCount);
+
+    uint32_t *out = std::data(*pVisible);
+
+    jobSystem->ParallelFor(count, VISIBILITY_BATCH_SIZE, [this, &frustum, out](uint32_t begin, uint32_t end) {
+        batchCounts[begin / VISIBILITY_BATCH_SIZE] = _CullRange(frustum, begin, end, out + begin);
+    });
+
+    /* 按块顺序压紧，第一块本来就在开头 */
+    uint32_t visibleCount = batchCount > 0 ? batchCounts[0] : 0;
+    for (uint32_t i = 1; i < batchCount; i++) {
+        memmove(out + visibleCount, out + (size_t) i * VISIBILITY_BATCH_SIZE, batchCounts[i] * sizeof(uint32_t));
+        visibleCount += batchCounts[i];
+    }
+
+    pVisible->resize(visibleCount);
+}
+
+uint32_t VisibilityCuller::_CullRange(const Frustum& frustum, uint32_t begin, uint32_t end, uint32_t *pOut) const
+{
+    /* AABB 对每个平面只需要测试法线方向上最远的角，按法线符号在 min/max 数组之间选 */
+    const float *cornerX[6];
+    const float *cornerY[6];
+    const float *cornerZ[6];
+
+    for (int p = 0; p < 6; p++) {
+        const glm::vec4& plane = frustum.planes[p];
+        cornerX[p] = plane.x >= 0.0f ? std::data(maxX) : std::data(minX);
+        cornerY[p] = plane.y >= 0.0f ? std::data(maxY) : std::data(minY);
+        cornerZ[p] = plane.z >= 0.0f ? std::data(maxZ) : std::data(minZ);
+    }
+
+    uint32_t visibleCount = 0;
+    uint32_t i = begin;
+
+#if VISIBILITY_SIMD_WIDTH == 8
+    for (; i + 8 <= end; i += 8) {
+        __m256 cx = _mm256_loadu_ps(&centerX[i]);
+        __m256 cy = _mm256_loadu_ps(&centerY[i]);
+        __m256 cz = _mm256_loadu_ps(&centerZ[i]);
+        __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&radius[i]));
+        __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+        for (int p = 0; p < 6; p++) {
+            __m256 nx = _mm256_set1_ps(frustum.planes[p].x);
+            __m256 ny = _mm256_set1_ps(frustum.planes[p].y);
+            __m256 nz = _mm256_set1_ps(frustum.planes[p].z);
+            __m256 d = _mm256_set1_ps(frustum.planes[p].w);
+
+            __m256 sphereDistance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, cx), _mm256_mul_ps(ny, cy)), _mm256_add_ps(_mm256_mul_ps(nz, cz), d));
+            visible = _mm256_and_ps(visible, _mm256_cmp_ps(sphereDistance, negRadius, _CMP_GE_OQ));
+
+            __m256 px = _mm256_loadu_ps(&cornerX[p][i]);
+            __m256 py = _mm256_loadu_ps(&cornerY[p][i]);
+            __m256 pz = _mm256_loadu_ps(&cornerZ[p][i]);
+
+            __m256 boxDistance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, px), _mm256_mul_ps(ny, py)), _mm256_add_ps(_mm256_mul_ps(nz, pz), d));
+            visible = _mm256_and_ps(visible, _mm256_cmp_ps(boxDistance, _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+
+        uint32_t mask = (uint32_t) _mm256_movemask_ps(visible);
+        while (mask != 0) {
+            pOut[visibleCount++] = userData[i + __builtin_ctz(mask)];
+            mask &= mask - 1;
+        }
+    }
+#elif VISIBILITY_SIMD_WIDTH == 4
+    for (; i + 4 <= end; i += 4) {
+        __m128 cx = _mm_loadu_ps(&centerX[i]);
+        __m128 cy = _mm_loadu_ps(&centerY[i]);
+        __m128 cz = _mm_loadu_ps(&centerZ[i]);
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radius[i]));
+        __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+        for (int p = 0; p < 6; p++) {
+            __m128 nx = _mm_set1_ps(frustum.planes[p].x);
+            __m128 ny = _mm_set1_ps(frustum.planes[p].y);
+            __m128 nz = _mm_set1_ps(frustum.planes[p].z);
+            __m128 d = _mm_set1_ps(frustum.planes[p].w);
+
+            __m128 sphereDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_add_ps(_mm_mul_ps(nz, cz), d));
+            visible = _mm_and_ps(visible, _mm_cmpge_ps(sphereDistance, negRadius));
+
+            __m128 px = _mm_loadu_ps(&cornerX[p][i]);
+            __m128 py = _mm_loadu_ps(&cornerY[p][i]);
+            __m128 pz = _mm_loadu_ps(&cornerZ[p][i]);
+
+            __m128 boxDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, px), _mm_mul_ps(ny, py)), _mm_add_ps(_mm_mul_ps(nz, pz), d));
+            visible = _mm_and_ps(visible, _mm_cmpge_ps(boxDistance, _mm_setzero_ps()));
+        }
+
+        uint32_t mask = (uint32_t) _mm_movemask_ps(visible);
+        for (uint32_t lane = 0; lane < 4; lane++) {
+            if (mask & (1u << lane))
+                pOut[visibleCount++] = userData[i + lane];
+        }
+    }
+#endif
+
+    /* 不足一组的尾部逐个测试，结果和 SIMD 路径一致 */
+    for (; i < end; i++) {
+        bool visible = true;
+
+        for (int p = 0; p < 6 && visible; p++) {
+            const glm::vec4& plane = frustum.planes[p];
+            float sphereDistance = plane.x * centerX[i] + plane.y * centerY[i] + plane.z * centerZ[i] + plane.w;
+            float boxDistance = plane.x * cornerX[p][i] + plane.y * cornerY[p][i] + plane.z * cornerZ[p][i] + plane.w;
+            visible = sphereDistance >= -radius[i] && boxDistance >= 0.0f;
+        }
+
+        if (visible)
+            pOut[visibleCount++] = userData[i];
+    }
+
+    return visibleCount;
+}
+
+uint32_t VisibilityCuller::_GetDenseIndex(VisibilityObject object) const
+{
+    assert(objectHandles.IsValid(object.id));
+    return slotToDense[HandlePool::IndexOf(object.id)];
+}
@@ -0,0 +1,67 @@
+#ifndef VISIBILITY_H_
+#define VISIBILITY_H_
+
+#include "driver/handle_pool.h"
+#include "render/frustum.h"
+#include "utils/job_system.h"
+
+#include <glm/glm.hpp>
+
+// std
+#include <vector>
+
+typedef struct VisibilityObject {
+    uint32_t id = 0;
+    bool operator==(const VisibilityObject&) const = default;
+} VisibilityObject;
+
+/*
+ * CPU 端的视锥剔除：世界空间的包围球和 AABB 按分量分开存成 SoA 数组，
+ * 一次对 8 个（AVX2）或 4 个（SSE2）物体测试六个平面，按块分给 JobSystem 并行，
+ * 输出紧凑的可见列表给 draw 提交使用。物体删除时用末尾的物体填空，数组始终连续。
+ * 只能在主线程修改，Cull 期间工作线程只读。
+ */
+class VisibilityCuller
+{
+public:
+    explicit VisibilityCuller(JobSystem *jobSystem);
+
+    /* userData 原样出现在可见列表里，一般是 draw 或物体的下标 */
+    VisibilityObject AddObject(const glm::vec4& boundingSphere, const glm::vec3& aabbMin, const glm::vec3& aabbMax, uint32_t userData);
+    void RemoveObject(VisibilityObject object);
+    void SetBounds(VisibilityObject object, const glm::vec4& boundingSphere, const glm::vec3& aabbMin, const glm::vec3& aabbMax);
+
+    /* 包围球和 AABB 都和视锥相交才算可见，pVisible 按存储顺序写入可见物体的 userData */
+    void Cull(const Frustum& frustum, std::vector<uint32_t> *pVisible);
+
+    uint32_t GetObjectCount() const { return static_cast<uint32_t>(std::size(userData)); }
+
+private:
+    uint32_t _CullRange(const Frustum& frustum, uint32_t begin, uint32_t end, uint32_t *pOut) const;
+    uint32_t _GetDenseIndex(VisibilityObject object) const;
+
+    JobSystem *jobSystem = nullptr;
+
+    // SoA，按 dense 下标存放
+    std::vector<float> centerX;
+    std::vector<float> centerY;
+    std::vector<float> centerZ;
+    std::vector<float> radius;
+    std::vector<float> minX;
+    std::vector<float> minY;
+    std::vector<float> minZ;
+    std::vector<float> maxX;
+    std::vector<float> maxY;
+    std::vector<float> maxZ;
+    std::vector<uint32_t> userData;
+
+    // 句柄 slot 和 dense 下标互相映射
+    HandlePool objectHandles;
+    std::vector<uint32_t> slotToDense;
+    std::vector<uint32_t> denseToSlot;
+
+    // 每块的可见数，Cull 时各块先写到自己的区间再压紧
+    std::vector<uint32_t> batchCounts;
+};
+
+#endif /* VISIBILITY_H_ */
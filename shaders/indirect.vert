@@ -0,0 +1,42 @@
+/**
+ * -- Vertex Shader File --
+ *
+ * GPU 剔除后的间接绘制，物体变换通过 gl_InstanceIndex（即 firstInstance）从 object buffer 读取。
+ */
+#version 460
+
+#extension GL_EXT_buffer_reference : require
+
+struct GpuObject {
+    mat4 model;
+    vec4 boundingSphere;
+    uint firstIndex;
+    uint indexCount;
+    int vertexOffset;
+    uint vertexFormat;
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 16) readonly buffer ObjectBuffer {
+    GpuObject objects[];
+};
+
+layout(push_constant) uniform PushConstants {
+    mat4 viewProjection;
+    ObjectBuffer objectBuffer;
+} pc;
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 color;
+
+layout(location = 0) out vec3 outColor;
+
+/* 深度预渲染和着色 pass 用 EQUAL 比较，两个 pipeline 算出的位置必须逐位相同 */
+invariant gl_Position;
+
+void main()
+{
+    mat4 model = pc.objectBuffer.objects[gl_InstanceIndex].model;
+
+    gl_Position = pc.viewProjection * model * vec4(pos, 1.0f);
+    outColor = color;
+}
@@ -0,0 +1,22 @@
+/**
+ * -- Vertex Shader File --
+ *
+ * 实例化绘制，model 矩阵来自 binding 1 的逐实例顶点属性，每列占一个 location。
+ */
+#version 450
+
+layout(push_constant) uniform PushConstants {
+    mat4 viewProjection;
+} pc;
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 color;
+layout(location = 2) in mat4 model;
+
+layout(location = 0) out vec3 outColor;
+
+void main()
+{
+    gl_Position = pc.viewProjection * model * vec4(pos, 1.0f);
+    outColor = color;
+}
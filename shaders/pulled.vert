@@ -0,0 +1,67 @@
+/**
+ * -- Vertex Shader File --
+ *
+ * 顶点拉取：pipeline 没有顶点输入，按 gl_VertexIndex 从 megabuffer 的地址读原始数据，
+ * 再按物体的 vertexFormat 解码，不同格式的 mesh 可以放进同一个间接绘制。
+ */
+#version 460
+
+#extension GL_EXT_buffer_reference : require
+
+#define VERTEX_FORMAT_FLOAT 0
+#define VERTEX_FORMAT_PACKED 1
+
+struct GpuObject {
+    mat4 model;
+    vec4 boundingSphere;
+    uint firstIndex;
+    uint indexCount;
+    int vertexOffset;
+    uint vertexFormat;
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 16) readonly buffer ObjectBuffer {
+    GpuObject objects[];
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer VertexBuffer {
+    uint words[];
+};
+
+layout(push_constant) uniform PushConstants {
+    mat4 viewProjection;
+    ObjectBuffer objectBuffer;
+    VertexBuffer vertexBuffer;
+    uint vertexStride;      // megabuffer 的槽位大小，单位是 uint
+} pc;
+
+layout(location = 0) out vec3 outColor;
+
+invariant gl_Position;
+
+void main()
+{
+    GpuObject object = pc.objectBuffer.objects[gl_InstanceIndex];
+
+    /* gl_VertexIndex 已经加上了 vertexOffset，减掉之后才是 mesh 内的下标 */
+    uint base = uint(object.vertexOffset) * pc.vertexStride;
+    uint local = uint(gl_VertexIndex - object.vertexOffset);
+
+    vec3 pos;
+    vec3 color;
+
+    if (object.vertexFormat == VERTEX_FORMAT_PACKED) {
+        uint w = base + local * 3;
+        vec2 xy = unpackHalf2x16(pc.vertexBuffer.words[w]);
+        float z = unpackHalf2x16(pc.vertexBuffer.words[w + 1]).x;
+        pos = vec3(xy, z);
+        color = unpackUnorm4x8(pc.vertexBuffer.words[w + 2]).rgb;
+    } else {
+        uint w = base + local * pc.vertexStride;
+        pos = uintBitsToFloat(uvec3(pc.vertexBuffer.words[w], pc.vertexBuffer.words[w + 1], pc.vertexBuffer.words[w + 2]));
+        color = uintBitsToFloat(uvec3(pc.vertexBuffer.words[w + 3], pc.vertexBuffer.words[w + 4], pc.vertexBuffer.words[w + 5]));
+    }
+
+    gl_Position = pc.viewProjection * object.model * vec4(pos, 1.0f);
+    outColor = color;
+}
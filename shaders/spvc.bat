@@ -5,10 +5,10 @@ set SCRIPT_DIR=%~dp0
 echo [spvc] script dirname: %SCRIPT_DIR%
 cd /d "%SCRIPT_DIR%"
 
-for %%f in (*.vert *.frag) do (
+for %%f in (*.vert *.frag *.comp *.task *.mesh) do (
     if exist "%%f" (
         echo [spvc] compiling %%f ...
-        glslangValidator -V "%%f" -o "%%f.spv"
+        glslangValidator -V --target-env vulkan1.3 "%%f" -o "%%f.spv"
     )
 )
 
@@ -25,4 +25,10 @@ static void io_free_buf(char *buf)
     free(buf);
 }
 
+/* 只读映射整个文件，返回的地址按页对齐，失败返回 NULL */
+void *io_map_file(const char *path, size_t *size);
+void io_unmap_file(void *buf, size_t size);
+/* 映射的粒度，映射实际覆盖的长度是文件大小按它向上对齐 */
+size_t io_page_size();
+
 #endif /* _IOUTILS_H_ */
@@ -0,0 +1,135 @@
+#include "job_system.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+JobSystem::JobSystem(uint32_t threadCount)
+{
+    if (threadCount == 0) {
+        /* 留一个核给主线程 */
+        uint32_t hardwareThreads = std::thread::hardware_concurrency();
+        threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    for (uint32_t i = 0; i < threadCount; i++)
+        workers.emplace_back(&JobSystem::_WorkerMain, this);
+}
+
+JobSystem::~JobSystem()
+{
+    Shutdown();
+}
+
+void JobSystem::Submit(Job job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+
+    jobAvailable.notify_one();
+}
+
+void JobSystem::ParallelFor(uint32_t count, uint32_t batchSize, const RangeJob& job)
+{
+    if (count == 0)
+        return;
+
+    const uint32_t batchCount = (count + batchSize - 1) / batchSize;
+
+    if (batchCount == 1 || workers.empty()) {
+        job(0, count);
+        return;
+    }
+
+    /*
+     * 状态放在堆上，晚启动的工作线程在函数返回后才运行时也不会访问已经释放的栈，
+     * 这时所有块都已领完，它不会再碰 job。
+     */
+    struct ParallelState {
+        std::atomic<uint32_t> nextBatch = 0;
+        std::atomic<uint32_t> doneBatches = 0;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+
+    auto state = std::make_shared<ParallelState>();
+
+    auto run = [state, count, batchSize, batchCount, &job]() {
+        for (;;) {
+            uint32_t batch = state->nextBatch++;
+            if (batch >= batchCount)
+                return;
+
+            uint32_t begin = batch * batchSize;
+            job(begin, std::min(count, begin + batchSize));
+
+            if (++state->doneBatches == batchCount) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->finished.notify_all();
+            }
+        }
+    };
+
+    uint32_t helperCount = std::min(GetThreadCount(), batchCount - 1);
+    for (uint32_t i = 0; i < helperCount; i++)
+        Submit(run);
+
+    run();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&state, batchCount] { return state->doneBatches == batchCount; });
+}
+
+void JobSystem::WaitIdle()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    jobsFinished.wait(lock, [this] { return jobs.empty() && activeJobs == 0; });
+}
+
+void JobSystem::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping)
+            return;
+        stopping = true;
+    }
+
+    jobAvailable.notify_all();
+
+    for (std::thread &worker : workers) {
+        if (worker.joinable())
+            worker.join();
+    }
+}
+
+void JobSystem::_WorkerMain()
+{
+    for (;;) {
+        Job job;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+
+            /* 退出前把队列里剩下的任务跑完 */
+            if (jobs.empty())
+                return;
+
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            activeJobs++;
+        }
+
+        job();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            activeJobs--;
+            if (jobs.empty() && activeJobs == 0)
+                jobsFinished.notify_all();
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef _JOB_SYSTEM_H_
+#define _JOB_SYSTEM_H_
+
+// std
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * 简单的后台线程池，用来跑 pipeline 编译之类不能卡住帧的任务，
+ * 也可以用 ParallelFor 把一帧内的计算拆给所有线程。
+ */
+class JobSystem
+{
+public:
+    typedef std::function<void()> Job;
+    typedef std::function<void(uint32_t begin, uint32_t end)> RangeJob;
+
+    explicit JobSystem(uint32_t threadCount = 0);
+   ~JobSystem();
+
+    void Submit(Job job);
+    /*
+     * 把 [0, count) 按 batchSize 切块，调用线程和工作线程一起领取执行，全部完成后返回。
+     * 工作线程被长任务占住时调用线程会自己做完，不会一直等。
+     */
+    void ParallelFor(uint32_t count, uint32_t batchSize, const RangeJob& job);
+    void WaitIdle();
+    void Shutdown();
+
+    uint32_t GetThreadCount() const { return static_cast<uint32_t>(std::size(workers)); }
+
+private:
+    void _WorkerMain();
+
+    std::vector<std::thread> workers;
+    std::deque<Job> jobs;
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::condition_variable jobsFinished;
+    uint32_t activeJobs = 0;
+    bool stopping = false;
+};
+
+#endif /* _JOB_SYSTEM_H_ */